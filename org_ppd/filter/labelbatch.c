@@ -0,0 +1,861 @@
+/*
+ * "$Id$"
+ *
+ *   Job batching for the label printer filters.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ *
+ *   CUPS runs one job per queue at a time, so jobs are batched by keeping
+ *   the filter that ran the first one alive for a short window instead of
+ *   holding output back.  The filter for each job hands its raster, output,
+ *   status and back channel descriptors to this batcher over a local
+ *   socket and waits for its exit status, so pages and status messages are
+ *   still reported against the job they belong to.  The batcher keeps the
+ *   printer setup, PPD and caches of the earlier jobs and exits once no job
+ *   arrives within the window.
+ *
+ *   A batcher can also be started on its own with LabelBatchServe() and
+ *   then serves a queue until it is stopped.  Its jobs come from the
+ *   labelshim filter, which sends the job's arguments and environment
+ *   along with its files, so jobs with any options can use it and the
+ *   filter itself does no more than connect.
+ *
+ * Contents:
+ *
+ *   LabelBatchJoin()     - Hand a job to the batcher, starting one if needed.
+ *   LabelBatchSend()     - Hand a job with its arguments to a served batcher.
+ *   LabelBatchServe()    - Become a batcher that serves jobs until stopped.
+ *   LabelBatchNext()     - Wait for the next job in the batcher.
+ *   LabelBatchArgs()     - Return the arguments of the current job.
+ *   LabelBatchDone()     - Report the end of a job and release its files.
+ *   labelbatch_args()    - Read the arguments and environment of a job.
+ *   labelbatch_cancel()  - Cancel the current job when its filter asks.
+ *   labelbatch_connect() - Connect to the batcher.
+ *   labelbatch_forward() - Pass a cancel on to the batcher.
+ *   labelbatch_listen()  - Become the batcher.
+ *   labelbatch_run()     - Send a job to the batcher and wait for it.
+ *   labelbatch_unlock()  - Remove the lock file and release the lock.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "labelbatch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+/*
+ * Constants...
+ *
+ * A job is sent as one "J" byte carrying the raster, output, status and
+ * (if open) back channel descriptors.  The batcher answers "A" when it
+ * starts the job and "0" or "1" with the exit status when it is done; any
+ * byte from the filter or a hangup while the job runs cancels it.
+ *
+ * A job for a served batcher starts with an "R" byte instead, followed by
+ * a 4-byte length in network order and the six filter arguments and the
+ * environment as nul-terminated strings.
+ */
+
+#define LABELBATCH_FDS		4	/* Most descriptors per job */
+#define LABELBATCH_TRIES	100	/* Connect attempts while starting */
+#define LABELBATCH_HIGHFD	10	/* Lowest descriptor kept by batcher */
+#define LABELBATCH_ARGC		6	/* Number of filter arguments */
+#define LABELBATCH_ARGS		65536	/* Most bytes of arguments */
+
+
+/*
+ * Globals...
+ */
+
+static char		BatchPath[sizeof(((struct sockaddr_un *)0)->sun_path)];
+					/* Batcher socket filename */
+static int		BatchListen = -1;
+					/* Listening socket in batcher */
+static char		BatchLock[sizeof(BatchPath) + 5];
+					/* Lock filename */
+static int		BatchLockFd = -1;
+					/* Lock file in batcher */
+static volatile int	BatchJob = -1;	/* Connection for current job */
+static volatile int	BatchClient = -1;
+					/* Connection in the job's filter */
+static void		(*BatchCancel)(int) = NULL;
+					/* Cancel handler for jobs */
+static char		*BatchData = NULL;
+					/* Arguments and environment of job */
+static size_t		BatchSize = 0;	/* Allocated size of BatchData */
+static char		**BatchArgv = NULL;
+					/* Arguments, then environment */
+static int		BatchAlloc = 0,	/* Allocated entries in BatchArgv */
+			BatchHasArgs = 0;
+					/* Did the current job send arguments? */
+static char		**BatchEnviron = NULL;
+					/* Environment of the batcher */
+
+extern char		**environ;	/* Environment of the current job */
+
+
+/*
+ * Local functions...
+ */
+
+static int	labelbatch_args(int sock);
+static void	labelbatch_cancel(int sig);
+static int	labelbatch_connect(void);
+static void	labelbatch_forward(int sig);
+static int	labelbatch_listen(int detach);
+static int	labelbatch_run(int sock, int fd, const char *args,
+		               size_t length, int *status);
+static void	labelbatch_unlock(void);
+
+
+/*
+ * 'LabelBatchJoin()' - Hand a job to the batcher, starting one if needed.
+ *
+ * Returns 1 if the batcher ran the job, with its exit status in "status",
+ * 0 in a new batcher process that should serve jobs with LabelBatchNext(),
+ * and -1 if the job should be printed here.
+ */
+
+int					/* O - 1 = done, 0 = batcher, -1 = print */
+LabelBatchJoin(const char *key,		/* I - Batch key for queue and options */
+               int        fd,		/* I - Raster file */
+	       int        *status)	/* O - Exit status of job */
+{
+  int			sock,		/* Connection to batcher */
+			i;		/* Looping var */
+  pid_t			pid;		/* Batcher process */
+  const char		*tmpdir;	/* TMPDIR env var */
+
+
+  if ((tmpdir = getenv("TMPDIR")) == NULL)
+    tmpdir = "/tmp";
+
+  if (snprintf(BatchPath, sizeof(BatchPath), "%s/%s.batch", tmpdir,
+               key) >= (int)sizeof(BatchPath))
+    return (-1);
+
+ /*
+  * Find the batcher, or start one...
+  */
+
+  if ((sock = labelbatch_connect()) < 0)
+  {
+    if ((pid = fork()) == 0)
+    {
+      if (labelbatch_listen(1))
+        _exit(0);
+
+      return (0);
+    }
+    else if (pid < 0)
+      return (-1);
+
+    for (i = 0; i < LABELBATCH_TRIES && (sock = labelbatch_connect()) < 0;
+         i ++)
+      usleep(10000);
+
+    if (sock < 0)
+      return (-1);
+  }
+
+  return (labelbatch_run(sock, fd, NULL, 0, status));
+}
+
+
+/*
+ * 'LabelBatchSend()' - Hand a job with its arguments to a served batcher.
+ *
+ * The first six arguments and the environment are sent along with the
+ * job's files.  Returns 1 if the batcher ran the job, with its exit status
+ * in "status", and -1 if there is no batcher or it did not take the job.
+ */
+
+int					/* O - 1 = done, -1 = print */
+LabelBatchSend(const char *path,	/* I - Batcher socket */
+               int        fd,		/* I - Raster file */
+	       char       *argv[],	/* I - Filter arguments */
+	       int        *status)	/* O - Exit status of job */
+{
+  int		sock,			/* Connection to batcher */
+		i,			/* Looping var */
+		result;			/* Result of job */
+  size_t	length,			/* Length of arguments */
+		bytes;			/* Length of string */
+  char		*args,			/* Arguments and environment */
+		*ptr;			/* Pointer into args */
+
+
+  if (snprintf(BatchPath, sizeof(BatchPath), "%s", path) >=
+          (int)sizeof(BatchPath))
+    return (-1);
+
+ /*
+  * Collect the arguments and environment...
+  */
+
+  for (i = 0, length = 0; i < LABELBATCH_ARGC; i ++)
+    length += strlen(argv[i]) + 1;
+
+  for (i = 0; environ[i]; i ++)
+    length += strlen(environ[i]) + 1;
+
+  if (length > LABELBATCH_ARGS || (args = malloc(length)) == NULL)
+    return (-1);
+
+  for (i = 0, ptr = args; i < LABELBATCH_ARGC; i ++, ptr += bytes)
+  {
+    bytes = strlen(argv[i]) + 1;
+    memcpy(ptr, argv[i], bytes);
+  }
+
+  for (i = 0; environ[i]; i ++, ptr += bytes)
+  {
+    bytes = strlen(environ[i]) + 1;
+    memcpy(ptr, environ[i], bytes);
+  }
+
+ /*
+  * Send the job...
+  */
+
+  if ((sock = labelbatch_connect()) < 0)
+    result = -1;
+  else
+    result = labelbatch_run(sock, fd, args, length, status);
+
+  free(args);
+
+  return (result);
+}
+
+
+/*
+ * 'LabelBatchServe()' - Become a batcher that serves jobs until stopped.
+ *
+ * Jobs are then taken with LabelBatchNext() with a window of -1.  Fails
+ * if another batcher is already serving on "path".
+ */
+
+int					/* O - 0 on success, -1 on error */
+LabelBatchServe(const char *path)	/* I - Batcher socket */
+{
+  if (snprintf(BatchPath, sizeof(BatchPath), "%s", path) >=
+          (int)sizeof(BatchPath))
+  {
+    errno = ENAMETOOLONG;
+    return (-1);
+  }
+
+  return (labelbatch_listen(0));
+}
+
+
+/*
+ * 'LabelBatchNext()' - Wait for the next job in the batcher.
+ *
+ * The job's raster file is installed as the standard input, its output and
+ * status as the standard output and error, and its back channel as file 3;
+ * a job from labelshim also gets its own environment.  Returns -1 once no
+ * job has arrived for "window" milliseconds, which -1 makes forever.
+ */
+
+int					/* O - Raster file or -1 when done */
+LabelBatchNext(int  window,		/* I - Batch window in ms or -1 */
+               void (*cancel)(int))	/* I - Cancel handler */
+{
+  int			sock,		/* Job connection */
+			i,		/* Looping var */
+			fds[LABELBATCH_FDS],
+					/* Descriptors for the job */
+			num_fds;	/* Number of descriptors */
+  char			ch;		/* Job byte */
+  struct pollfd		pfd;		/* Listening socket */
+  struct msghdr		msg;		/* Job message */
+  struct iovec		iov;		/* Job message data */
+  struct cmsghdr	*cmsg;		/* Descriptors */
+  char			control[CMSG_SPACE(sizeof(fds))];
+					/* Descriptor buffer */
+  struct sigaction	action;		/* Cancel handler */
+
+
+  BatchCancel = cancel;
+
+  while (BatchListen >= 0)
+  {
+    pfd.fd     = BatchListen;
+    pfd.events = POLLIN;
+
+    if ((i = poll(&pfd, 1, BatchPath[0] ? window : 0)) < 0 && errno == EINTR)
+      continue;
+
+    if (i <= 0)
+    {
+     /*
+      * Take one last look after removing the socket, so no filter that
+      * found it is left waiting...
+      */
+
+      if (BatchPath[0])
+      {
+        unlink(BatchPath);
+	BatchPath[0] = '\0';
+	continue;
+      }
+
+      close(BatchListen);
+      BatchListen = -1;
+
+      labelbatch_unlock();
+      break;
+    }
+
+    if ((i = accept(BatchListen, NULL, NULL)) < 0)
+      continue;
+
+   /*
+    * Keep the connection clear of the descriptors the job is given...
+    */
+
+    sock = fcntl(i, F_DUPFD, LABELBATCH_HIGHFD);
+    close(i);
+
+    if (sock < 0)
+      continue;
+
+    memset(&msg, 0, sizeof(msg));
+
+    iov.iov_base       = &ch;
+    iov.iov_len        = 1;
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(sock, &msg, 0) != 1 || (ch != 'J' && ch != 'R') ||
+        (cmsg = CMSG_FIRSTHDR(&msg)) == NULL ||
+	cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+    {
+      close(sock);
+      continue;
+    }
+
+    num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    memcpy(fds, CMSG_DATA(cmsg), num_fds * sizeof(int));
+
+    BatchHasArgs = ch == 'R';
+
+    if (num_fds < 3 || (BatchHasArgs && labelbatch_args(sock)))
+    {
+      for (i = 0; i < num_fds; i ++)
+        close(fds[i]);
+
+      close(sock);
+      continue;
+    }
+
+   /*
+    * Install the job's files...
+    */
+
+    for (i = 0; i < num_fds; i ++)
+      if (fds[i] != i)
+      {
+	dup2(fds[i], i);
+	close(fds[i]);
+      }
+
+    if (num_fds < 4)
+      close(3);
+
+   /*
+    * Cancel the job if its filter writes to or drops the connection...
+    */
+
+    BatchJob = sock;
+
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = labelbatch_cancel;
+    sigaction(SIGIO, &action, NULL);
+
+    fcntl(sock, F_SETOWN, getpid());
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_ASYNC | O_NONBLOCK);
+
+    write(sock, "A", 1);
+
+    labelbatch_cancel(SIGIO);
+
+    return (0);
+  }
+
+  return (-1);
+}
+
+
+/*
+ * 'LabelBatchArgs()' - Return the arguments of the current job.
+ *
+ * The six filter arguments are returned as a NULL-terminated array, or
+ * NULL for a job sent by LabelBatchJoin(), which has no arguments.
+ */
+
+char **					/* O - Filter arguments or NULL */
+LabelBatchArgs(void)
+{
+  return (BatchHasArgs ? BatchArgv : NULL);
+}
+
+
+/*
+ * 'LabelBatchDone()' - Report the end of a job and release its files.
+ */
+
+void
+LabelBatchDone(int status)		/* I - Exit status of job */
+{
+  int	sock = BatchJob;		/* Job connection */
+  int	null;				/* /dev/null */
+
+
+  if (sock < 0)
+    return;
+
+  BatchJob = -1;
+
+  fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) & ~(O_ASYNC | O_NONBLOCK));
+  write(sock, status ? "1" : "0", 1);
+  close(sock);
+
+  if ((null = open("/dev/null", O_RDWR)) >= 0)
+  {
+    dup2(null, 0);
+    dup2(null, 1);
+    dup2(null, 2);
+    close(null);
+  }
+
+  close(3);
+}
+
+
+/*
+ * 'labelbatch_args()' - Read the arguments and environment of a job.
+ *
+ * The environment becomes the batcher's until the next job is read.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+labelbatch_args(int sock)		/* I - Job connection */
+{
+  unsigned char	header[4];		/* Length of arguments */
+  size_t	length,			/* Length of arguments */
+		total;			/* Bytes read */
+  ssize_t	bytes;			/* Bytes read by this call */
+  char		*ptr,			/* Pointer into arguments */
+		*end;			/* End of arguments */
+  int		count;			/* Number of strings */
+  void		*temp;			/* New buffer */
+
+
+  if (!BatchEnviron)
+    BatchEnviron = environ;
+
+  environ = BatchEnviron;
+
+  for (total = 0; total < sizeof(header); total += bytes)
+    if ((bytes = read(sock, header + total, sizeof(header) - total)) <= 0)
+      return (-1);
+
+  length = ((size_t)header[0] << 24) | ((size_t)header[1] << 16) |
+           ((size_t)header[2] << 8) | header[3];
+
+  if (length < 1 || length > LABELBATCH_ARGS)
+    return (-1);
+
+  if (length > BatchSize)
+  {
+    if ((temp = realloc(BatchData, length)) == NULL)
+      return (-1);
+
+    BatchData = temp;
+    BatchSize = length;
+  }
+
+  for (total = 0; total < length; total += bytes)
+    if ((bytes = read(sock, BatchData + total, length - total)) <= 0)
+      return (-1);
+
+  if (BatchData[length - 1])
+    return (-1);
+
+ /*
+  * Point at each string; the arguments and environment are each followed
+  * by a NULL entry...
+  */
+
+  for (count = 0, ptr = BatchData, end = BatchData + length; ptr < end;
+       ptr += strlen(ptr) + 1)
+    count ++;
+
+  if (count < LABELBATCH_ARGC)
+    return (-1);
+
+  if (count + 2 > BatchAlloc)
+  {
+    if ((temp = realloc(BatchArgv, (count + 2) * sizeof(char *))) == NULL)
+      return (-1);
+
+    BatchArgv  = temp;
+    BatchAlloc = count + 2;
+  }
+
+  for (count = 0, ptr = BatchData; ptr < end; ptr += strlen(ptr) + 1)
+  {
+    if (count == LABELBATCH_ARGC)
+      BatchArgv[count ++] = NULL;
+
+    BatchArgv[count ++] = ptr;
+  }
+
+  if (count == LABELBATCH_ARGC)
+    BatchArgv[count ++] = NULL;
+
+  BatchArgv[count] = NULL;
+
+  environ = BatchArgv + LABELBATCH_ARGC + 1;
+
+  return (0);
+}
+
+
+/*
+ * 'labelbatch_cancel()' - Cancel the current job when its filter asks.
+ */
+
+static void
+labelbatch_cancel(int sig)		/* I - Signal */
+{
+  char	ch;				/* Cancel byte */
+  int	saved = errno;			/* Saved errno */
+
+
+  if (BatchJob >= 0 && recv(BatchJob, &ch, 1, MSG_PEEK | MSG_DONTWAIT) >= 0 &&
+      BatchCancel)
+    (*BatchCancel)(sig);
+
+  errno = saved;
+}
+
+
+/*
+ * 'labelbatch_connect()' - Connect to the batcher.
+ */
+
+static int				/* O - Connection or -1 */
+labelbatch_connect(void)
+{
+  int			sock;		/* Connection */
+  struct sockaddr_un	addr;		/* Socket address */
+
+
+  if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    return (-1);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, BatchPath, sizeof(BatchPath));
+
+  if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)))
+  {
+    close(sock);
+    return (-1);
+  }
+
+  return (sock);
+}
+
+
+/*
+ * 'labelbatch_forward()' - Pass a cancel on to the batcher.
+ */
+
+static void
+labelbatch_forward(int sig)		/* I - Signal */
+{
+  int	saved = errno;			/* Saved errno */
+
+
+  (void)sig;
+
+  if (BatchClient >= 0)
+    write(BatchClient, "C", 1);
+
+  errno = saved;
+}
+
+
+/*
+ * 'labelbatch_listen()' - Become the batcher.
+ *
+ * A batcher started by a job leaves the session and drops every file of
+ * that job, so CUPS does not wait for it to finish the job.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+labelbatch_listen(int detach)		/* I - Started by a job? */
+{
+  int			i,		/* Looping var */
+			null,		/* /dev/null */
+			lockfd,		/* Lock file */
+			sock;		/* Listening socket */
+  long			max_fd;		/* Highest descriptor */
+  struct stat		lockinfo,	/* Locked file information */
+			fileinfo;	/* Lock filename information */
+  struct sockaddr_un	addr;		/* Socket address */
+
+
+  signal(SIGPIPE, SIG_IGN);
+
+  if (detach)
+  {
+    setsid();
+
+    if ((max_fd = sysconf(_SC_OPEN_MAX)) < 0 || max_fd > 1024)
+      max_fd = 1024;
+
+    for (i = 3; i < max_fd; i ++)
+      close(i);
+
+    if ((null = open("/dev/null", O_RDWR)) < 0)
+      return (-1);
+
+    dup2(null, 0);
+    dup2(null, 1);
+    dup2(null, 2);
+    close(null);
+  }
+
+ /*
+  * Only one batcher per key; a new one waits for an old one to finish,
+  * while a served batcher gives way to one that is already serving...
+  */
+
+  snprintf(BatchLock, sizeof(BatchLock), "%s.lock", BatchPath);
+
+  for (;;)
+  {
+    if ((i = open(BatchLock, O_RDWR | O_CREAT, 0600)) < 0)
+      return (-1);
+
+    lockfd = fcntl(i, F_DUPFD, LABELBATCH_HIGHFD);
+    close(i);
+
+    if (lockfd < 0)
+      return (-1);
+
+    if (flock(lockfd, detach ? LOCK_EX : LOCK_EX | LOCK_NB))
+    {
+      close(lockfd);
+      return (-1);
+    }
+
+   /*
+    * A batcher removes the lock file as it exits, so the file we waited
+    * on may be gone; lock the one now in its place...
+    */
+
+    if (!fstat(lockfd, &lockinfo) && !stat(BatchLock, &fileinfo) &&
+        lockinfo.st_dev == fileinfo.st_dev &&
+	lockinfo.st_ino == fileinfo.st_ino)
+      break;
+
+    close(lockfd);
+  }
+
+  BatchLockFd = lockfd;
+
+  if ((i = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+  {
+    labelbatch_unlock();
+    return (-1);
+  }
+
+  sock = fcntl(i, F_DUPFD, LABELBATCH_HIGHFD);
+  close(i);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, BatchPath, sizeof(BatchPath));
+
+  unlink(BatchPath);
+
+  if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(sock, SOMAXCONN))
+  {
+    unlink(BatchPath);
+    labelbatch_unlock();
+    return (-1);
+  }
+
+  BatchListen = sock;
+
+  return (0);
+}
+
+
+/*
+ * 'labelbatch_run()' - Send a job to the batcher and wait for it.
+ */
+
+static int				/* O - 1 = done, -1 = not taken */
+labelbatch_run(int        sock,		/* I - Connection to batcher */
+               int        fd,		/* I - Raster file */
+	       const char *args,	/* I - Arguments or NULL */
+	       size_t     length,	/* I - Length of arguments */
+	       int        *status)	/* O - Exit status of job */
+{
+  int			fds[LABELBATCH_FDS],
+					/* Descriptors for the job */
+			num_fds;	/* Number of descriptors */
+  char			ch;		/* Reply byte */
+  unsigned char		header[5];	/* Job byte and argument length */
+  ssize_t		bytes;		/* Bytes read or sent */
+  size_t		total;		/* Bytes of arguments sent */
+  int			accepted;	/* Has the batcher started the job? */
+  struct msghdr		msg;		/* Job message */
+  struct iovec		iov[2];		/* Job message data */
+  struct cmsghdr	*cmsg;		/* Descriptors */
+  char			control[CMSG_SPACE(sizeof(fds))];
+					/* Descriptor buffer */
+  struct sigaction	action,		/* Cancel forwarding */
+			oldaction;	/* Previous SIGTERM action */
+
+
+ /*
+  * Send the job...
+  */
+
+  fds[0]  = fd;
+  fds[1]  = 1;
+  fds[2]  = 2;
+  fds[3]  = 3;
+  num_fds = fcntl(3, F_GETFD) != -1 ? 4 : 3;
+
+  header[0] = args ? 'R' : 'J';
+  header[1] = (unsigned char)(length >> 24);
+  header[2] = (unsigned char)(length >> 16);
+  header[3] = (unsigned char)(length >> 8);
+  header[4] = (unsigned char)length;
+
+  memset(&msg, 0, sizeof(msg));
+  memset(control, 0, sizeof(control));
+
+  iov[0].iov_base    = header;
+  iov[0].iov_len     = args ? 5 : 1;
+  iov[1].iov_base    = (void *)args;
+  iov[1].iov_len     = length;
+  msg.msg_iov        = iov;
+  msg.msg_iovlen     = args ? 2 : 1;
+  msg.msg_control    = control;
+  msg.msg_controllen = CMSG_SPACE(num_fds * sizeof(int));
+
+  cmsg             = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type  = SCM_RIGHTS;
+  cmsg->cmsg_len   = CMSG_LEN(num_fds * sizeof(int));
+  memcpy(CMSG_DATA(cmsg), fds, num_fds * sizeof(int));
+
+  if ((bytes = sendmsg(sock, &msg, 0)) < (ssize_t)iov[0].iov_len)
+  {
+    close(sock);
+    return (-1);
+  }
+
+  for (total = (size_t)bytes - iov[0].iov_len; args && total < length;
+       total += (size_t)bytes)
+    if ((bytes = write(sock, args + total, length - total)) <= 0)
+    {
+      close(sock);
+      return (-1);
+    }
+
+ /*
+  * Pass a cancel on to the batcher while waiting for the job to finish...
+  */
+
+  BatchClient = sock;
+
+  memset(&action, 0, sizeof(action));
+  sigemptyset(&action.sa_mask);
+  action.sa_handler = labelbatch_forward;
+  sigaction(SIGTERM, &action, &oldaction);
+
+  for (accepted = 0; (bytes = read(sock, &ch, 1)) != 0;)
+  {
+    if (bytes < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    if (ch == 'A')
+      accepted = 1;
+    else
+      break;
+  }
+
+  sigaction(SIGTERM, &oldaction, NULL);
+
+  BatchClient = -1;
+  close(sock);
+
+  if (!accepted)
+    return (-1);
+
+  *status = bytes == 1 ? ch != '0' : 1;
+
+  return (1);
+}
+
+
+
+/*
+ * 'labelbatch_unlock()' - Remove the lock file and release the lock.
+ *
+ * The file is removed while it is still locked, so a batcher waiting for
+ * it finds it gone and locks a new one instead.
+ */
+
+static void
+labelbatch_unlock(void)
+{
+  if (BatchLockFd < 0)
+    return;
+
+  unlink(BatchLock);
+  close(BatchLockFd);
+
+  BatchLockFd = -1;
+}
+
+/*
+ * End of "$Id$".
+ */
@@ -0,0 +1,49 @@
+/*
+ * "$Id$"
+ *
+ *   Job batching for the label printer filters.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ */
+
+#ifndef _LABELBATCH_H_
+#  define _LABELBATCH_H_
+
+/*
+ * Constants...
+ */
+
+#  define LABELD_DIR		"/var/run/labeld"
+					/* Default served batcher directory */
+
+
+/*
+ * Prototypes...
+ */
+
+#  ifdef __cplusplus
+extern "C" {
+#  endif /* __cplusplus */
+
+extern int	LabelBatchJoin(const char *key, int fd, int *status);
+extern int	LabelBatchSend(const char *path, int fd, char *argv[],
+		               int *status);
+extern int	LabelBatchServe(const char *path);
+extern int	LabelBatchNext(int window, void (*cancel)(int));
+extern char	**LabelBatchArgs(void);
+extern void	LabelBatchDone(int status);
+
+#  ifdef __cplusplus
+}
+#  endif /* __cplusplus */
+
+#endif /* !_LABELBATCH_H_ */
+
+
+/*
+ * End of "$Id$".
+ */
@@ -0,0 +1,1864 @@
+/*
+ * "$Id$"
+ *
+ *   Label encoder for the label printer filters.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ *
+ *   An encoder turns raster lines into commands for Dymo, Zebra EPL, ZPL
+ *   and CPCL, and Intellitech PCL printers and hands them to a sink
+ *   callback, so labels can be encoded in-process without writing a
+ *   raster file and running rastertolabel:
+ *
+ *     enc = LabelEncNew(sink, data);
+ *     LabelEncStartJob(enc, ZEBRA_ZPL, num_options, options);
+ *     LabelEncWritePage(enc, &header, bitmap);
+ *     LabelEncDelete(enc);
+ *
+ *   Options are PPD keywords and choices such as zePrintRate=4.  Pages can
+ *   also be sent a line at a time with LabelEncStartPage(),
+ *   LabelEncWriteRow() and LabelEncEndPage().  Output is handed to the
+ *   sink before each call returns.
+ *
+ *   All state is kept in the labelenc_t, so any number of encoders can run
+ *   on different threads; the only globals are the ZPL run-length tables
+ *   and span scanner, which LabelEncInit() sets up once.
+ *
+ *   ZPL graphics from an encoder are always run-length compressed ASCII
+ *   hex, as a ~DG download, inline ^GF fields (zeGraphicField) or streamed
+ *   segments (VariableLength).  The zeGraphicEncoding, zeGraphicCache,
+ *   zeIncremental, zeInkRegions and zeEncoderThreads options are ignored
+ *   here: Z64 and automatic encoding, graphic caching, incremental pages,
+ *   inked regions and threaded encoding are done by rastertolabel itself,
+ *   in its own globals, for the one job it prints at a time.
+ *
+ * Contents:
+ *
+ *   LabelEncInit()       - Initialize the ZPL tables and span scanner.
+ *   LabelEncNew()        - Create an encoder.
+ *   LabelEncDelete()     - Free an encoder.
+ *   LabelEncStartJob()   - Compile the job options and start the job.
+ *   LabelEncStartPage()  - Start a page of graphics.
+ *   LabelEncWriteRow()   - Encode a line of graphics.
+ *   LabelEncEndPage()    - Finish a page of graphics.
+ *   LabelEncWritePage()  - Encode a page of graphics.
+ *   LabelEncStartLabel() - Start a ZPL label format.
+ *   LabelEncStreaming()  - Tell whether a ZPL page is streamed in segments.
+ *   LabelEncBandRows()   - Compute the rows per graphic field of a page.
+ *   LabelEncZPLLine()    - Run-length encode a line of ZPL hex graphics.
+ *   LabelEncZPLDecode()  - Decode a line of compressed ZPL hex graphics.
+ *   labelenc_flush()     - Hand the gathered output to the sink.
+ *   labelenc_init()      - Build the ZPL tables and pick a span scanner.
+ *   labelenc_label()     - Output the commands starting a ZPL label.
+ *   labelenc_pcl()       - Output a PCL (mode 3) compressed line.
+ *   labelenc_plan()      - Render the ZPL label commands for a header.
+ *   labelenc_printf()    - Format output.
+ *   labelenc_span_c()    - Count repeated bytes a word at a time.
+ *   labelenc_span_sse2() - Count repeated bytes using SSE2.
+ *   labelenc_span_avx2() - Count repeated bytes using AVX2.
+ *   labelenc_write()     - Gather output.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "labelenc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#  define HAVE_ZPL_SIMD 1
+#  include <immintrin.h>
+#endif /* __GNUC__ && (__i386__ || __x86_64__) */
+
+
+/*
+ * Local functions...
+ */
+
+static int	labelenc_flush(labelenc_t *enc);
+static void	labelenc_init(void);
+static void	labelenc_label(labelenc_t *enc, cups_page_header2_t *header,
+		               int segment, int last_inked, int more);
+static void	labelenc_pcl(labelenc_t *enc, const unsigned char *line,
+		             int length);
+static void	labelenc_plan(labelenc_t *enc, cups_page_header2_t *header);
+static void	labelenc_printf(labelenc_t *enc, const char *format, ...)
+#ifdef __GNUC__
+		__attribute__ ((__format__ (__printf__, 2, 3)))
+#endif /* __GNUC__ */
+		;
+static int	labelenc_span_c(const unsigned char *line, int length,
+		                unsigned char ch);
+#ifdef HAVE_ZPL_SIMD
+static int	labelenc_span_sse2(const unsigned char *line, int length,
+		                   unsigned char ch);
+static int	labelenc_span_avx2(const unsigned char *line, int length,
+		                   unsigned char ch);
+#endif /* HAVE_ZPL_SIMD */
+static void	labelenc_write(labelenc_t *enc, const void *data,
+		               size_t length);
+
+#define labelenc_puts(enc,s)	labelenc_write((enc), (s), strlen(s))
+
+
+/*
+ * Globals...
+ */
+
+int		(*LabelEncSpan)(const unsigned char *line, int length,
+		                unsigned char ch) = labelenc_span_c;
+					/* Repeated byte scanner */
+static pthread_once_t	EncOnce = PTHREAD_ONCE_INIT;
+					/* Initialization control */
+static char	EncRunTable[400][3];	/* Repeat tokens for 0-399 characters */
+
+
+/*
+ * 'LabelEncInit()' - Initialize the ZPL tables and span scanner.
+ *
+ * LabelEncNew() calls this; call it before using LabelEncZPLLine() or
+ * LabelEncSpan without an encoder.
+ */
+
+void
+LabelEncInit(void)
+{
+  pthread_once(&EncOnce, labelenc_init);
+}
+
+
+/*
+ * 'LabelEncNew()' - Create an encoder.
+ */
+
+labelenc_t *				/* O - Encoder or NULL on error */
+LabelEncNew(labelenc_sink_t sink,	/* I - Output callback */
+            void            *data)	/* I - Data for output callback */
+{
+  labelenc_t	*enc;			/* Encoder */
+
+
+  LabelEncInit();
+
+  if ((enc = calloc(1, sizeof(labelenc_t))) == NULL)
+    return (NULL);
+
+  enc->sink      = sink;
+  enc->sink_data = data;
+
+  return (enc);
+}
+
+
+/*
+ * 'LabelEncDelete()' - Free an encoder.
+ */
+
+void
+LabelEncDelete(labelenc_t *enc)		/* I - Encoder */
+{
+  if (!enc)
+    return;
+
+  free(enc->comp_buffer);
+  free(enc->last_buffer);
+  free(enc);
+}
+
+
+/*
+ * 'LabelEncStartJob()' - Compile the job options and start the job.
+ *
+ * The options sent with every page or label are looked up and formatted
+ * here once per job rather than for each page.
+ */
+
+int					/* O - 0 on success, -1 on error */
+LabelEncStartJob(
+    labelenc_t    *enc,			/* I - Encoder */
+    int           model,		/* I - cupsModelNumber of printer */
+    int           num_options,		/* I - Number of options */
+    cups_option_t *options)		/* I - PPD options and choices */
+{
+  int		i;			/* Looping var */
+  int		val;			/* Option value */
+  size_t	length;			/* Length of commands */
+  const char	*choice,		/* Option choice */
+		*amount,		/* zeCutAmount choice */
+		*margin,		/* zeCutMargin choice */
+		*present,		/* zePresentType choice */
+		*timeout;		/* zePresentTimeout choice */
+  float		rate;			/* zePrintRate value */
+
+
+  enc->model    = model;
+  enc->error    = 0;
+  enc->used     = 0;
+  enc->page     = 0;
+  enc->labeled  = 0;
+  enc->rate[0]  = '\0';
+  enc->mode[0]  = '\0';
+  enc->reprint[0] = '\0';
+  strcpy(enc->backfeed, "N");
+
+ /*
+  * Media tracking and print mode...
+  */
+
+  if ((choice = cupsGetOption("zeMediaTracking", num_options,
+                              options)) == NULL)
+    enc->tracking = LABELENC_TRACK_OTHER;
+  else if (!strcmp(choice, "Continuous"))
+    enc->tracking = LABELENC_TRACK_CONTINUOUS;
+  else if (!strcmp(choice, "Web"))
+    enc->tracking = LABELENC_TRACK_WEB;
+  else if (!strcmp(choice, "Mark"))
+    enc->tracking = LABELENC_TRACK_MARK;
+  else if (!strcmp(choice, "VariableLength"))
+    enc->tracking = LABELENC_TRACK_VARIABLE;
+  else
+    enc->tracking = LABELENC_TRACK_OTHER;
+
+  enc->kiosk = (choice = cupsGetOption("zePrintMode", num_options,
+                                       options)) != NULL &&
+               !strcmp(choice, "Kiosk");
+
+ /*
+  * Graphic fields; banded graphics are always sent inline, one ^GF field
+  * per band...
+  */
+
+  enc->inline_graphics = (choice = cupsGetOption("zeGraphicField",
+                                                 num_options,
+						 options)) != NULL &&
+                         !strcmp(choice, "Inline");
+
+  if ((choice = cupsGetOption("zeBandHeight", num_options, options)) != NULL)
+    enc->band_height = atoi(choice);
+  else
+    enc->band_height = 0;
+
+  if ((choice = cupsGetOption("zeMaxGraphic", num_options, options)) != NULL)
+    enc->max_graphic = 1024 * atoi(choice);
+  else
+    enc->max_graphic = 0;
+
+  if (enc->band_height > 0 || enc->max_graphic > 0)
+    enc->inline_graphics = 1;
+
+ /*
+  * Continuous media can be cut short after the last inked line...
+  */
+
+  if ((choice = cupsGetOption("zeTrimMargin", num_options, options)) != NULL &&
+      choice[0] >= '0' && choice[0] <= '9' &&
+      enc->tracking == LABELENC_TRACK_CONTINUOUS)
+    enc->trim_margin = atoi(choice);
+  else
+    enc->trim_margin = -1;
+
+ /*
+  * Print rate...
+  */
+
+  if ((choice = cupsGetOption("zePrintRate", num_options, options)) != NULL &&
+      strcmp(choice, "Default"))
+  {
+    rate = atof(choice);
+    val  = atoi(choice);
+
+    switch (model)
+    {
+      case ZEBRA_EPL_LINE :
+          snprintf(enc->rate, sizeof(enc->rate), "\033S%.0f",
+	           rate * 2.0 - 2.0);
+	  break;
+
+      case ZEBRA_EPL_PAGE :
+          snprintf(enc->rate, sizeof(enc->rate), "S%.0f\n",
+	           rate >= 3.0 ? rate : rate * 2.0 - 2.0);
+	  break;
+
+      case ZEBRA_ZPL :
+          snprintf(enc->rate, sizeof(enc->rate), "^PR%d,%d,%d\n", val, val,
+	           val);
+	  break;
+
+      case ZEBRA_CPCL :
+          snprintf(enc->rate, sizeof(enc->rate), "SPEED %d\r\n", val);
+	  break;
+    }
+  }
+
+  snprintf(enc->start, sizeof(enc->start), "^XA\n%s^LH0,0\n", enc->rate);
+
+ /*
+  * Reprinting after an error...
+  */
+
+  if ((choice = cupsGetOption("zeErrorReprint", num_options,
+                              options)) == NULL)
+    ;
+  else if (!strcmp(choice, "Always"))
+    strcpy(enc->reprint, model == ZEBRA_CPCL ? "ON-OUT-OF-PAPER WAIT\r\n" :
+                                               "^JZY\n");
+  else if (!strcmp(choice, "Never"))
+    strcpy(enc->reprint, model == ZEBRA_CPCL ? "ON-OUT-OF-PAPER PURGE\r\n" :
+                                               "^JZN\n");
+
+ /*
+  * ZPL print mode and kiosk values...
+  */
+
+  if ((choice = cupsGetOption("zePrintMode", num_options, options)) != NULL &&
+      strcmp(choice, "Saved"))
+  {
+    if (!strcmp(choice, "Tear"))
+      strcpy(enc->mode, "^MMT,Y\n");
+    else if (!strcmp(choice, "Peel"))
+      strcpy(enc->mode, "^MMP,Y\n");
+    else if (!strcmp(choice, "Rewind"))
+      strcpy(enc->mode, "^MMR,Y\n");
+    else if (!strcmp(choice, "Applicator"))
+      strcpy(enc->mode, "^MMA,Y\n");
+    else if (!strcmp(choice, "Kiosk"))
+      strcpy(enc->mode, "^MMK,Y\n");
+    else
+      strcpy(enc->mode, "^MMC,Y\n");
+  }
+
+  if (enc->kiosk)
+  {
+   /*
+    * The presenter loop length is the sum of zePresenterLoopLength and
+    * zePresenterLoopLengthTens...
+    */
+
+    if ((choice = cupsGetOption("zePresenterLoopLength", num_options,
+                                options)) != NULL)
+      val = atoi(choice);
+    else
+      val = 400;
+
+    if ((choice = cupsGetOption("zePresenterLoopLengthTens", num_options,
+                                options)) != NULL)
+    {
+      val += atoi(choice);
+
+      if (val < 3)
+        val = 0;
+    }
+
+    if ((amount = cupsGetOption("zeCutAmount", num_options, options)) == NULL)
+      amount = "0";
+    if ((margin = cupsGetOption("zeCutMargin", num_options, options)) == NULL)
+      margin = "9";
+    if ((present = cupsGetOption("zePresentType", num_options,
+                                 options)) == NULL)
+      present = "0";
+    if ((timeout = cupsGetOption("zePresentTimeout", num_options,
+                                 options)) == NULL)
+      timeout = "0";
+
+    length = strlen(enc->mode);
+    snprintf(enc->mode + length, sizeof(enc->mode) - length,
+             "^KV%s,%s,%s,%s,%d", amount, margin, present, timeout, val);
+  }
+
+ /*
+  * Backfeed setting of the printer, restored after a streamed page...
+  */
+
+  if ((choice = cupsGetOption("zeBackfeed", num_options, options)) != NULL &&
+      strlen(choice) < sizeof(enc->backfeed))
+    strcpy(enc->backfeed, choice);
+
+ /*
+  * Intellitech print mode...
+  */
+
+  if ((choice = cupsGetOption("inPrintMode", num_options, options)) == NULL)
+    enc->pcl_mode = 0;
+  else if (!strcmp(choice, "Standard"))
+    enc->pcl_mode = 'S';
+  else if (!strcmp(choice, "Tear"))
+    enc->pcl_mode = 'T';
+  else
+    enc->pcl_mode = 'C';
+
+ /*
+  * Initialize the printer...
+  */
+
+  switch (model)
+  {
+    case DYMO_3x0 :
+       /*
+	* Clear any remaining data and reset the printer...
+	*/
+
+	for (i = 0; i < 100; i ++)
+	  labelenc_write(enc, "\033", 1);
+
+	labelenc_puts(enc, "\033@");
+	break;
+
+    case INTELLITECH_PCL :
+       /*
+	* Send a PCL reset sequence.
+	*/
+
+	labelenc_puts(enc, "\033E");
+        break;
+  }
+
+  return (labelenc_flush(enc));
+}
+
+
+/*
+ * 'LabelEncStartPage()' - Start a page of graphics.
+ */
+
+int					/* O - 0 on success, -1 on error */
+LabelEncStartPage(
+    labelenc_t          *enc,		/* I - Encoder */
+    cups_page_header2_t *header)	/* I - Page header */
+{
+  int		length;			/* Actual label length */
+
+
+  enc->header       = *header;
+  enc->page ++;
+  enc->y            = 0;
+  enc->feed         = 0;
+  enc->last_set     = 0;
+  enc->last_inked   = -1;
+  enc->streaming    = 0;
+  enc->segment_open = 0;
+
+ /*
+  * Grow the compression buffers as needed; they are kept from page to
+  * page...
+  */
+
+  if ((int)header->cupsBytesPerLine > enc->line_size)
+  {
+    free(enc->comp_buffer);
+    free(enc->last_buffer);
+
+    enc->comp_buffer = malloc(2 * header->cupsBytesPerLine + 1);
+    enc->last_buffer = malloc(header->cupsBytesPerLine);
+
+    if (!enc->comp_buffer || !enc->last_buffer)
+    {
+      free(enc->comp_buffer);
+      free(enc->last_buffer);
+
+      enc->comp_buffer = NULL;
+      enc->last_buffer = NULL;
+      enc->line_size   = 0;
+
+      return (-1);
+    }
+
+    enc->line_size = header->cupsBytesPerLine;
+  }
+
+  switch (enc->model)
+  {
+    case DYMO_3x0 :
+       /*
+	* Setup printer/job attributes...
+	*/
+
+	length = header->PageSize[1] * header->HWResolution[1] / 72;
+
+	labelenc_printf(enc, "\033L%c%c", length >> 8, length);
+	labelenc_printf(enc, "\033D%c", header->cupsBytesPerLine);
+
+	labelenc_printf(enc, "\033%c", header->cupsCompression + 'c');
+					/* Darkness */
+	break;
+
+    case ZEBRA_EPL_LINE :
+       /*
+        * Set print rate and darkness...
+	*/
+
+	labelenc_puts(enc, enc->rate);
+
+        if (header->cupsCompression > 0 && header->cupsCompression <= 100)
+	  labelenc_printf(enc, "\033D%d", 7 * header->cupsCompression / 100);
+
+       /*
+        * Set left margin to 0 and start buffered output...
+	*/
+
+	labelenc_puts(enc, "\033M01");
+        labelenc_puts(enc, "\033B");
+        break;
+
+    case ZEBRA_EPL_PAGE :
+       /*
+        * Start a new label...
+	*/
+
+        labelenc_puts(enc, "\nN\n");
+
+       /*
+        * Set hardware options, print rate and darkness...
+	*/
+
+	if (!strcmp(header->MediaType, "Direct"))
+	  labelenc_puts(enc, "OD\n");
+
+	labelenc_puts(enc, enc->rate);
+
+        if (header->cupsCompression > 0 && header->cupsCompression <= 100)
+	  labelenc_printf(enc, "D%d\n", 15 * header->cupsCompression / 100);
+
+       /*
+        * Set label size...
+	*/
+
+        labelenc_printf(enc, "q%d\n", (header->cupsWidth + 7) & ~7);
+        break;
+
+    case ZEBRA_ZPL :
+       /*
+        * Figure out how many rows go in each graphic field; variable
+	* length pages of any height are streamed as a series of short
+	* labels, unless each page needs to be printed several times...
+	*/
+
+        enc->band_rows = LabelEncBandRows(enc, header->cupsBytesPerLine,
+	                                  header->cupsHeight);
+        enc->streaming = LabelEncStreaming(enc, header);
+
+        if (enc->streaming && enc->band_rows == (int)header->cupsHeight &&
+	    enc->band_rows > LABELENC_SEGMENT_ROWS)
+	  enc->band_rows = LABELENC_SEGMENT_ROWS;
+
+       /*
+        * Set darkness...
+	*/
+
+        if (header->cupsCompression > 0 && header->cupsCompression <= 100)
+	  labelenc_printf(enc, "~SD%02d\n", 30 * header->cupsCompression / 100);
+
+       /*
+	* Turn off backfeed so segments print without gaps; segments are
+	* started by LabelEncWriteRow()...
+	*/
+
+        if (enc->streaming)
+	  labelenc_puts(enc, "~JSO\n");
+
+       /*
+        * Otherwise start bitmap graphics, either as a download or as
+	* graphic fields in the label format (started by LabelEncWriteRow());
+	* inline labels start before the ink is known, so they are not
+	* trimmed...
+	*/
+
+        else if (enc->inline_graphics)
+	  labelenc_label(enc, header, 0, (int)header->cupsHeight, 0);
+	else
+          labelenc_printf(enc, "~DGR:CUPS.GRF,%d,%d,\n",
+		          header->cupsHeight * header->cupsBytesPerLine,
+		          header->cupsBytesPerLine);
+        break;
+
+    case ZEBRA_CPCL :
+       /*
+        * Start label...
+	*/
+
+        labelenc_printf(enc, "! 0 %u %u %u %u\r\n", header->HWResolution[0],
+	                header->HWResolution[1], header->cupsHeight,
+	                header->NumCopies);
+	labelenc_printf(enc, "PAGE-WIDTH %d\r\n", header->cupsWidth);
+	labelenc_printf(enc, "PAGE-HEIGHT %d\r\n", header->cupsWidth);
+        break;
+
+    case INTELLITECH_PCL :
+       /*
+        * Set the media size...
+	*/
+
+	labelenc_puts(enc, "\033&l6D\033&k12H");
+					/* Set 6 LPI, 10 CPI */
+	labelenc_puts(enc, "\033&l0O");	/* Set portrait orientation */
+
+	switch (header->PageSize[1])
+	{
+	  case 540 : /* Monarch Envelope */
+              labelenc_puts(enc, "\033&l80A");
+	      break;
+
+	  case 624 : /* DL Envelope */
+              labelenc_puts(enc, "\033&l90A");
+	      break;
+
+	  case 649 : /* C5 Envelope */
+              labelenc_puts(enc, "\033&l91A");
+	      break;
+
+	  case 684 : /* COM-10 Envelope */
+              labelenc_puts(enc, "\033&l81A");
+	      break;
+
+	  case 756 : /* Executive */
+              labelenc_puts(enc, "\033&l1A");
+	      break;
+
+	  case 792 : /* Letter */
+              labelenc_puts(enc, "\033&l2A");
+	      break;
+
+	  case 842 : /* A4 */
+              labelenc_puts(enc, "\033&l26A");
+	      break;
+
+	  case 1008 : /* Legal */
+              labelenc_puts(enc, "\033&l3A");
+	      break;
+
+          default : /* Custom size */
+	      labelenc_printf(enc, "\033!f%dZ",
+	                      header->PageSize[1] * 300 / 72);
+	      break;
+	}
+
+	labelenc_printf(enc, "\033&l%dP",
+	                header->PageSize[1] / 12);
+					/* Set page length */
+	labelenc_puts(enc, "\033&l0E");	/* Set top margin to 0 */
+        labelenc_printf(enc, "\033&l%dX", header->NumCopies);
+					/* Set number copies */
+        labelenc_puts(enc, "\033&l0L");	/* Turn off perforation skip */
+
+       /*
+        * Print settings...
+	*/
+
+	if (enc->page == 1)
+	{
+          if (header->cupsRowFeed)	/* inPrintRate */
+	    labelenc_printf(enc, "\033!p%dS", header->cupsRowFeed);
+
+          if (header->cupsCompression != ~0)
+	  				/* inPrintDensity */
+	    labelenc_printf(enc, "\033&d%dA",
+	                    30 * header->cupsCompression / 100 - 15);
+
+          if (enc->pcl_mode == 'S')
+	    labelenc_puts(enc, "\033!p0M");
+	  else if (enc->pcl_mode == 'T')
+	  {
+	    labelenc_puts(enc, "\033!p1M");
+
+            if (header->cupsRowCount)	/* inTearInterval */
+	      labelenc_printf(enc, "\033!n%dT", header->cupsRowCount);
+          }
+	  else if (enc->pcl_mode == 'C')
+	  {
+	    labelenc_puts(enc, "\033!p2M");
+
+            if (header->cupsRowStep)	/* inCutInterval */
+	      labelenc_printf(enc, "\033!n%dC", header->cupsRowStep);
+          }
+        }
+
+       /*
+	* Setup graphics...
+	*/
+
+	labelenc_printf(enc, "\033*t%dR", header->HWResolution[0]);
+					/* Set resolution */
+
+	labelenc_printf(enc, "\033*r%dS", header->cupsWidth);
+					/* Set width */
+	labelenc_printf(enc, "\033*r%dT", header->cupsHeight);
+					/* Set height */
+
+	labelenc_puts(enc, "\033&a0H");	/* Set horizontal position */
+	labelenc_puts(enc, "\033&a0V");	/* Set vertical position */
+        labelenc_puts(enc, "\033*r1A");	/* Start graphics */
+        labelenc_puts(enc, "\033*b3M");	/* Set compression */
+        break;
+  }
+
+  return (labelenc_flush(enc));
+}
+
+
+/*
+ * 'LabelEncWriteRow()' - Encode a line of graphics.
+ *
+ * Lines are cupsBytesPerLine bytes with 1 bits for black and are written
+ * in order from the top of the page.
+ */
+
+int					/* O - 0 on success, -1 on error */
+LabelEncWriteRow(labelenc_t          *enc,
+					/* I - Encoder */
+                 const unsigned char *row)
+					/* I - Line of graphics */
+{
+  int		i,			/* Looping var */
+		y,			/* Line number */
+		bpl;			/* Bytes per line */
+  cups_page_header2_t *header;		/* Page header */
+
+
+  header = &(enc->header);
+  bpl    = header->cupsBytesPerLine;
+
+  if (bpl > enc->line_size)
+    return (-1);
+  y      = enc->y ++;
+
+  switch (enc->model)
+  {
+    case DYMO_3x0 :
+       /*
+	* See if the line is blank; if not, write it to the printer...
+	*/
+
+	if (row[0] || memcmp(row, row + 1, bpl - 1))
+	{
+          if (enc->feed)
+	  {
+	    while (enc->feed > 255)
+	    {
+	      labelenc_printf(enc, "\033f\001%c", 255);
+	      enc->feed -= 255;
+	    }
+
+	    labelenc_printf(enc, "\033f\001%c", enc->feed);
+	    enc->feed = 0;
+          }
+
+          labelenc_write(enc, "\026", 1);
+	  labelenc_write(enc, row, bpl);
+
+#ifdef __sgi
+	 /*
+          * This hack works around a bug in the IRIX serial port driver when
+	  * run at high baud rates (e.g. 115200 baud)...  This results in
+	  * slightly slower label printing, but at least the labels come
+	  * out properly.
+	  */
+
+	  labelenc_flush(enc);
+	  sginap(1);
+#endif /* __sgi */
+	}
+	else
+          enc->feed ++;
+	break;
+
+    case ZEBRA_EPL_LINE :
+        labelenc_printf(enc, "\033g%03d", bpl);
+	labelenc_write(enc, row, bpl);
+        break;
+
+    case ZEBRA_EPL_PAGE :
+       /*
+        * GW uses 0 bits for black...
+	*/
+
+        if (row[0] || memcmp(row, row + 1, bpl - 1))
+	{
+          labelenc_printf(enc, "GW0,%d,%d,1\n", y, bpl);
+
+	  for (i = 0; i < bpl; i ++)
+	    enc->comp_buffer[i] = ~row[i];
+
+	  enc->comp_buffer[bpl] = '\n';
+	  labelenc_write(enc, enc->comp_buffer, bpl + 1);
+	}
+        break;
+
+    case ZEBRA_ZPL :
+        if (enc->trim_margin >= 0 && (*LabelEncSpan)(row, bpl, 0) < bpl)
+	  enc->last_inked = y;
+
+       /*
+        * Start the next segment of a streamed page as needed...
+	*/
+
+        if (enc->streaming && (y % enc->band_rows) == 0)
+	{
+	  if (enc->segment_open)
+	    labelenc_puts(enc, "^FS^XZ\n");
+
+          i = (int)header->cupsHeight - y < enc->band_rows ?
+	          (int)header->cupsHeight - y : enc->band_rows;
+
+          labelenc_label(enc, header, i, enc->last_inked,
+	                 y + i < (int)header->cupsHeight);
+	  labelenc_printf(enc, "^FO0,0^GFA,%d,%d,%d,\n", i * bpl, i * bpl,
+	                  bpl);
+
+	  enc->segment_open = 1;
+	  enc->last_set     = 0;
+	}
+
+       /*
+        * Start the next graphic field as needed...
+	*/
+
+        if (!enc->streaming && enc->inline_graphics &&
+	    (y % enc->band_rows) == 0)
+	{
+	  if (y > 0)
+	    labelenc_puts(enc, "^FS\n");
+
+          i = (int)header->cupsHeight - y < enc->band_rows ?
+	          (int)header->cupsHeight - y : enc->band_rows;
+
+	  labelenc_printf(enc, "^FO0,%d^GFA,%d,%d,%d,\n", y, i * bpl, i * bpl,
+	                  bpl);
+
+	  enc->last_set = 0;
+	}
+
+       /*
+	* Determine if this row is the same as the previous line.
+        * If so, output a ':'...
+        */
+
+        if (enc->last_set && !memcmp(row, enc->last_buffer, bpl))
+	{
+	  labelenc_write(enc, ":", 1);
+	  break;
+	}
+
+       /*
+        * Run-length compress the graphics and keep the line for the next
+	* one...
+	*/
+
+	labelenc_write(enc, enc->comp_buffer,
+	               LabelEncZPLLine(row, bpl, enc->comp_buffer));
+
+	memcpy(enc->last_buffer, row, bpl);
+	enc->last_set = 1;
+        break;
+
+    case ZEBRA_CPCL :
+        if (row[0] || memcmp(row, row + 1, bpl - 1))
+	{
+	  labelenc_printf(enc, "CG %u 1 0 %d ", bpl, y);
+          labelenc_write(enc, row, bpl);
+	  labelenc_puts(enc, "\r\n");
+	}
+	break;
+
+    case INTELLITECH_PCL :
+	if (row[0] || memcmp(row, row + 1, bpl - 1))
+        {
+	  if (enc->feed)
+	  {
+	    labelenc_printf(enc, "\033*b%dY", enc->feed);
+	    enc->feed     = 0;
+	    enc->last_set = 0;
+	  }
+
+          labelenc_pcl(enc, row, bpl);
+	}
+	else
+	  enc->feed ++;
+        break;
+  }
+
+  return (labelenc_flush(enc));
+}
+
+
+/*
+ * 'LabelEncEndPage()' - Finish a page of graphics.
+ *
+ * A canceled ZPL page is dropped by the printer; other printers eject
+ * what they have.
+ */
+
+int					/* O - 0 on success, -1 on error */
+LabelEncEndPage(labelenc_t *enc,	/* I - Encoder */
+                int        canceled)	/* I - Non-zero if canceled */
+{
+  cups_page_header2_t *header;		/* Page header */
+
+
+  header = &(enc->header);
+
+  switch (enc->model)
+  {
+    case DYMO_3x0 :
+       /*
+	* Eject the current page...
+	*/
+
+	labelenc_puts(enc, "\033E");
+	break;
+
+    case ZEBRA_EPL_LINE :
+       /*
+        * End buffered output, eject the label...
+	*/
+
+        labelenc_puts(enc, "\033E\014");
+	break;
+
+    case ZEBRA_EPL_PAGE :
+       /*
+        * Print the label...
+	*/
+
+        labelenc_puts(enc, "P1\n");
+	break;
+
+    case ZEBRA_ZPL :
+        if (enc->streaming)
+	{
+	 /*
+	  * Finish the last segment, closing the format before cancelling the
+	  * graphic, and restore backfeed...
+	  */
+
+          if (enc->segment_open)
+	    labelenc_puts(enc, canceled ? "^FS^XZ\n~DN\n" : "^FS^XZ\n");
+
+	  labelenc_printf(enc, "~JS%s\n", enc->backfeed);
+	  break;
+	}
+
+        if (canceled)
+	{
+	 /*
+	  * End the open graphic field and label format, or cancel the bitmap
+	  * download...
+	  */
+
+	  labelenc_puts(enc, enc->inline_graphics ? "^FS^XZ\n" : "~DN\n");
+	  break;
+	}
+
+        if (enc->inline_graphics)
+	{
+	 /*
+	  * End the graphic field sent by LabelEncWriteRow()...
+	  */
+
+	  labelenc_puts(enc, "^FS\n");
+	}
+	else
+	{
+	 /*
+	  * Start the label, print the downloaded graphic and delete it...
+	  */
+
+	  labelenc_label(enc, header, 0, enc->last_inked, 0);
+	  labelenc_puts(enc, "^FO0,0^XGR:CUPS.GRF,1,1^FS\n");
+	  labelenc_puts(enc, "^IDR:CUPS.GRF^FS\n");
+	}
+
+	if (enc->kiosk)
+	  labelenc_puts(enc, "^XZ^XA^CN0^PN1^XZ\n");
+        break;
+
+    case ZEBRA_CPCL :
+       /*
+        * Set tear-off adjust position...
+	*/
+
+	if (header->AdvanceDistance != 1000)
+          labelenc_printf(enc, "PRESENT-AT %d 1\r\n",
+	                  (int)header->AdvanceDistance);
+
+       /*
+        * Allow for reprinting after an error...
+	*/
+
+	labelenc_puts(enc, enc->reprint);
+
+       /*
+        * Cut label?
+	*/
+
+	if (header->CutMedia)
+	  labelenc_puts(enc, "CUT\r\n");
+
+       /*
+        * Set darkness and print rate...
+	*/
+
+	if (header->cupsCompression > 0)
+	  labelenc_printf(enc, "TONE %u\r\n", 2 * header->cupsCompression);
+
+	labelenc_puts(enc, enc->rate);
+
+       /*
+        * Print the label...
+	*/
+
+	if (enc->tracking != LABELENC_TRACK_CONTINUOUS)
+          labelenc_puts(enc, "FORM\r\n");
+
+	labelenc_puts(enc, "PRINT\r\n");
+	break;
+
+    case INTELLITECH_PCL :
+        labelenc_puts(enc, "\033*rB");	/* End GFX */
+        labelenc_puts(enc, "\014");	/* Eject current page */
+        break;
+  }
+
+  return (labelenc_flush(enc));
+}
+
+
+/*
+ * 'LabelEncWritePage()' - Encode a page of graphics.
+ *
+ * The page is cupsHeight lines of cupsBytesPerLine bytes.
+ */
+
+int					/* O - 0 on success, -1 on error */
+LabelEncWritePage(
+    labelenc_t          *enc,		/* I - Encoder */
+    cups_page_header2_t *header,	/* I - Page header */
+    const unsigned char *page)		/* I - Page bitmap */
+{
+  unsigned	y;			/* Current line */
+
+
+  if (LabelEncStartPage(enc, header))
+    return (-1);
+
+  for (y = 0; y < header->cupsHeight; y ++)
+    if (LabelEncWriteRow(enc, page + (size_t)y * header->cupsBytesPerLine))
+      return (-1);
+
+  return (LabelEncEndPage(enc, 0));
+}
+
+
+/*
+ * 'LabelEncStartLabel()' - Start a ZPL label format.
+ *
+ * Continuous labels end shortly after the last inked line when the job
+ * trims them; streamed segments are "segment" rows long.
+ */
+
+int					/* O - 0 on success, -1 on error */
+LabelEncStartLabel(
+    labelenc_t          *enc,		/* I - Encoder */
+    cups_page_header2_t *header,	/* I - Page header */
+    int                 segment,	/* I - Rows in streamed segment or 0 */
+    int                 last_inked)	/* I - Last inked line or -1 */
+{
+  labelenc_label(enc, header, segment, last_inked, 0);
+
+  return (labelenc_flush(enc));
+}
+
+
+/*
+ * 'LabelEncStreaming()' - Tell whether a ZPL page is streamed in segments.
+ *
+ * Variable length pages of any height are streamed as a series of short
+ * labels, unless each page needs to be printed several times.
+ */
+
+int					/* O - 1 if streamed, 0 otherwise */
+LabelEncStreaming(
+    labelenc_t          *enc,		/* I - Encoder */
+    cups_page_header2_t *header)	/* I - Page header */
+{
+  return (enc->tracking == LABELENC_TRACK_VARIABLE &&
+          header->NumCopies <= 1 && !enc->kiosk);
+}
+
+
+/*
+ * 'LabelEncBandRows()' - Compute the rows per graphic field of a page.
+ */
+
+int					/* O - Rows per field */
+LabelEncBandRows(labelenc_t *enc,	/* I - Encoder */
+                 int        bpl,	/* I - Bytes per line */
+                 int        rows)	/* I - Number of lines */
+{
+  int	band_rows;			/* Rows per field */
+
+
+  band_rows = rows;
+
+  if (enc->band_height > 0 && enc->band_height < band_rows)
+    band_rows = enc->band_height;
+
+  if (enc->max_graphic > 0 && band_rows * bpl > enc->max_graphic)
+    band_rows = enc->max_graphic / bpl;
+
+  if (band_rows < 1)
+    band_rows = 1;
+
+  return (band_rows);
+}
+
+
+/*
+ * 'LabelEncZPLLine()' - Run-length encode a line of ZPL hex graphics.
+ *
+ * The output buffer must hold at least 2 * length bytes.  The output is
+ * the same as hex-encoding the line and compressing runs of repeated hex
+ * digits, but runs are found directly on the raster bytes.
+ *
+ * This is the shortest encoding the ZPL compression grammar allows: a run
+ * costs one digit plus the fewest repeat tokens for its length and is
+ * never shorter when split, so the only choice left is the end of the
+ * line, where a run of 0's or F's becomes a single ',' or '!' fill once it
+ * reaches a byte boundary.  Lines that repeat the previous line (':') are
+ * handled by the caller.
+ */
+
+int					/* O - Number of bytes in output */
+LabelEncZPLLine(
+    const unsigned char *line,		/* I - Line to encode */
+    int                 length,		/* I - Length of line */
+    unsigned char       *out)		/* I - Output buffer */
+{
+  const unsigned char	*ptr,		/* Pointer into line */
+			*end;		/* End of line */
+  unsigned char		*outptr;	/* Pointer into output */
+  const char		*token;		/* Repeat token */
+  int			repeat_char,	/* Repeated nibble */
+			repeat_count,	/* Number of repeated nibbles */
+			nibble,		/* Current nibble */
+			shift,		/* Shift for current nibble */
+			span;		/* Number of repeated bytes */
+  static const char	*hex = "0123456789ABCDEF";
+					/* Hex digits */
+
+
+  if (length < 1)
+    return (0);
+
+  outptr       = out;
+  end          = line + length;
+  repeat_char  = *line >> 4;
+  repeat_count = 0;
+
+  for (ptr = line; ptr < end;)
+  {
+    if ((*ptr >> 4) == (*ptr & 15) && (*ptr & 15) == repeat_char)
+    {
+     /*
+      * Solid byte continuing the current run; skip all of the copies in
+      * one go...
+      */
+
+      span         = (*LabelEncSpan)(ptr, end - ptr, *ptr);
+      repeat_count += 2 * span;
+      ptr          += span;
+      continue;
+    }
+
+    for (shift = 4; shift >= 0; shift -= 4)
+    {
+      nibble = (*ptr >> shift) & 15;
+
+      if (nibble == repeat_char)
+        repeat_count ++;
+      else
+      {
+       /*
+        * Output the previous run...
+	*/
+
+        if (repeat_count > 1)
+	{
+	  for (; repeat_count >= 400; repeat_count -= 400)
+	    *outptr++ = 'z';
+
+          for (token = EncRunTable[repeat_count]; *token; token ++)
+	    *outptr++ = *token;
+	}
+
+        *outptr++    = hex[repeat_char];
+	repeat_char  = nibble;
+	repeat_count = 1;
+      }
+    }
+
+    ptr ++;
+  }
+
+  if (repeat_char == 0 || repeat_char == 15)
+  {
+   /*
+    * Handle 0's or F's on the end of the line...
+    */
+
+    if (repeat_count & 1)
+    {
+      repeat_count --;
+      *outptr++ = hex[repeat_char];
+    }
+
+    if (repeat_count > 0)
+      *outptr++ = repeat_char ? '!' : ',';
+  }
+  else
+  {
+    if (repeat_count > 1)
+    {
+      for (; repeat_count >= 400; repeat_count -= 400)
+	*outptr++ = 'z';
+
+      for (token = EncRunTable[repeat_count]; *token; token ++)
+	*outptr++ = *token;
+    }
+
+    *outptr++ = hex[repeat_char];
+  }
+
+#ifdef DEBUG
+ /*
+  * Make sure the line decodes to the original pixels...
+  */
+
+  {
+    unsigned char *check = malloc(length);
+					/* Decoded line */
+
+    if (check &&
+        (LabelEncZPLDecode(out, outptr - out, NULL, check, length) !=
+	     length ||
+         memcmp(check, line, length)))
+      fprintf(stderr, "DEBUG: ZPL line encoding does not match raster: "
+                      "%.*s\n", (int)(outptr - out), out);
+
+    free(check);
+  }
+#endif /* DEBUG */
+
+  return (outptr - out);
+}
+
+
+/*
+ * 'LabelEncZPLDecode()' - Decode a line of compressed ZPL hex graphics.
+ *
+ * This accepts the full ZPL compression grammar (repeat tokens, ',', '!',
+ * and ':' for a copy of the previous line) and is used to check the
+ * encoder, by testlabelenc and by DEBUG builds.  Returns the number of
+ * bytes decoded or -1 on error.
+ */
+
+int					/* O - Bytes decoded or -1 */
+LabelEncZPLDecode(
+    const unsigned char *data,		/* I - Compressed line */
+    int                 datalen,	/* I - Length of compressed line */
+    const unsigned char *prev,		/* I - Previous line or NULL */
+    unsigned char       *line,		/* O - Decoded line */
+    int                 length)		/* I - Length of line */
+{
+  int	i,				/* Looping var */
+	nibbles,			/* Nibbles decoded */
+	count,				/* Repeat count */
+	nibble;				/* Current nibble */
+
+
+  if (datalen == 1 && data[0] == ':')
+  {
+    if (!prev)
+      return (-1);
+
+    memcpy(line, prev, length);
+    return (length);
+  }
+
+  memset(line, 0, length);
+
+  for (i = 0, nibbles = 0, count = 0; i < datalen; i ++)
+  {
+    if (data[i] >= 'G' && data[i] <= 'Y')
+      count += data[i] - 'F';
+    else if (data[i] >= 'g' && data[i] <= 'z')
+      count += 20 * (data[i] - 'f');
+    else if (data[i] == ',' || data[i] == '!')
+    {
+     /*
+      * Fill the rest of the line...
+      */
+
+      if (count || i != datalen - 1)
+        return (-1);
+
+      for (nibble = data[i] == '!' ? 15 : 0; nibbles < 2 * length; nibbles ++)
+        line[nibbles / 2] |= (nibbles & 1) ? nibble : nibble << 4;
+    }
+    else
+    {
+      if (data[i] >= '0' && data[i] <= '9')
+        nibble = data[i] - '0';
+      else if (data[i] >= 'A' && data[i] <= 'F')
+        nibble = data[i] - 'A' + 10;
+      else
+        return (-1);
+
+      if (count == 0)
+        count = 1;
+
+      if (nibbles + count > 2 * length)
+        return (-1);
+
+      for (; count > 0; count --, nibbles ++)
+        line[nibbles / 2] |= (nibbles & 1) ? nibble : nibble << 4;
+    }
+  }
+
+ /*
+  * A repeat count needs a digit after it; a short line is padded with 0's...
+  */
+
+  if (count)
+    return (-1);
+
+  return (length);
+}
+
+
+/*
+ * 'labelenc_flush()' - Hand the gathered output to the sink.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+labelenc_flush(labelenc_t *enc)		/* I - Encoder */
+{
+  if (enc->used > 0 && !enc->error &&
+      (*enc->sink)(enc->sink_data, enc->out, enc->used))
+    enc->error = 1;
+
+  enc->used = 0;
+
+  return (enc->error ? -1 : 0);
+}
+
+
+/*
+ * 'labelenc_init()' - Build the ZPL tables and pick a span scanner.
+ */
+
+static void
+labelenc_init(void)
+{
+  int	count;				/* Repeat count */
+  char	*token;				/* Pointer into table entry */
+
+
+ /*
+  * Pre-render the repeat tokens for 0 to 399 characters: 'g' through 'y'
+  * are multiples of 20 characters and 'G' through 'Y' are 1 through 19
+  * characters.  Counts of 400 or more are prefixed with one 'z' per 400
+  * characters when the line is encoded...
+  */
+
+  for (count = 0; count < 400; count ++)
+  {
+    token = EncRunTable[count];
+
+    if (count >= 20)
+      *token++ = 'f' + count / 20;
+
+    if (count % 20)
+      *token++ = 'F' + count % 20;
+
+    *token = '\0';
+  }
+
+ /*
+  * Use the widest span scanner the CPU supports...
+  */
+
+#ifdef HAVE_ZPL_SIMD
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2"))
+    LabelEncSpan = labelenc_span_avx2;
+  else if (__builtin_cpu_supports("sse2"))
+    LabelEncSpan = labelenc_span_sse2;
+#endif /* HAVE_ZPL_SIMD */
+}
+
+
+/*
+ * 'labelenc_label()' - Output the commands starting a ZPL label.
+ */
+
+static void
+labelenc_label(
+    labelenc_t          *enc,		/* I - Encoder */
+    cups_page_header2_t *header,	/* I - Page header */
+    int                 segment,	/* I - Rows in streamed segment or 0 */
+    int                 last_inked,	/* I - Last inked line or -1 */
+    int                 more)		/* I - 1 if more segments follow */
+{
+  int		length,			/* Label length */
+		margin;			/* Trim margin in lines */
+
+
+ /*
+  * Start label and set print rate and label home...
+  */
+
+  labelenc_puts(enc, enc->start);
+
+ /*
+  * Set media tracking...
+  */
+
+  switch (enc->tracking)
+  {
+    case LABELENC_TRACK_CONTINUOUS :
+       /*
+	* Add label length command for continuous, ending shortly after the
+	* last inked line when trimming...
+	*/
+
+	length = header->cupsHeight;
+	margin = (int)(enc->trim_margin * header->HWResolution[1] / 25.4 + 0.5);
+
+	if (enc->trim_margin >= 0 && last_inked + 1 + margin < length)
+	  length = last_inked + 1 + margin > 0 ? last_inked + 1 + margin : 1;
+
+	labelenc_printf(enc, "^LL%d\n^MNN\n", length);
+	break;
+
+    case LABELENC_TRACK_WEB :
+	labelenc_puts(enc, "^MNY\n");
+	break;
+
+    case LABELENC_TRACK_MARK :
+	labelenc_puts(enc, "^MNM\n");
+	break;
+
+    case LABELENC_TRACK_VARIABLE :
+       /*
+	* Streamed segments are butted together on continuous media...
+	*/
+
+	if (segment > 0)
+	  labelenc_printf(enc, "^LL%d\n^MNN\n", segment);
+	else
+	  labelenc_puts(enc, "^MNV\n^LL10\n");
+	break;
+  }
+
+ /*
+  * Set label top, media type, print mode, tear-off position, error
+  * reprinting and copies, rendered again only when the header changes...
+  */
+
+  if (!enc->labeled ||
+      memcmp(header, &(enc->label_header), sizeof(enc->label_header)))
+    labelenc_plan(enc, header);
+
+  if (more && enc->mode[0])
+  {
+   /*
+    * Only the last segment of a streamed page gets the print mode, so a
+    * long label is cut or presented once rather than after each segment...
+    */
+
+    labelenc_write(enc, enc->label, enc->label_mode);
+    labelenc_puts(enc, "^MMT,Y\n");
+    labelenc_puts(enc, enc->label + enc->label_mode + strlen(enc->mode));
+  }
+  else
+    labelenc_puts(enc, enc->label);
+}
+
+
+/*
+ * 'labelenc_pcl()' - Output a PCL (mode 3) compressed line.
+ */
+
+static void
+labelenc_pcl(labelenc_t          *enc,	/* I - Encoder */
+             const unsigned char *line,	/* I - Line to compress */
+             int                 length)/* I - Length of line */
+{
+  const unsigned char	*line_ptr,	/* Current byte pointer */
+			*line_end,	/* End-of-line byte pointer */
+			*start,		/* Start of compression sequence */
+			*seed;		/* Seed buffer pointer */
+  unsigned char		*comp_ptr;	/* Pointer into compression buffer */
+  int			count,		/* Count of bytes for output */
+			offset;		/* Offset of bytes for output */
+
+
+ /*
+  * Do delta-row compression...
+  */
+
+  line_ptr = line;
+  line_end = line + length;
+
+  comp_ptr = enc->comp_buffer;
+  seed     = enc->last_buffer;
+
+  while (line_ptr < line_end)
+  {
+   /*
+    * Find the next non-matching sequence...
+    */
+
+    start = line_ptr;
+
+    if (!enc->last_set)
+    {
+     /*
+      * The seed buffer is invalid, so do the next 8 bytes, max...
+      */
+
+      offset = 0;
+
+      if ((count = line_end - line_ptr) > 8)
+	count = 8;
+
+      line_ptr += count;
+    }
+    else
+    {
+     /*
+      * The seed buffer is valid, so compare against it...
+      */
+
+      while (line_ptr < line_end &&
+             *line_ptr == *seed)
+      {
+        line_ptr ++;
+        seed ++;
+      }
+
+      if (line_ptr == line_end)
+        break;
+
+      offset = line_ptr - start;
+
+     /*
+      * Find up to 8 non-matching bytes...
+      */
+
+      start = line_ptr;
+      count = 0;
+      while (line_ptr < line_end &&
+             *line_ptr != *seed &&
+             count < 8)
+      {
+        line_ptr ++;
+        seed ++;
+        count ++;
+      }
+    }
+
+   /*
+    * Place mode 3 compression data in the buffer; see HP manuals
+    * for details...
+    */
+
+    if (offset >= 31)
+    {
+     /*
+      * Output multi-byte offset...
+      */
+
+      *comp_ptr++ = ((count - 1) << 5) | 31;
+
+      offset -= 31;
+      while (offset >= 255)
+      {
+        *comp_ptr++ = 255;
+        offset    -= 255;
+      }
+
+      *comp_ptr++ = offset;
+    }
+    else
+    {
+     /*
+      * Output single-byte offset...
+      */
+
+      *comp_ptr++ = ((count - 1) << 5) | offset;
+    }
+
+    memcpy(comp_ptr, start, count);
+    comp_ptr += count;
+  }
+
+ /*
+  * Set the length of the data and write it...
+  */
+
+  labelenc_printf(enc, "\033*b%dW", (int)(comp_ptr - enc->comp_buffer));
+  labelenc_write(enc, enc->comp_buffer, comp_ptr - enc->comp_buffer);
+
+ /*
+  * Save this line as a "seed" buffer for the next...
+  */
+
+  memcpy(enc->last_buffer, line, length);
+  enc->last_set = 1;
+}
+
+
+/*
+ * 'labelenc_plan()' - Render the ZPL label commands for a header.
+ */
+
+static void
+labelenc_plan(labelenc_t          *enc,	/* I - Encoder */
+              cups_page_header2_t *header)
+					/* I - Page header */
+{
+  char		*ptr,			/* Pointer into commands */
+		*end;			/* End of commands */
+
+
+  enc->label_header = *header;
+  enc->labeled      = 1;
+
+  ptr  = enc->label;
+  end  = enc->label + sizeof(enc->label);
+  *ptr = '\0';
+
+ /*
+  * Label top and media type...
+  */
+
+  if (header->cupsRowStep != 200)
+  {
+    snprintf(ptr, end - ptr, "^LT%u\n", header->cupsRowStep);
+    ptr += strlen(ptr);
+  }
+
+  if (!strcmp(header->MediaType, "Thermal"))
+    snprintf(ptr, end - ptr, "^MTT\n");
+  else if (!strcmp(header->MediaType, "Direct"))
+    snprintf(ptr, end - ptr, "^MTD\n");
+
+  ptr += strlen(ptr);
+
+ /*
+  * Print mode...
+  */
+
+  enc->label_mode = (int)(ptr - enc->label);
+
+  snprintf(ptr, end - ptr, "%s", enc->mode);
+  ptr += strlen(ptr);
+
+ /*
+  * Tear-off adjust position...
+  */
+
+  if (header->AdvanceDistance != 1000)
+  {
+    snprintf(ptr, end - ptr, (int)header->AdvanceDistance < 0 ?
+                                 "~TA%04d\n" : "~TA%03d\n",
+	     (int)header->AdvanceDistance);
+    ptr += strlen(ptr);
+  }
+
+ /*
+  * Reprinting after an error and multiple copies...
+  */
+
+  snprintf(ptr, end - ptr, "%s", enc->reprint);
+  ptr += strlen(ptr);
+
+  if (header->NumCopies > 1)
+    snprintf(ptr, end - ptr, "^PQ%d, 0, 0, N\n", header->NumCopies);
+}
+
+
+/*
+ * 'labelenc_printf()' - Format output.
+ *
+ * Commands are short; at least 1k of the buffer is free for each one.
+ */
+
+static void
+labelenc_printf(labelenc_t *enc,	/* I - Encoder */
+                const char *format,	/* I - printf-style format string */
+		...)			/* I - Additional arguments */
+{
+  va_list	ap;			/* Argument pointer */
+  int		length;			/* Length of output */
+  size_t	space;			/* Space left in buffer */
+
+
+  if (sizeof(enc->out) - enc->used < 1024)
+    labelenc_flush(enc);
+
+  space = sizeof(enc->out) - enc->used;
+
+  va_start(ap, format);
+  length = vsnprintf((char *)enc->out + enc->used, space, format, ap);
+  va_end(ap);
+
+  if (length > 0)
+    enc->used += (size_t)length < space ? (size_t)length : space - 1;
+}
+
+
+/*
+ * 'labelenc_span_c()' - Count repeated bytes a word at a time.
+ */
+
+static int				/* O - Number of matching bytes */
+labelenc_span_c(
+    const unsigned char *line,		/* I - Start of span */
+    int                 length,		/* I - Bytes left in line */
+    unsigned char       ch)		/* I - Byte to match */
+{
+  int		count;			/* Number of matching bytes */
+  uint64_t	pattern,		/* Byte repeated 8 times */
+		word;			/* Current word */
+
+
+  pattern = 0x0101010101010101ULL * ch;
+
+  for (count = 0; count + 8 <= length; count += 8)
+  {
+    memcpy(&word, line + count, sizeof(word));
+    if (word != pattern)
+      break;
+  }
+
+  while (count < length && line[count] == ch)
+    count ++;
+
+  return (count);
+}
+
+
+#ifdef HAVE_ZPL_SIMD
+/*
+ * 'labelenc_span_sse2()' - Count repeated bytes using SSE2.
+ */
+
+__attribute__((target("sse2")))
+static int				/* O - Number of matching bytes */
+labelenc_span_sse2(
+    const unsigned char *line,		/* I - Start of span */
+    int                 length,		/* I - Bytes left in line */
+    unsigned char       ch)		/* I - Byte to match */
+{
+  int		count;			/* Number of matching bytes */
+  unsigned	mask;			/* Comparison mask */
+  __m128i	pattern;		/* Byte repeated 16 times */
+
+
+  pattern = _mm_set1_epi8((char)ch);
+
+  for (count = 0; count + 16 <= length; count += 16)
+  {
+    mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(
+               _mm_loadu_si128((const __m128i *)(line + count)), pattern));
+
+    if (mask != 0xffff)
+      return (count + __builtin_ctz(~mask));
+  }
+
+  while (count < length && line[count] == ch)
+    count ++;
+
+  return (count);
+}
+
+
+/*
+ * 'labelenc_span_avx2()' - Count repeated bytes using AVX2.
+ */
+
+__attribute__((target("avx2")))
+static int				/* O - Number of matching bytes */
+labelenc_span_avx2(
+    const unsigned char *line,		/* I - Start of span */
+    int                 length,		/* I - Bytes left in line */
+    unsigned char       ch)		/* I - Byte to match */
+{
+  int		count;			/* Number of matching bytes */
+  unsigned	mask;			/* Comparison mask */
+  __m256i	pattern;		/* Byte repeated 32 times */
+
+
+  pattern = _mm256_set1_epi8((char)ch);
+
+  for (count = 0; count + 32 <= length; count += 32)
+  {
+    mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+               _mm256_loadu_si256((const __m256i *)(line + count)), pattern));
+
+    if (mask != 0xffffffff)
+      return (count + __builtin_ctz(~mask));
+  }
+
+  while (count < length && line[count] == ch)
+    count ++;
+
+  return (count);
+}
+#endif /* HAVE_ZPL_SIMD */
+
+
+/*
+ * 'labelenc_write()' - Gather output.
+ *
+ * Data larger than the buffer goes to the sink directly.
+ */
+
+static void
+labelenc_write(labelenc_t *enc,		/* I - Encoder */
+               const void *data,	/* I - Data to write */
+	       size_t     length)	/* I - Number of bytes */
+{
+  if (enc->used + length > sizeof(enc->out))
+  {
+    labelenc_flush(enc);
+
+    if (length > sizeof(enc->out))
+    {
+      if (!enc->error && (*enc->sink)(enc->sink_data, data, length))
+        enc->error = 1;
+
+      return;
+    }
+  }
+
+  memcpy(enc->out + enc->used, data, length);
+  enc->used += length;
+}
+
+
+/*
+ * End of "$Id$".
+ */
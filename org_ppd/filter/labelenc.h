@@ -0,0 +1,156 @@
+/*
+ * "$Id$"
+ *
+ *   Label encoder for the label printer filters.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ */
+
+#ifndef _LABELENC_H_
+#  define _LABELENC_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include <cups/cups.h>
+#  include <cups/raster.h>
+#  include <stddef.h>
+
+
+/*
+ * Model number constants...
+ */
+
+#  define DYMO_3x0	0		/* Dymo Labelwriter 300/330/330 Turbo */
+
+#  define ZEBRA_EPL_LINE 0x10		/* Zebra EPL line mode printers */
+#  define ZEBRA_EPL_PAGE 0x11		/* Zebra EPL page mode printers */
+#  define ZEBRA_ZPL	0x12		/* Zebra ZPL-based printers */
+#  define ZEBRA_CPCL	0x13		/* Zebra CPCL-based printers */
+
+#  define INTELLITECH_PCL 0x20		/* Intellitech PCL-based printers */
+
+
+/*
+ * zeMediaTracking values...
+ */
+
+#  define LABELENC_TRACK_OTHER	0	/* Media tracking not set */
+#  define LABELENC_TRACK_CONTINUOUS 1	/* Continuous */
+#  define LABELENC_TRACK_WEB	2	/* Web */
+#  define LABELENC_TRACK_MARK	3	/* Mark */
+#  define LABELENC_TRACK_VARIABLE 4	/* VariableLength */
+
+#  define LABELENC_SEGMENT_ROWS	200	/* Rows per streamed ZPL segment */
+#  define LABELENC_BUFSIZE	8192	/* Output gathered per sink call */
+
+
+/*
+ * Types...
+ */
+
+typedef int (*labelenc_sink_t)(void *data, const void *buffer,
+			       size_t length);
+					/**** Output callback, 0 or -1 ****/
+
+typedef struct labelenc_s		/**** Label encoder ****/
+{
+  /* Fields are read-only outside labelenc.c */
+  int		model;			/* cupsModelNumber of printer */
+  labelenc_sink_t sink;			/* Output callback */
+  void		*sink_data;		/* Data for output callback */
+  int		error;			/* Non-zero after an output error */
+
+  /* Job options */
+  int		tracking,		/* LABELENC_TRACK_ value */
+		kiosk,			/* Non-zero for zePrintMode Kiosk */
+		inline_graphics,	/* Non-zero for inline ^GF graphics */
+		band_height,		/* zeBandHeight option */
+		max_graphic,		/* zeMaxGraphic option in bytes */
+		trim_margin,		/* Millimeters kept after the ink or -1 */
+		pcl_mode;		/* inPrintMode as 'S', 'T', 'C' or 0 */
+  char		start[64],		/* ZPL label start and print rate */
+		rate[32],		/* EPL/CPCL print rate command */
+		mode[256],		/* ZPL print mode and kiosk commands */
+		reprint[32],		/* Error reprint command */
+		backfeed[8];		/* ~JS value restored after streaming */
+  int		labeled,		/* Non-zero if label is rendered */
+		label_mode;		/* Offset of print mode in label */
+  cups_page_header2_t label_header;	/* Page header of label commands */
+  char		label[512];		/* ZPL label commands for header */
+
+  /* Current page */
+  cups_page_header2_t header;		/* Page header */
+  int		page,			/* Page number in job */
+		y,			/* Next line */
+		feed,			/* Number of lines to skip */
+		last_set,		/* Non-zero if last_buffer is valid */
+		band_rows,		/* Rows per graphic field */
+		streaming,		/* Non-zero to stream variable length */
+		segment_open,		/* Non-zero if a segment is started */
+		last_inked;		/* Last inked line or -1 */
+  unsigned char	*comp_buffer,		/* Compression buffer */
+		*last_buffer;		/* Previous line */
+  int		line_size;		/* Allocated size of line buffers */
+
+  /* Output */
+  size_t	used;			/* Bytes in out */
+  unsigned char	out[LABELENC_BUFSIZE];	/* Output for the sink */
+} labelenc_t;
+
+
+/*
+ * Globals...
+ */
+
+#  ifdef __cplusplus
+extern "C" {
+#  endif /* __cplusplus */
+
+extern int	(*LabelEncSpan)(const unsigned char *line, int length,
+		                unsigned char ch);
+					/* Repeated byte scanner */
+
+
+/*
+ * Prototypes...
+ */
+
+extern void	LabelEncInit(void);
+extern labelenc_t *LabelEncNew(labelenc_sink_t sink, void *data);
+extern void	LabelEncDelete(labelenc_t *enc);
+extern int	LabelEncStartJob(labelenc_t *enc, int model, int num_options,
+		                 cups_option_t *options);
+extern int	LabelEncStartPage(labelenc_t *enc,
+		                  cups_page_header2_t *header);
+extern int	LabelEncWriteRow(labelenc_t *enc, const unsigned char *row);
+extern int	LabelEncEndPage(labelenc_t *enc, int canceled);
+extern int	LabelEncWritePage(labelenc_t *enc, cups_page_header2_t *header,
+		                  const unsigned char *page);
+extern int	LabelEncStartLabel(labelenc_t *enc,
+		                   cups_page_header2_t *header, int segment,
+				   int last_inked);
+extern int	LabelEncStreaming(labelenc_t *enc,
+		                  cups_page_header2_t *header);
+extern int	LabelEncBandRows(labelenc_t *enc, int bpl, int rows);
+extern int	LabelEncZPLLine(const unsigned char *line, int length,
+		                unsigned char *out);
+extern int	LabelEncZPLDecode(const unsigned char *data, int datalen,
+		                  const unsigned char *prev,
+				  unsigned char *line, int length);
+
+#  ifdef __cplusplus
+}
+#  endif /* __cplusplus */
+
+#endif /* !_LABELENC_H_ */
+
+
+/*
+ * End of "$Id$".
+ */
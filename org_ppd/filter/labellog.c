@@ -0,0 +1,224 @@
+/*
+ * "$Id$"
+ *
+ *   Status and debug logging for the label printer filters.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ *
+ *   The scheduler drops DEBUG: messages unless its LogLevel is debug or
+ *   debug2, so the filters read the LogLevel from cupsd.conf and do not
+ *   format or write messages that would be dropped.  Each message is one
+ *   write, and progress is reported at most once a second.
+ *
+ * Contents:
+ *
+ *   LabelLogStart()    - Read the scheduler's LogLevel for a new job.
+ *   LabelLogDebug()    - Log a DEBUG: message at LogLevel debug.
+ *   LabelLogDebug2()   - Log a DEBUG2: message at LogLevel debug2.
+ *   LabelLogProgress() - Report how far a page has printed.
+ *   labellog_write()   - Write one message to the scheduler.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "labellog.h"
+#include <cups/i18n.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+
+
+/*
+ * Globals...
+ */
+
+int			LabelLogLevel = LABELLOG_DEBUG;
+					/* LABELLOG_ level of cupsd */
+static int		LogPage = 0,	/* Page of last progress message */
+			LogPercent = 0;	/* Percent of last progress message */
+static long long	LogTime = 0;	/* Time of last progress message */
+
+
+/*
+ * Local functions...
+ */
+
+static void	labellog_write(const char *prefix, const char *format,
+		               va_list ap);
+
+
+/*
+ * 'LabelLogStart()' - Read the scheduler's LogLevel for a new job.
+ *
+ * Messages up to DEBUG: are logged as before when cupsd.conf cannot be
+ * read.
+ */
+
+void
+LabelLogStart(void)
+{
+  FILE		*fp;			/* cupsd.conf file */
+  const char	*serverroot;		/* CUPS_SERVERROOT env var */
+  char		filename[1024],		/* cupsd.conf filename */
+		line[1024],		/* Line from file */
+		*ptr;			/* Pointer into line */
+
+
+  LabelLogLevel = LABELLOG_DEBUG;
+  LogPage       = 0;
+  LogPercent    = 0;
+  LogTime       = 0;
+
+  if ((serverroot = getenv("CUPS_SERVERROOT")) == NULL)
+    serverroot = "/etc/cups";
+
+  snprintf(filename, sizeof(filename), "%s/cupsd.conf", serverroot);
+
+  if ((fp = fopen(filename, "r")) == NULL)
+    return;
+
+ /*
+  * The last LogLevel line wins, as in cupsd...
+  */
+
+  while (fgets(line, sizeof(line), fp))
+  {
+    for (ptr = line; isspace(*ptr & 255); ptr ++);
+
+    if (strncasecmp(ptr, "LogLevel", 8) || !isspace(ptr[8] & 255))
+      continue;
+
+    for (ptr += 8; isspace(*ptr & 255); ptr ++);
+
+    if (!strncasecmp(ptr, "debug2", 6))
+      LabelLogLevel = LABELLOG_DEBUG2;
+    else if (!strncasecmp(ptr, "debug", 5))
+      LabelLogLevel = LABELLOG_DEBUG;
+    else
+      LabelLogLevel = LABELLOG_INFO;
+  }
+
+  fclose(fp);
+}
+
+
+/*
+ * 'LabelLogDebug()' - Log a DEBUG: message at LogLevel debug.
+ */
+
+void
+LabelLogDebug(const char *format,	/* I - printf-style format string */
+              ...)			/* I - Additional arguments */
+{
+  va_list	ap;			/* Argument pointer */
+
+
+  if (LabelLogLevel < LABELLOG_DEBUG)
+    return;
+
+  va_start(ap, format);
+  labellog_write("DEBUG: ", format, ap);
+  va_end(ap);
+}
+
+
+/*
+ * 'LabelLogDebug2()' - Log a DEBUG2: message at LogLevel debug2.
+ */
+
+void
+LabelLogDebug2(const char *format,	/* I - printf-style format string */
+               ...)			/* I - Additional arguments */
+{
+  va_list	ap;			/* Argument pointer */
+
+
+  if (LabelLogLevel < LABELLOG_DEBUG2)
+    return;
+
+  va_start(ap, format);
+  labellog_write("DEBUG2: ", format, ap);
+  va_end(ap);
+}
+
+
+/*
+ * 'LabelLogProgress()' - Report how far a page has printed.
+ *
+ * Call for each line; a message is written when the page or a further
+ * LABELLOG_STEP percent of it is reached, at most once per
+ * LABELLOG_INTERVAL.
+ */
+
+void
+LabelLogProgress(int page,		/* I - Page number */
+                 int line,		/* I - Current line */
+		 int lines)		/* I - Lines on page */
+{
+  int			percent;	/* Percent of page done */
+  long long		now;		/* Current time in ms */
+  struct timespec	ts;		/* Current time */
+
+
+  percent = lines > 0 ? (int)(100LL * line / lines) : 0;
+
+  if (page == LogPage && percent < LogPercent + LABELLOG_STEP)
+    return;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  now = ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+
+  if (LogPage && now - LogTime < LABELLOG_INTERVAL)
+    return;
+
+  LogPage    = page;
+  LogPercent = percent;
+  LogTime    = now;
+
+  fprintf(stderr, _("INFO: Printing page %d, %d%% complete...\n"), page,
+          percent);
+}
+
+
+/*
+ * 'labellog_write()' - Write one message to the scheduler.
+ */
+
+static void
+labellog_write(const char *prefix,	/* I - Message prefix */
+               const char *format,	/* I - printf-style format string */
+	       va_list    ap)		/* I - Arguments */
+{
+  char		buffer[2048];		/* Message */
+  size_t	length;			/* Length of message */
+
+
+  length = strlen(prefix);
+  memcpy(buffer, prefix, length);
+
+  vsnprintf(buffer + length, sizeof(buffer) - length, format, ap);
+
+ /*
+  * Keep a truncated message on its own line...
+  */
+
+  if ((length = strlen(buffer)) == sizeof(buffer) - 1)
+    buffer[length - 1] = '\n';
+
+  fputs(buffer, stderr);
+}
+
+
+/*
+ * End of "$Id$".
+ */
@@ -0,0 +1,76 @@
+/*
+ * "$Id$"
+ *
+ *   Status and debug logging for the label printer filters.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ */
+
+#ifndef _LABELLOG_H_
+#  define _LABELLOG_H_
+
+/*
+ * Constants...
+ */
+
+#  define LABELLOG_INFO		0	/* Errors, states and progress only */
+#  define LABELLOG_DEBUG	1	/* LogLevel debug: job details */
+#  define LABELLOG_DEBUG2	2	/* LogLevel debug2: page details */
+
+#  define LABELLOG_INTERVAL	1000	/* Least ms between progress messages */
+#  define LABELLOG_STEP		10	/* Least percent between them */
+
+
+/*
+ * Details logged for each page or line are only compiled in when DEBUG is
+ * defined, and then only logged at LogLevel debug2; the argument is the
+ * parenthesized format and values, as for CUPS's DEBUG_printf()...
+ */
+
+#  ifdef DEBUG
+#    define LABELLOG_PAGE(x)	LabelLogDebug2 x
+#  else
+#    define LABELLOG_PAGE(x)
+#  endif /* DEBUG */
+
+#  ifdef __GNUC__
+#    define LABELLOG_FORMAT(a,b) __attribute__ ((__format__ (__printf__, a, b)))
+#  else
+#    define LABELLOG_FORMAT(a,b)
+#  endif /* __GNUC__ */
+
+
+/*
+ * Globals...
+ */
+
+#  ifdef __cplusplus
+extern "C" {
+#  endif /* __cplusplus */
+
+extern int	LabelLogLevel;		/* LABELLOG_ level of cupsd */
+
+
+/*
+ * Prototypes...
+ */
+
+extern void	LabelLogStart(void);
+extern void	LabelLogDebug(const char *format, ...) LABELLOG_FORMAT(1, 2);
+extern void	LabelLogDebug2(const char *format, ...) LABELLOG_FORMAT(1, 2);
+extern void	LabelLogProgress(int page, int line, int lines);
+
+#  ifdef __cplusplus
+}
+#  endif /* __cplusplus */
+
+#endif /* !_LABELLOG_H_ */
+
+
+/*
+ * End of "$Id$".
+ */
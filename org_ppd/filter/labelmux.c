@@ -0,0 +1,923 @@
+/*
+ * "$Id$"
+ *
+ *   Priority multiplexer for label printers.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ *
+ *   Usage:
+ *
+ *     labelmux [-q bytes] printer queue ...
+ *
+ *   The multiplexer owns one printer, which is a file or device, or
+ *   "host[:port]" for a network printer (port 9100 by default), and
+ *   listens on a socket named for each queue in $LABELMUX_DIR (default
+ *   /var/run/labelmux).  Only the owner and the $LABELMUX_GROUP group
+ *   (default "lp", the group filters run as) may connect to the sockets.
+ *   Filters for those queues with a priority set
+ *   (zePriority or Priority) send their output there instead of to the
+ *   backend, so the queues should use a device that ignores the empty job
+ *   that then reaches it.
+ *
+ *   Each label or page is held until the filter finishes it and is then
+ *   sent whole: the highest priority first, and within a priority in the
+ *   order they were finished.  An urgent label thus waits at most for the
+ *   label being sent, however many labels a bulk job has queued.  A job's
+ *   setup is sent again before its next label whenever another job's
+ *   label went out in between.  A job is reported done to its filter once
+ *   its last label is sent; labels not yet sent are dropped when the job
+ *   is canceled or its filter goes away.
+ *
+ * Contents:
+ *
+ *   main()         - Schedule labels from the filters to the printer.
+ *   lm_accept()    - Accept a connection from a filter.
+ *   lm_drop()      - Drop a job's unsent labels.
+ *   lm_frame()     - Act on the end of a frame from a filter.
+ *   lm_listen()    - Listen for filters on a queue's socket.
+ *   lm_next()      - Pick the next label to send.
+ *   lm_now()       - Return the monotonic time in milliseconds.
+ *   lm_open()      - Open or start connecting to the printer.
+ *   lm_read()      - Read frames from a filter.
+ *   lm_reap()      - Close a finished job's connection.
+ *   lm_sighandler() - Stop the multiplexer.
+ *   lm_write()     - Send more of the current label to the printer.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "labelout.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <netdb.h>
+#include <grp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#ifndef MSG_NOSIGNAL
+#  define MSG_NOSIGNAL 0
+#endif /* !MSG_NOSIGNAL */
+
+
+/*
+ * Constants...
+ */
+
+#define LM_GROUP	"lp"		/* Default group allowed to connect */
+#define LM_PORT		"9100"		/* Default printer port */
+#define LM_QUEUED	1048576		/* Default bytes queued per job */
+#define LM_RETRY	1000		/* Milliseconds between reopens */
+#define LM_SNDBUF	16384		/* Socket buffer for network printers */
+
+#define LM_CLOSED	0		/* Printer not open */
+#define LM_CONNECT	1		/* Connection in progress */
+#define LM_READY	2		/* Printer open */
+
+
+/*
+ * Types...
+ */
+
+typedef struct lm_unit_s		/**** Finished label or page ****/
+{
+  struct lm_unit_s *next;		/* Next unit for job */
+  long		seq;			/* Order finished in */
+  char		*data;			/* Printer data */
+  size_t	length;			/* Length of data */
+} lm_unit_t;
+
+typedef struct lm_client_s		/**** Job sending labels ****/
+{
+  struct lm_client_s *next;		/* Next job */
+  int		fd,			/* Connection from filter */
+		id,			/* Job number for messages */
+		priority,		/* Priority, higher is sooner */
+		quit,			/* Filter is waiting for the end */
+		eof;			/* Filter closed its connection */
+  unsigned char	header[5];		/* Frame header */
+  size_t	headerlen,		/* Bytes of header read */
+		remaining;		/* Bytes of frame data left */
+  char		*data,			/* Unit being received */
+		*preamble;		/* Job setup */
+  size_t	length,			/* Length of unit being received */
+		alloc,			/* Allocated size of unit */
+		preamblelen,		/* Length of job setup */
+		queued;			/* Bytes in finished units */
+  lm_unit_t	*units,			/* Finished units */
+		*last;			/* Last finished unit */
+  long		labels;			/* Units sent */
+} lm_client_t;
+
+
+/*
+ * Globals...
+ */
+
+static lm_client_t	*Clients = NULL;/* Connected jobs */
+static int		NumQueues = 0,	/* Number of queue sockets */
+			*Queues = NULL;	/* Queue sockets */
+static char		**QueuePaths = NULL;
+					/* Queue socket filenames */
+static const char	*Printer = NULL;/* Printer file or "host:port" */
+static struct addrinfo	*PrinterAddrs = NULL;
+					/* Network printer addresses */
+static int		PrinterFd = -1,	/* Printer connection or -1 */
+			PrinterState = LM_CLOSED;
+					/* LM_ state */
+static long long	PrinterWake = 0;/* Time to reopen the printer or 0 */
+static size_t		MaxQueued = LM_QUEUED;
+					/* Most bytes queued per job */
+static lm_client_t	*Current = NULL;/* Job of label being sent */
+static lm_unit_t	*CurrentUnit = NULL;
+					/* Label being sent */
+static size_t		CurrentOffset = 0;
+					/* Bytes of label sent */
+static int		LastId = 0,	/* Job of last label sent */
+			NextId = 0;	/* Number of last job connected */
+static long		Seq = 0;	/* Units finished so far */
+static volatile int	Stop = 0;	/* Signal received */
+
+
+/*
+ * Local functions...
+ */
+
+static void		lm_accept(int fd);
+static void		lm_drop(lm_client_t *c);
+static void		lm_frame(lm_client_t *c);
+static int		lm_listen(const char *name);
+static void		lm_next(void);
+static long long	lm_now(void);
+static void		lm_open(long long now);
+static void		lm_read(lm_client_t *c);
+static void		lm_reap(lm_client_t *c);
+static void		lm_sighandler(int sig);
+static void		lm_write(long long now);
+
+
+/*
+ * 'main()' - Schedule labels from the filters to the printer.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line args */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		i;			/* Looping var */
+  int		opt;			/* Current option */
+  int		count;			/* Number of poll entries */
+  int		timeout;		/* Poll timeout in ms */
+  long long	now;			/* Current time */
+  lm_client_t	*c,			/* Current job */
+		*next;			/* Next job */
+  lm_client_t	**polled;		/* Job for each poll entry */
+  struct pollfd	*pfds;			/* Poll entries */
+  char		host[256],		/* Printer host name */
+		*port;			/* Printer port */
+  struct addrinfo hints;		/* Address lookup hints */
+  int		error;			/* Lookup error */
+
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGTERM, lm_sighandler);
+  signal(SIGINT, lm_sighandler);
+
+  while ((opt = getopt(argc, argv, "q:")) != -1)
+    switch (opt)
+    {
+      case 'q' :
+          if ((MaxQueued = (size_t)atol(optarg)) < 1)
+	    MaxQueued = LM_QUEUED;
+	  break;
+
+      default :
+          fputs("Usage: labelmux [-q bytes] printer queue ...\n", stderr);
+	  return (1);
+    }
+
+  if (argc - optind < 2)
+  {
+    fputs("Usage: labelmux [-q bytes] printer queue ...\n", stderr);
+    return (1);
+  }
+
+ /*
+  * A printer name without a slash is a network printer...
+  */
+
+  Printer = argv[optind ++];
+
+  if (!strchr(Printer, '/'))
+  {
+    strncpy(host, Printer, sizeof(host) - 1);
+    host[sizeof(host) - 1] = '\0';
+
+    if ((port = strrchr(host, ':')) != NULL && !strchr(port + 1, ']'))
+      *port++ = '\0';
+    else
+      port = LM_PORT;
+
+    if (host[0] == '[' && host[strlen(host) - 1] == ']')
+    {
+      host[strlen(host) - 1] = '\0';
+      memmove(host, host + 1, strlen(host));
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if ((error = getaddrinfo(host, port, &hints, &PrinterAddrs)) != 0)
+    {
+      fprintf(stderr, "ERROR: Unable to look up \"%s\": %s\n", Printer,
+              gai_strerror(error));
+      return (1);
+    }
+  }
+
+  if ((Queues = calloc(argc - optind, sizeof(int))) == NULL ||
+      (QueuePaths = calloc(argc - optind, sizeof(char *))) == NULL)
+  {
+    fputs("ERROR: Unable to allocate memory.\n", stderr);
+    return (1);
+  }
+
+  for (; optind < argc; optind ++)
+    if (lm_listen(argv[optind]))
+      break;
+
+  pfds   = NULL;
+  polled = NULL;
+
+  while (optind == argc && !Stop)
+  {
+   /*
+    * Start the next label and (re)open the printer for it...
+    */
+
+    now = lm_now();
+
+    if (!CurrentUnit)
+      lm_next();
+
+    if (CurrentUnit && PrinterState == LM_CLOSED &&
+        (!PrinterWake || PrinterWake <= now))
+      lm_open(now);
+
+    for (count = NumQueues + 1, c = Clients; c; c = c->next)
+      count ++;
+
+    if ((pfds = realloc(pfds, count * sizeof(struct pollfd))) == NULL ||
+        (polled = realloc(polled, count * sizeof(lm_client_t *))) == NULL)
+    {
+      fputs("ERROR: Unable to allocate memory.\n", stderr);
+      break;
+    }
+
+    for (count = 0; count < NumQueues; count ++)
+    {
+      pfds[count].fd      = Queues[count];
+      pfds[count].events  = POLLIN;
+      pfds[count].revents = 0;
+      polled[count]       = NULL;
+    }
+
+   /*
+    * Stop reading a job that has enough labels queued; a unit is always
+    * read to its end...
+    */
+
+    for (c = Clients; c; c = c->next)
+    {
+      if (c->eof || (c->units && c->queued + c->length >= MaxQueued))
+        continue;
+
+      pfds[count].fd      = c->fd;
+      pfds[count].events  = POLLIN;
+      pfds[count].revents = 0;
+      polled[count]       = c;
+      count ++;
+    }
+
+    if (PrinterFd >= 0 && (CurrentUnit || PrinterState == LM_CONNECT))
+    {
+      pfds[count].fd      = PrinterFd;
+      pfds[count].events  = POLLOUT;
+      pfds[count].revents = 0;
+      polled[count]       = NULL;
+      count ++;
+    }
+
+    if (CurrentUnit && PrinterState == LM_CLOSED && PrinterWake)
+      timeout = PrinterWake > now ? (int)(PrinterWake - now) : 0;
+    else
+      timeout = -1;
+
+    if (poll(pfds, count, timeout) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      fprintf(stderr, "ERROR: poll failed: %s\n", strerror(errno));
+      break;
+    }
+
+    now = lm_now();
+
+    for (i = 0; i < count; i ++)
+    {
+      if (!pfds[i].revents)
+        continue;
+
+      if (i < NumQueues)
+        lm_accept(Queues[i]);
+      else if (polled[i])
+        lm_read(polled[i]);
+      else
+        lm_write(now);
+    }
+
+    for (c = Clients; c; c = next)
+    {
+      next = c->next;
+
+      if ((c->quit || c->eof) && !c->units && !c->length && c != Current)
+        lm_reap(c);
+    }
+  }
+
+  for (i = 0; i < NumQueues; i ++)
+  {
+    close(Queues[i]);
+    unlink(QueuePaths[i]);
+  }
+
+  free(pfds);
+  free(polled);
+
+  return (Stop ? 0 : 1);
+}
+
+
+/*
+ * 'lm_accept()' - Accept a connection from a filter.
+ */
+
+static void
+lm_accept(int fd)			/* I - Queue socket */
+{
+  lm_client_t	*c;			/* New job */
+  int		cfd;			/* Connection */
+
+
+  if ((cfd = accept(fd, NULL, NULL)) < 0)
+    return;
+
+  if ((c = calloc(1, sizeof(lm_client_t))) == NULL)
+  {
+    fputs("ERROR: Unable to allocate memory.\n", stderr);
+    close(cfd);
+    return;
+  }
+
+  fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL) | O_NONBLOCK);
+
+  c->fd       = cfd;
+  c->id       = ++ NextId;
+  c->priority = 1;
+  c->next     = Clients;
+  Clients     = c;
+}
+
+
+/*
+ * 'lm_drop()' - Drop a job's unsent labels.
+ */
+
+static void
+lm_drop(lm_client_t *c)			/* I - Job */
+{
+  lm_unit_t	*unit,			/* Current unit */
+		*next;			/* Next unit */
+  long		dropped;		/* Number of units dropped */
+
+
+ /*
+  * Leave the label being sent, since part of it is already out...
+  */
+
+  for (dropped = 0, unit = c->units; unit; unit = next)
+  {
+    next = unit->next;
+
+    if (unit == CurrentUnit)
+    {
+      unit->next = NULL;
+      continue;
+    }
+
+    free(unit->data);
+    free(unit);
+    dropped ++;
+  }
+
+  c->units  = c->last = c == Current ? CurrentUnit : NULL;
+  c->queued = c->units ? c->units->length : 0;
+  c->length = 0;
+
+  if (dropped)
+    fprintf(stderr, "INFO: Job %d: Dropped %ld unsent labels.\n", c->id,
+            dropped);
+}
+
+
+/*
+ * 'lm_frame()' - Act on the end of a frame from a filter.
+ */
+
+static void
+lm_frame(lm_client_t *c)		/* I - Job */
+{
+  lm_unit_t	*unit;			/* New unit */
+
+
+  switch (c->header[0])
+  {
+    case LABELMUX_HELLO :
+        fprintf(stderr, "DEBUG: Job %d: Connected at priority %d.\n", c->id,
+	        c->priority);
+        break;
+
+    case LABELMUX_PREAMBLE :
+        free(c->preamble);
+
+        c->preamble    = c->data;
+	c->preamblelen = c->length;
+	c->data        = NULL;
+	c->length      = 0;
+	c->alloc       = 0;
+	break;
+
+    case LABELMUX_END :
+        if (!c->length)
+	  break;
+
+        if ((unit = calloc(1, sizeof(lm_unit_t))) == NULL)
+	{
+	  fputs("ERROR: Unable to allocate memory.\n", stderr);
+	  c->length = 0;
+	  break;
+	}
+
+        unit->seq    = ++ Seq;
+	unit->data   = c->data;
+	unit->length = c->length;
+
+        if (c->last)
+	  c->last->next = unit;
+	else
+	  c->units = unit;
+
+	c->last   = unit;
+	c->queued += unit->length;
+	c->data   = NULL;
+	c->length = 0;
+	c->alloc  = 0;
+	break;
+
+    case LABELMUX_QUIT :
+        c->quit = 1;
+	break;
+
+    case LABELMUX_CANCEL :
+        lm_drop(c);
+	break;
+  }
+
+  c->headerlen = 0;
+}
+
+
+/*
+ * 'lm_listen()' - Listen for filters on a queue's socket.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+lm_listen(const char *name)		/* I - Queue name or socket filename */
+{
+  int			fd;		/* Listening socket */
+  const char		*dir,		/* Socket directory */
+			*group;		/* Group allowed to connect */
+  struct sockaddr_un	addr;		/* Socket address */
+  struct group		*grp;		/* Group entry */
+  mode_t		mask;		/* Old umask */
+
+
+  if ((dir = getenv("LABELMUX_DIR")) == NULL)
+    dir = LABELMUX_DIR;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+
+  if (strchr(name, '/'))
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", name);
+  else
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/%s", dir, name);
+
+  unlink(addr.sun_path);
+
+ /*
+  * Anyone who can connect can send data to the printer, so the socket is
+  * created private and then opened to the group filters run as...
+  */
+
+  mask = umask(077);
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+      bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 16))
+  {
+    umask(mask);
+
+    fprintf(stderr, "ERROR: Unable to listen on \"%s\": %s\n", addr.sun_path,
+            strerror(errno));
+
+    if (fd >= 0)
+      close(fd);
+
+    return (-1);
+  }
+
+  umask(mask);
+
+  if ((group = getenv("LABELMUX_GROUP")) == NULL)
+    group = LM_GROUP;
+
+  if ((grp = getgrnam(group)) == NULL ||
+      chown(addr.sun_path, (uid_t)-1, grp->gr_gid))
+    fprintf(stderr, "DEBUG: Unable to give group \"%s\" access to "
+                    "\"%s\".\n", group, addr.sun_path);
+  else
+    chmod(addr.sun_path, 0660);
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  Queues[NumQueues]     = fd;
+  QueuePaths[NumQueues] = strdup(addr.sun_path);
+  NumQueues ++;
+
+  fprintf(stderr, "DEBUG: Listening on \"%s\".\n", addr.sun_path);
+
+  return (0);
+}
+
+
+/*
+ * 'lm_next()' - Pick the next label to send.
+ *
+ * The job's setup goes in front of the label when the last label sent
+ * came from another job.
+ */
+
+static void
+lm_next(void)
+{
+  lm_client_t	*c,			/* Current job */
+		*best;			/* Job to send */
+  lm_unit_t	*unit;			/* Label to send */
+  char		*data;			/* Label with job setup */
+  long		waiting;		/* Labels passed over */
+
+
+  for (best = NULL, c = Clients; c; c = c->next)
+    if (c->units &&
+        (!best || c->priority > best->priority ||
+	 (c->priority == best->priority && c->units->seq < best->units->seq)))
+      best = c;
+
+  if (!best)
+    return;
+
+  unit = best->units;
+
+  if (best->id != LastId && best->preamblelen)
+  {
+    if ((data = malloc(best->preamblelen + unit->length)) == NULL)
+    {
+      fputs("ERROR: Unable to allocate memory.\n", stderr);
+      return;
+    }
+
+    memcpy(data, best->preamble, best->preamblelen);
+    memcpy(data + best->preamblelen, unit->data, unit->length);
+
+    free(unit->data);
+
+    unit->data   = data;
+    unit->length += best->preamblelen;
+    best->queued += best->preamblelen;
+  }
+
+  if (LastId && best->id != LastId)
+  {
+    for (waiting = 0, c = Clients; c; c = c->next)
+      if (c != best && c->units && c->priority < best->priority)
+        waiting ++;
+
+    if (waiting)
+      fprintf(stderr, "DEBUG: Job %d: Priority %d label goes ahead of %ld "
+                      "waiting jobs.\n", best->id, best->priority, waiting);
+  }
+
+  Current       = best;
+  CurrentUnit   = unit;
+  CurrentOffset = 0;
+  LastId        = best->id;
+}
+
+
+/*
+ * 'lm_now()' - Return the monotonic time in milliseconds.
+ */
+
+static long long			/* O - Time in milliseconds */
+lm_now(void)
+{
+  struct timespec	now;		/* Current time */
+
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (now.tv_sec * 1000LL + now.tv_nsec / 1000000);
+}
+
+
+/*
+ * 'lm_open()' - Open or start connecting to the printer.
+ */
+
+static void
+lm_open(long long now)			/* I - Current time */
+{
+  struct addrinfo	*addr;		/* Current address */
+  int			sndbuf = LM_SNDBUF;
+					/* Socket buffer size */
+
+
+  PrinterWake = 0;
+
+  if (!PrinterAddrs)
+  {
+    if ((PrinterFd = open(Printer, O_WRONLY | O_CREAT | O_APPEND,
+                          0666)) >= 0)
+    {
+      fcntl(PrinterFd, F_SETFL, fcntl(PrinterFd, F_GETFL) | O_NONBLOCK);
+      PrinterState = LM_READY;
+      return;
+    }
+  }
+  else
+  {
+    for (addr = PrinterAddrs; addr; addr = addr->ai_next)
+    {
+      if ((PrinterFd = socket(addr->ai_family, addr->ai_socktype,
+                              addr->ai_protocol)) < 0)
+	continue;
+
+     /*
+      * Keep the socket buffer small so labels wait here, where an urgent
+      * one can still go ahead of them...
+      */
+
+      setsockopt(PrinterFd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+      fcntl(PrinterFd, F_SETFL, fcntl(PrinterFd, F_GETFL) | O_NONBLOCK);
+
+      if (!connect(PrinterFd, addr->ai_addr, addr->ai_addrlen) ||
+          errno == EINPROGRESS)
+      {
+        PrinterState = LM_CONNECT;
+        return;
+      }
+
+      close(PrinterFd);
+      PrinterFd = -1;
+    }
+  }
+
+  fprintf(stderr, "DEBUG: Unable to open \"%s\": %s\n", Printer,
+          strerror(errno));
+
+  PrinterFd   = -1;
+  PrinterWake = now + LM_RETRY;
+}
+
+
+/*
+ * 'lm_read()' - Read frames from a filter.
+ */
+
+static void
+lm_read(lm_client_t *c)			/* I - Job */
+{
+  ssize_t	bytes;			/* Bytes read */
+  size_t	n;			/* Bytes for this frame */
+  char		*ptr,			/* Pointer into buffer */
+		*end,			/* End of buffer */
+		*data;			/* Grown unit */
+  static char	buffer[65536];		/* Read buffer */
+
+
+  if ((bytes = read(c->fd, buffer, sizeof(buffer))) < 0)
+  {
+    if (errno == EAGAIN || errno == EINTR)
+      return;
+
+    bytes = 0;
+  }
+
+  if (bytes == 0)
+  {
+   /*
+    * A filter that goes away without ending its job was killed...
+    */
+
+    c->eof = 1;
+
+    if (!c->quit)
+      lm_drop(c);
+
+    return;
+  }
+
+  for (ptr = buffer, end = buffer + bytes; ptr < end; ptr += n)
+  {
+    if (c->headerlen < sizeof(c->header))
+    {
+      if ((n = sizeof(c->header) - c->headerlen) > (size_t)(end - ptr))
+        n = end - ptr;
+
+      memcpy(c->header + c->headerlen, ptr, n);
+
+      if ((c->headerlen += n) < sizeof(c->header))
+        break;
+
+      c->remaining = ((size_t)c->header[1] << 24) |
+                     ((size_t)c->header[2] << 16) |
+		     ((size_t)c->header[3] << 8) | c->header[4];
+
+      if (!c->remaining)
+        lm_frame(c);
+
+      continue;
+    }
+
+    if ((n = c->remaining) > (size_t)(end - ptr))
+      n = end - ptr;
+
+    if (c->header[0] == LABELMUX_HELLO)
+      c->priority = *ptr;
+    else if (c->header[0] == LABELMUX_DATA)
+    {
+      if (c->length + n > c->alloc)
+      {
+        if ((data = realloc(c->data, 2 * (c->length + n))) == NULL)
+	{
+	  fputs("ERROR: Unable to allocate memory.\n", stderr);
+	  c->eof = 1;
+	  lm_drop(c);
+	  return;
+	}
+
+        c->data  = data;
+	c->alloc = 2 * (c->length + n);
+      }
+
+      memcpy(c->data + c->length, ptr, n);
+      c->length += n;
+    }
+
+    if ((c->remaining -= n) == 0)
+      lm_frame(c);
+  }
+}
+
+
+/*
+ * 'lm_reap()' - Close a finished job's connection.
+ */
+
+static void
+lm_reap(lm_client_t *c)			/* I - Job */
+{
+  lm_client_t	**prev;			/* Link to job */
+  char		reply = LABELMUX_DONE;	/* Reply to filter */
+
+
+  if (c->quit)
+    send(c->fd, &reply, 1, MSG_NOSIGNAL);
+
+  fprintf(stderr, "INFO: Job %d: Sent %ld labels.\n", c->id, c->labels);
+
+  for (prev = &Clients; *prev != c; prev = &((*prev)->next));
+
+  *prev = c->next;
+
+  close(c->fd);
+  free(c->data);
+  free(c->preamble);
+  free(c);
+}
+
+
+/*
+ * 'lm_sighandler()' - Stop the multiplexer.
+ */
+
+static void
+lm_sighandler(int sig)			/* I - Signal */
+{
+  (void)sig;
+
+  Stop = 1;
+}
+
+
+/*
+ * 'lm_write()' - Send more of the current label to the printer.
+ *
+ * A label interrupted by a printer error is sent again from its start
+ * once the printer is reopened.
+ */
+
+static void
+lm_write(long long now)			/* I - Current time */
+{
+  ssize_t	bytes;			/* Bytes written */
+  int		error;			/* Connection error */
+  socklen_t	len;			/* Length of error */
+  lm_client_t	*c = Current;		/* Job of label */
+  lm_unit_t	*unit = CurrentUnit;	/* Label being sent */
+
+
+  if (PrinterState == LM_CONNECT)
+  {
+    len = sizeof(error);
+
+    if (getsockopt(PrinterFd, SOL_SOCKET, SO_ERROR, &error, &len) || error)
+      errno = error ? error : errno;
+    else
+    {
+      fprintf(stderr, "DEBUG: Connected to \"%s\".\n", Printer);
+      PrinterState = LM_READY;
+      return;
+    }
+  }
+  else if (!unit)
+    return;
+  else if ((bytes = write(PrinterFd, unit->data + CurrentOffset,
+                          unit->length - CurrentOffset)) >= 0 ||
+           errno == EAGAIN || errno == EINTR)
+  {
+    if (bytes < 0 || (CurrentOffset += bytes) < unit->length)
+      return;
+
+   /*
+    * Finished the label...
+    */
+
+    c->units  = unit->next;
+    c->queued -= unit->length;
+    c->labels ++;
+
+    if (!c->units)
+      c->last = NULL;
+
+    free(unit->data);
+    free(unit);
+
+    Current     = NULL;
+    CurrentUnit = NULL;
+    return;
+  }
+
+  fprintf(stderr, "DEBUG: Unable to write to \"%s\": %s\n", Printer,
+          strerror(errno));
+
+  close(PrinterFd);
+
+  PrinterFd     = -1;
+  PrinterState  = LM_CLOSED;
+  PrinterWake   = now + LM_RETRY;
+  CurrentOffset = 0;
+}
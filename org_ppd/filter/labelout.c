@@ -0,0 +1,883 @@
+/*
+ * "$Id$"
+ *
+ *   Buffered output writer for the label printer filters.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ *
+ * Contents:
+ *
+ *   LabelOutMux()      - Send output through the label multiplexer.
+ *   LabelOutStart()    - Send stdout through a large counted output buffer.
+ *   LabelOutPreamble() - Mark the output so far as the job setup.
+ *   LabelOutFlush()    - Flush buffered output at a page or job boundary.
+ *   LabelOutPoll()     - Flush buffered output once the latency bound is up.
+ *   LabelOutWrite()    - Write encoder output to the printer.
+ *   LabelOutEnd()      - Flush the end of the job and log the write count.
+ *   labelout_exit()    - Send queued output when the filter exits early.
+ *   labelout_frame()   - Send a frame to the label multiplexer.
+ *   labelout_put()     - Write a block of output to the printer.
+ *   labelout_stop()    - Send queued output and stop the writer thread.
+ *   labelout_submit()  - Queue the buffer being filled for writing.
+ *   labelout_thread()  - Write queued buffers to the printer.
+ *   labelout_wait()    - Wait until a non-blocking descriptor takes output.
+ *   labelout_write()   - Write buffered output to the printer.
+ *   labelout_writefn() - Write buffered output for funopen().
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE			/* For fopencookie() and F_SETPIPE_SZ */
+#endif /* !_GNU_SOURCE */
+
+#include "labelout.h"
+#include "labellog.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifndef MSG_NOSIGNAL
+#  define MSG_NOSIGNAL 0
+#endif /* !MSG_NOSIGNAL */
+
+/*
+ * Output is counted by pointing stdout at a stream of our own, which
+ * needs fopencookie() or funopen() and a stdout that can be assigned to.
+ * Elsewhere stdout is only given the large buffer...
+ */
+
+#if defined(__GLIBC__)
+#  define HAVE_FOPENCOOKIE 1
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+      defined(__OpenBSD__) || defined(__DragonFly__)
+#  define HAVE_FUNOPEN 1
+#endif /* __GLIBC__ */
+
+#if defined(HAVE_FOPENCOOKIE) || defined(HAVE_FUNOPEN)
+#  define HAVE_OUTSTREAM 1
+#endif /* HAVE_FOPENCOOKIE || HAVE_FUNOPEN */
+
+/*
+ * Output buffers for the writer thread...
+ */
+
+#define LABELOUT_SLOTS	4		/* Number of buffers in the ring */
+
+typedef struct labelout_slot_s		/**** Output buffer ****/
+{
+  char		*data;			/* Buffered output */
+  size_t	used;			/* Bytes in buffer */
+} labelout_slot_t;
+
+
+/*
+ * Globals...
+ */
+
+static int		OutFd = 1;	/* Printer file descriptor */
+static int		OutMux = -1;	/* Multiplexer connection or -1 */
+#ifdef HAVE_OUTSTREAM
+static FILE		*OutStdout = NULL,
+					/* stdout before LabelOutStart() */
+			*OutStream = NULL;
+					/* Counted output stream */
+#endif /* HAVE_OUTSTREAM */
+static char		*OutBuffer = NULL;
+					/* Output buffer */
+static size_t		OutSize = 0;	/* Size of output buffer */
+static int		OutExit = 0;	/* Is labelout_exit() registered? */
+static int		OutLatency = 0;	/* Longest time to hold output (ms) */
+static struct timespec	OutLast;	/* Time of last write */
+static long		OutWrites = 0,	/* Number of write calls */
+			OutBytes = 0;	/* Number of bytes written */
+static int		OutAsync = 0,	/* Writing on a separate thread? */
+			OutStopping = 0,/* Writer thread should exit */
+			OutError = 0;	/* Write error seen */
+static pthread_t	OutThread;	/* Writer thread */
+static pthread_mutex_t	OutLock = PTHREAD_MUTEX_INITIALIZER;
+					/* Lock for the buffer ring */
+static pthread_cond_t	OutQueuedCond = PTHREAD_COND_INITIALIZER,
+					/* A buffer was queued */
+			OutFreedCond = PTHREAD_COND_INITIALIZER;
+					/* A buffer was written */
+static labelout_slot_t	OutSlots[LABELOUT_SLOTS];
+					/* Buffer ring */
+static size_t		OutSlotSize = 0;/* Size of each buffer */
+static int		OutFill = 0,	/* Buffer being filled */
+			OutDrain = 0,	/* Next buffer to write */
+			OutQueued = 0;	/* Buffers queued or being written */
+
+
+/*
+ * Local functions...
+ */
+
+static void	labelout_exit(void);
+static int	labelout_frame(int type, const char *data, size_t length);
+static ssize_t	labelout_put(const char *data, size_t length);
+static void	labelout_stop(void);
+static void	labelout_submit(void);
+static void	*labelout_thread(void *data);
+static void	labelout_wait(int fd);
+#ifdef HAVE_OUTSTREAM
+static ssize_t	labelout_write(void *cookie, const char *data, size_t length);
+#endif /* HAVE_OUTSTREAM */
+#ifdef HAVE_FUNOPEN
+static int	labelout_writefn(void *cookie, const char *data, int length);
+#endif /* HAVE_FUNOPEN */
+
+
+/*
+ * 'LabelOutMux()' - Send output through the label multiplexer.
+ *
+ * The multiplexer listens on "$LABELMUX_DIR/$PRINTER" and owns the
+ * printer; see labelmux.c.  Output is sent there in frames, and each
+ * LabelOutFlush() ends a label or page that is scheduled whole against
+ * the labels of other jobs.  Nothing comes back on the back channel, so
+ * the filter must not wait for printer replies.  Call this before
+ * LabelOutStart(); output goes to stdout as usual if it fails.
+ */
+
+int					/* O - 0 on success, -1 on error */
+LabelOutMux(int priority)		/* I - Priority, higher is sooner */
+{
+  const char		*dir,		/* Socket directory */
+			*printer;	/* Printer name */
+  struct sockaddr_un	addr;		/* Multiplexer address */
+  char			value;		/* Priority byte */
+
+
+  if ((printer = getenv("PRINTER")) == NULL)
+  {
+    LabelLogDebug("PRINTER not set, not using the label multiplexer.\n");
+    return (-1);
+  }
+
+  if ((dir = getenv("LABELMUX_DIR")) == NULL)
+    dir = LABELMUX_DIR;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+
+  if (snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/%s", dir,
+               printer) >= (int)sizeof(addr.sun_path) ||
+      (OutMux = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    return (-1);
+
+  fcntl(OutMux, F_SETFD, FD_CLOEXEC);
+
+  value = (char)priority;
+
+  if (connect(OutMux, (struct sockaddr *)&addr, sizeof(addr)) ||
+      labelout_frame(LABELMUX_HELLO, &value, 1))
+  {
+    LabelLogDebug("Unable to use label multiplexer \"%s\": %s\n",
+                  addr.sun_path, strerror(errno));
+    close(OutMux);
+    OutMux = -1;
+    return (-1);
+  }
+
+  LabelLogDebug("Sending output through label multiplexer \"%s\" at "
+                "priority %d.\n", addr.sun_path, priority);
+
+  return (0);
+}
+
+
+/*
+ * 'LabelOutStart()' - Send stdout through a large counted output buffer.
+ *
+ * Output is held until the buffer fills, LabelOutFlush() is called, or
+ * LabelOutPoll() finds it older than the latency bound (0 for none).
+ * The bound is only checked between lines of output, so output can be held
+ * longer while the filter waits for raster data.
+ *
+ * With "async" set, full buffers are written on a separate thread so the
+ * filter keeps encoding while the backend drains them; the thread blocks
+ * in write() while the backend is busy.  When the output is a pipe it is
+ * enlarged to hold a whole buffer.  If the thread cannot be started,
+ * output is written in place as before.  Output to the multiplexer is
+ * always written in place.
+ *
+ * Output may be started again after LabelOutEnd() for another job in the
+ * same process, reusing the buffer for output written in place.
+ */
+
+int					/* O - 0 on success, -1 on error */
+LabelOutStart(size_t size,		/* I - Size of output buffer */
+              int    latency,		/* I - Latency bound in milliseconds */
+	      int    async)		/* I - Write on a separate thread? */
+{
+  FILE			*fp;		/* Counted output stream */
+  int			i;		/* Looping var */
+  struct stat		fileinfo;	/* Output file information */
+  sigset_t		mask,		/* Signals blocked in writer */
+			oldmask;	/* Signals blocked before */
+#ifdef HAVE_FOPENCOOKIE
+  cookie_io_functions_t	io = { NULL, labelout_write, NULL, NULL };
+					/* Stream callbacks */
+#endif /* HAVE_FOPENCOOKIE */
+
+
+  fflush(stdout);
+
+  OutFd        = OutMux >= 0 ? OutMux : fileno(stdout);
+  OutLatency   = latency;
+  OutWrites    = 0;
+  OutBytes     = 0;
+  OutError     = 0;
+  OutStopping  = 0;
+  OutFill      = 0;
+  OutDrain     = 0;
+  OutQueued    = 0;
+
+  if (OutMux >= 0)
+    async = 0;
+
+  if ((OutMux >= 0 || async) && !OutExit)
+  {
+    OutExit = 1;
+
+    atexit(labelout_exit);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &OutLast);
+
+  if (async)
+  {
+   /*
+    * Allocate the buffer ring...
+    */
+
+    OutSlotSize = size;
+
+    for (i = 0; i < LABELOUT_SLOTS; i ++)
+    {
+      OutSlots[i].used = 0;
+
+      if ((OutSlots[i].data = malloc(size)) == NULL)
+        break;
+    }
+
+    if (i < LABELOUT_SLOTS)
+    {
+      while (i > 0)
+        free(OutSlots[--i].data);
+
+      OutSlotSize = 0;
+      async       = 0;
+    }
+  }
+
+  if (async)
+  {
+#ifdef F_SETPIPE_SZ
+   /*
+    * Let a pipe to the backend hold a whole buffer...
+    */
+
+    if (!fstat(OutFd, &fileinfo) && S_ISFIFO(fileinfo.st_mode))
+      fcntl(OutFd, F_SETPIPE_SZ, (int)size);
+#else
+    (void)fileinfo;
+#endif /* F_SETPIPE_SZ */
+
+   /*
+    * Leave SIGTERM to the main thread so the cancel handler runs where
+    * the output is produced...
+    */
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, &oldmask);
+
+    if (pthread_create(&OutThread, NULL, labelout_thread, NULL))
+    {
+      for (i = 0; i < LABELOUT_SLOTS; i ++)
+        free(OutSlots[i].data);
+
+      OutSlotSize = 0;
+    }
+    else
+      OutAsync = 1;
+
+    pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+  }
+
+  if (!OutAsync && OutSize < size)
+  {
+    free(OutBuffer);
+
+    if ((OutBuffer = malloc(size)) == NULL)
+    {
+      OutSize = 0;
+      return (-1);
+    }
+
+    OutSize = size;
+  }
+
+#if defined(HAVE_FOPENCOOKIE)
+  fp = fopencookie(NULL, "w", io);
+#elif defined(HAVE_FUNOPEN)
+  fp = funopen(NULL, NULL, labelout_writefn, NULL, NULL);
+#else
+  fp = NULL;
+#endif /* HAVE_FOPENCOOKIE */
+
+  if (!fp)
+  {
+    if (OutAsync)
+      labelout_stop();
+
+    if (OutMux >= 0)
+    {
+     /*
+      * The multiplexer sees a job with no labels...
+      */
+
+      close(OutMux);
+      OutMux = -1;
+      OutFd  = fileno(stdout);
+    }
+
+    if (OutSize < size)
+    {
+      free(OutBuffer);
+
+      if ((OutBuffer = malloc(size)) == NULL)
+      {
+        OutSize = 0;
+        return (-1);
+      }
+
+      OutSize = size;
+    }
+
+   /*
+    * Still buffer the output, just without counting the writes...
+    */
+
+    setvbuf(stdout, OutBuffer, _IOFBF, size);
+    OutWrites = -1;
+    return (-1);
+  }
+
+ /*
+  * The writer thread has its own buffers, so stdio only batches small
+  * writes for it...
+  */
+
+  if (!OutAsync)
+    setvbuf(fp, OutBuffer, _IOFBF, size);
+
+#ifdef HAVE_OUTSTREAM
+  OutStdout = stdout;
+  OutStream = fp;
+  stdout    = fp;
+#endif /* HAVE_OUTSTREAM */
+
+  return (0);
+}
+
+
+/*
+ * 'LabelOutPreamble()' - Mark the output so far as the job setup.
+ *
+ * The multiplexer sends it again before the job's next label whenever a
+ * label from another job went out in between.
+ */
+
+void
+LabelOutPreamble(void)
+{
+  if (OutMux < 0)
+    return;
+
+  fflush(stdout);
+  labelout_frame(LABELMUX_PREAMBLE, NULL, 0);
+}
+
+
+/*
+ * 'LabelOutFlush()' - Flush buffered output at a page or job boundary.
+ */
+
+void
+LabelOutFlush(void)
+{
+  fflush(stdout);
+
+  if (OutAsync)
+    labelout_submit();
+
+  if (OutMux >= 0)
+    labelout_frame(LABELMUX_END, NULL, 0);
+
+  clock_gettime(CLOCK_MONOTONIC, &OutLast);
+}
+
+
+/*
+ * 'LabelOutPoll()' - Flush buffered output once the latency bound is up.
+ *
+ * The filters call this after each line they output.  Nothing flushes the
+ * output between calls: a timer or the writer thread would have to share
+ * stdout and the multiplexer connection with the filter.  While the
+ * filter waits in RasterInReadLine() or cupsRasterReadPixels(), output
+ * stays buffered until the next line is output or the page ends.
+ */
+
+void
+LabelOutPoll(void)
+{
+  struct timespec	now;		/* Current time */
+
+
+  if (OutLatency <= 0)
+    return;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  if ((now.tv_sec - OutLast.tv_sec) * 1000 +
+      (now.tv_nsec - OutLast.tv_nsec) / 1000000 >= OutLatency)
+  {
+    fflush(stdout);
+
+    if (OutAsync)
+      labelout_submit();
+
+    OutLast = now;
+  }
+}
+
+
+/*
+ * 'LabelOutWrite()' - Write encoder output to the printer.
+ *
+ * This is the labelenc_t sink for the filters; the output goes through
+ * stdout like the rest of the job's output.
+ */
+
+int					/* O - 0 on success, -1 on error */
+LabelOutWrite(void       *data,		/* I - Unused */
+              const void *buffer,	/* I - Data to write */
+	      size_t     length)	/* I - Number of bytes */
+{
+  (void)data;
+
+  if (fwrite(buffer, 1, length, stdout) < length)
+    return (-1);
+
+  LabelOutPoll();
+
+  return (0);
+}
+
+
+/*
+ * 'LabelOutEnd()' - Flush the end of the job and log the write count.
+ */
+
+void
+LabelOutEnd(int canceled)		/* I - Non-zero if the job was canceled */
+{
+  int		async = OutAsync,	/* Were buffers written on a thread? */
+		mux = OutMux >= 0;	/* Was output multiplexed? */
+  ssize_t	bytes;			/* Bytes read */
+  char		reply;			/* Reply from multiplexer */
+
+
+  fflush(stdout);
+
+  if (OutAsync)
+    labelout_stop();
+
+  if (mux)
+  {
+   /*
+    * Wait for the multiplexer to send the job's last label; a canceled
+    * job, or a signal while waiting, drops the labels not yet sent...
+    */
+
+    labelout_frame(canceled ? LABELMUX_CANCEL : LABELMUX_END, NULL, 0);
+    labelout_frame(LABELMUX_QUIT, NULL, 0);
+
+    while ((bytes = recv(OutMux, &reply, 1, 0)) < 0 && errno == EINTR)
+      labelout_frame(LABELMUX_CANCEL, NULL, 0);
+
+    if (bytes != 1 || reply != LABELMUX_DONE)
+      LabelLogDebug("Label multiplexer did not finish the job.\n");
+
+    close(OutMux);
+    OutMux = -1;
+  }
+
+  if (OutWrites >= 0)
+    LabelLogDebug("Wrote %ld bytes to the printer in %ld %s calls.\n",
+                  OutBytes, OutWrites,
+		  async ? "asynchronous write" :
+		  mux ? "multiplexer write" : "write");
+
+ /*
+  * Put stdout back so output can be started again...
+  */
+
+#ifdef HAVE_OUTSTREAM
+  if (OutStream)
+  {
+    stdout = OutStdout;
+
+    fclose(OutStream);
+    OutStream = NULL;
+  }
+#endif /* HAVE_OUTSTREAM */
+}
+
+
+/*
+ * 'labelout_exit()' - Send queued output when the filter exits early.
+ */
+
+static void
+labelout_exit(void)
+{
+  if (OutAsync)
+  {
+    fflush(stdout);
+    labelout_stop();
+  }
+
+  if (OutMux >= 0)
+  {
+    fflush(stdout);
+    labelout_frame(LABELMUX_END, NULL, 0);
+  }
+}
+
+
+/*
+ * 'labelout_frame()' - Send a frame to the label multiplexer.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+labelout_frame(int        type,		/* I - Frame type */
+               const char *data,	/* I - Frame data */
+	       size_t     length)	/* I - Number of bytes */
+{
+  unsigned char	header[5];		/* Frame type and length */
+  struct iovec	iov[2];			/* Header and data */
+  struct msghdr	msg;			/* Message to send */
+  ssize_t	bytes;			/* Bytes sent */
+
+
+  header[0] = (unsigned char)type;
+  header[1] = (unsigned char)(length >> 24);
+  header[2] = (unsigned char)(length >> 16);
+  header[3] = (unsigned char)(length >> 8);
+  header[4] = (unsigned char)length;
+
+  iov[0].iov_base = header;
+  iov[0].iov_len  = sizeof(header);
+  iov[1].iov_base = (void *)data;
+  iov[1].iov_len  = length;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov    = iov;
+  msg.msg_iovlen = 2;
+
+  while (iov[0].iov_len + iov[1].iov_len > 0)
+  {
+    OutWrites ++;
+
+    if ((bytes = sendmsg(OutMux, &msg, MSG_NOSIGNAL)) < 0)
+    {
+      if (errno == EAGAIN)
+        labelout_wait(OutMux);
+      else if (errno != EINTR)
+        return (-1);
+
+      continue;
+    }
+
+    if ((size_t)bytes >= iov[0].iov_len)
+    {
+      bytes           -= iov[0].iov_len;
+      iov[0].iov_len  = 0;
+      iov[1].iov_base = (char *)iov[1].iov_base + bytes;
+      iov[1].iov_len  -= bytes;
+    }
+    else
+    {
+      iov[0].iov_base = header + (sizeof(header) - iov[0].iov_len) + bytes;
+      iov[0].iov_len  -= bytes;
+    }
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'labelout_put()' - Write a block of output to the printer.
+ */
+
+static ssize_t				/* O - Bytes written or -1 on error */
+labelout_put(const char *data,		/* I - Data to write */
+             size_t     length)		/* I - Number of bytes */
+{
+  size_t	total;			/* Total bytes written */
+  ssize_t	bytes;			/* Bytes written by this call */
+
+
+  if (OutMux >= 0)
+  {
+    if (labelout_frame(LABELMUX_DATA, data, length))
+      return (-1);
+
+    OutBytes += (long)length;
+
+    return ((ssize_t)length);
+  }
+
+  for (total = 0; total < length; total += bytes)
+  {
+    OutWrites ++;
+
+    if ((bytes = write(OutFd, data + total, length - total)) < 0)
+    {
+      if (errno == EAGAIN)
+        labelout_wait(OutFd);
+      else if (errno != EINTR)
+        return (-1);
+
+      bytes = 0;
+    }
+  }
+
+  OutBytes += (long)length;
+
+  return ((ssize_t)length);
+}
+
+
+/*
+ * 'labelout_stop()' - Send queued output and stop the writer thread.
+ */
+
+static void
+labelout_stop(void)
+{
+  int	i;				/* Looping var */
+
+
+  labelout_submit();
+
+  pthread_mutex_lock(&OutLock);
+  OutStopping = 1;
+  pthread_cond_signal(&OutQueuedCond);
+  pthread_mutex_unlock(&OutLock);
+
+  pthread_join(OutThread, NULL);
+
+ /*
+  * Anything written after this goes straight to the printer...
+  */
+
+  for (i = 0; i < LABELOUT_SLOTS; i ++)
+    free(OutSlots[i].data);
+
+  OutSlotSize = 0;
+  OutAsync    = 0;
+}
+
+
+/*
+ * 'labelout_submit()' - Queue the buffer being filled for writing.
+ */
+
+static void
+labelout_submit(void)
+{
+  labelout_slot_t	*slot;		/* Buffer being filled */
+  sigset_t		mask,		/* SIGTERM */
+			oldmask;	/* Signals blocked before */
+
+
+  slot = OutSlots + OutFill;
+
+  if (!slot->used)
+    return;
+
+ /*
+  * Don't let the cancel handler find the ring locked...
+  */
+
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &mask, &oldmask);
+
+  pthread_mutex_lock(&OutLock);
+
+  OutQueued ++;
+  OutFill = (OutFill + 1) % LABELOUT_SLOTS;
+
+  pthread_cond_signal(&OutQueuedCond);
+
+  while (OutQueued == LABELOUT_SLOTS)
+    pthread_cond_wait(&OutFreedCond, &OutLock);
+
+  pthread_mutex_unlock(&OutLock);
+
+  slot       = OutSlots + OutFill;
+  slot->used = 0;
+
+  pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+}
+
+
+/*
+ * 'labelout_thread()' - Write queued buffers to the printer.
+ */
+
+static void *				/* O - Thread exit status (unused) */
+labelout_thread(void *data)		/* I - Unused */
+{
+  labelout_slot_t	*slot;		/* Buffer to write */
+
+
+  (void)data;
+
+  pthread_mutex_lock(&OutLock);
+
+  for (;;)
+  {
+    while (!OutQueued && !OutStopping)
+      pthread_cond_wait(&OutQueuedCond, &OutLock);
+
+    if (!OutQueued)
+      break;
+
+    slot = OutSlots + OutDrain;
+
+    pthread_mutex_unlock(&OutLock);
+
+    if (!OutError && labelout_put(slot->data, slot->used) < 0)
+    {
+      LabelLogDebug("Unable to write print data: %s\n", strerror(errno));
+      OutError = 1;
+    }
+
+    pthread_mutex_lock(&OutLock);
+
+    OutDrain = (OutDrain + 1) % LABELOUT_SLOTS;
+    OutQueued --;
+
+    pthread_cond_signal(&OutFreedCond);
+  }
+
+  pthread_mutex_unlock(&OutLock);
+
+  return (NULL);
+}
+
+
+/*
+ * 'labelout_wait()' - Wait until a non-blocking descriptor takes output.
+ */
+
+static void
+labelout_wait(int fd)			/* I - File descriptor */
+{
+  struct pollfd	pfd;			/* Poll entry */
+
+
+  pfd.fd     = fd;
+  pfd.events = POLLOUT;
+
+  poll(&pfd, 1, -1);
+}
+
+
+#ifdef HAVE_OUTSTREAM
+/*
+ * 'labelout_write()' - Write buffered output to the printer.
+ */
+
+static ssize_t				/* O - Bytes written or -1 on error */
+labelout_write(void       *cookie,	/* I - Unused */
+               const char *data,	/* I - Data to write */
+	       size_t     length)	/* I - Number of bytes */
+{
+  labelout_slot_t	*slot;		/* Buffer being filled */
+  size_t		total,		/* Total bytes buffered */
+			bytes;		/* Bytes buffered this time */
+
+
+  (void)cookie;
+
+  if (!OutAsync)
+  {
+    if (labelout_put(data, length) < 0)
+      return (-1);
+
+    clock_gettime(CLOCK_MONOTONIC, &OutLast);
+
+    return ((ssize_t)length);
+  }
+
+  for (total = 0; total < length; total += bytes)
+  {
+    slot  = OutSlots + OutFill;
+    bytes = OutSlotSize - slot->used;
+
+    if (bytes > length - total)
+      bytes = length - total;
+
+    memcpy(slot->data + slot->used, data + total, bytes);
+    slot->used += bytes;
+
+    if (slot->used == OutSlotSize)
+      labelout_submit();
+  }
+
+  return ((ssize_t)length);
+}
+#endif /* HAVE_OUTSTREAM */
+
+
+#ifdef HAVE_FUNOPEN
+/*
+ * 'labelout_writefn()' - Write buffered output for funopen().
+ */
+
+static int				/* O - Bytes written or -1 on error */
+labelout_writefn(void       *cookie,	/* I - Unused */
+                 const char *data,	/* I - Data to write */
+		 int        length)	/* I - Number of bytes */
+{
+  return ((int)labelout_write(cookie, data, (size_t)length));
+}
+#endif /* HAVE_FUNOPEN */
+
+
+/*
+ * End of "$Id$".
+ */
@@ -0,0 +1,72 @@
+/*
+ * "$Id$"
+ *
+ *   Buffered output writer for the label printer filters.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ */
+
+#ifndef _LABELOUT_H_
+#  define _LABELOUT_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include <stdio.h>
+
+
+/*
+ * Constants...
+ */
+
+#  define LABELOUT_BUFSIZE	262144	/* Default output buffer size */
+
+#  define LABELMUX_DIR		"/var/run/labelmux"
+					/* Default multiplexer socket directory */
+
+
+/*
+ * Multiplexer frame types; each frame is the type byte, a 4-byte length
+ * in network order, and that many bytes...
+ */
+
+#  define LABELMUX_HELLO	'H'	/* Job priority (1 byte) */
+#  define LABELMUX_DATA		'D'	/* Printer data */
+#  define LABELMUX_PREAMBLE	'P'	/* Data so far is the job setup */
+#  define LABELMUX_END		'E'	/* End of a label or page */
+#  define LABELMUX_QUIT		'Q'	/* End of the job */
+#  define LABELMUX_CANCEL	'C'	/* Drop the job's unsent labels */
+#  define LABELMUX_DONE		'F'	/* Reply: the job is finished */
+
+
+/*
+ * Prototypes...
+ */
+
+#  ifdef __cplusplus
+extern "C" {
+#  endif /* __cplusplus */
+
+extern int	LabelOutMux(int priority);
+extern int	LabelOutStart(size_t size, int latency, int async);
+extern void	LabelOutPreamble(void);
+extern void	LabelOutFlush(void);
+extern void	LabelOutPoll(void);
+extern int	LabelOutWrite(void *data, const void *buffer, size_t length);
+extern void	LabelOutEnd(int canceled);
+
+#  ifdef __cplusplus
+}
+#  endif /* __cplusplus */
+
+#endif /* !_LABELOUT_H_ */
+
+
+/*
+ * End of "$Id$".
+ */
@@ -0,0 +1,770 @@
+/*
+ * "$Id$"
+ *
+ *   PPD snapshots for the label printer filters.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ *
+ *   The filters only need each option's choices and which one is marked,
+ *   so the PPD file is parsed once into a snapshot of just that, which is
+ *   saved in $CUPS_CACHEDIR and mapped by later jobs.  The snapshot is
+ *   rebuilt when the PPD file changes size or contents; a new modification
+ *   time alone only updates the time saved in the snapshot.
+ *
+ * Contents:
+ *
+ *   LabelPPDOpen()    - Open a PPD snapshot and mark the job's choices.
+ *   LabelPPDMark()    - Mark the defaults and another job's choices.
+ *   LabelPPDCurrent() - Check that a snapshot still matches its PPD file.
+ *   LabelPPDClose()   - Close a PPD snapshot.
+ *   LabelPPDChoice()  - Return the marked choice for an option.
+ *   LabelPPDIsMarked() - Check whether a choice is marked.
+ *   LabelPPDKeyword() - Return the keyword of an option by index.
+ *   LabelPPDModel()   - Return the cupsModelNumber of the PPD file.
+ *   labelppd_build()  - Parse the PPD file and save a new snapshot.
+ *   labelppd_compare() - Compare the keywords of two options for qsort().
+ *   labelppd_find()   - Find an option by keyword.
+ *   labelppd_hash()   - Compute the FNV-1a hash of a file.
+ *   labelppd_load()   - Map a saved snapshot if it is current.
+ *   labelppd_mark()   - Mark a choice given as a job option.
+ *   labelppd_select() - Mark a choice and unmark the options it replaces.
+ *   labelppd_unmark() - Unmark an option.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "labelppd.h"
+#include "labellog.h"
+#include <cups/ppd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+
+/*
+ * Constants...
+ */
+
+#define LABELPPD_VERSION	1	/* Snapshot format version */
+
+#ifdef __APPLE__
+#  define LABELPPD_MTIME(info)	((info)->st_mtimespec.tv_sec * 1000000000LL + \
+				 (info)->st_mtimespec.tv_nsec)
+#else
+#  define LABELPPD_MTIME(info)	((info)->st_mtim.tv_sec * 1000000000LL + \
+				 (info)->st_mtim.tv_nsec)
+#endif /* __APPLE__ */
+
+
+/*
+ * Snapshot layout: the header, the options sorted by keyword, the offset
+ * of each choice name, and the strings...
+ */
+
+typedef struct labelppd_header_s	/**** Snapshot header ****/
+{
+  char			magic[4];	/* "LPPD" */
+  unsigned		version,	/* LABELPPD_VERSION */
+			length;		/* Length of snapshot */
+  int			model_number,	/* cupsModelNumber */
+			num_options,	/* Number of options */
+			num_choices;	/* Number of choices */
+  long long		size,		/* Size of PPD file */
+			mtime;		/* Modification time of PPD file (ns) */
+  unsigned long long	hash;		/* FNV-1a hash of PPD file */
+} labelppd_header_t;
+
+typedef struct labelppd_option_s	/**** Option ****/
+{
+  unsigned		keyword;	/* Offset of keyword */
+  int			defchoice,	/* Index of default choice or -1 */
+			first,		/* Index of first choice */
+			count;		/* Number of choices */
+} labelppd_option_t;
+
+struct labelppd_s			/**** PPD options and marked choices ****/
+{
+  char			*data;		/* Snapshot */
+  size_t		length;		/* Length of snapshot */
+  int			mapped;		/* Is the snapshot a file mapping? */
+  const labelppd_header_t *header;	/* Snapshot header */
+  const labelppd_option_t *options;	/* Options sorted by keyword */
+  const unsigned	*choices;	/* Offset of each choice name */
+  const char		*strings;	/* Keywords and choice names */
+  int			*marked;	/* Marked choice of each option or -1 */
+  char			*filename;	/* PPD file */
+};
+
+
+/*
+ * Local functions...
+ */
+
+static int		labelppd_build(labelppd_t *ppd, const char *filename,
+			               struct stat *info, const char *path);
+static int		labelppd_compare(const void *a, const void *b);
+static int		labelppd_find(labelppd_t *ppd, const char *keyword);
+static unsigned long long labelppd_hash(const char *filename);
+static int		labelppd_load(labelppd_t *ppd, const char *filename,
+			              struct stat *info, const char *path);
+static void		labelppd_mark(labelppd_t *ppd, const char *keyword,
+			              const char *choice);
+static void		labelppd_select(labelppd_t *ppd, int option,
+			                int choice);
+static void		labelppd_unmark(labelppd_t *ppd, const char *keyword);
+
+
+/*
+ * 'LabelPPDOpen()' - Open a PPD snapshot and mark the job's choices.
+ *
+ * Choices are marked as ppdMarkDefaults() and cupsMarkOptions() would for
+ * the options named by PPD keywords, and for "media" names that match a
+ * PageSize, MediaType or InputSlot choice.
+ */
+
+labelppd_t *				/* O - PPD snapshot or NULL */
+LabelPPDOpen(const char    *filename,	/* I - PPD file */
+             int           num_options,	/* I - Number of job options */
+	     cups_option_t *options)	/* I - Job options */
+{
+  labelppd_t		*ppd;		/* PPD snapshot */
+  struct stat		info;		/* PPD file information */
+  struct timespec	start,		/* Time started */
+			end;		/* Time finished */
+  const char		*cachedir,	/* CUPS_CACHEDIR env var */
+			*base,		/* Base name of PPD file */
+			*ptr;		/* Pointer into filename */
+  unsigned		hash = 2166136261U;
+					/* FNV-1a hash of filename */
+  char			path[1024];	/* Snapshot filename */
+  int			built;		/* Was the snapshot just built? */
+
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if (!filename || stat(filename, &info) ||
+      (ppd = calloc(1, sizeof(labelppd_t))) == NULL)
+    return (NULL);
+
+ /*
+  * Snapshots are named for the PPD file and a hash of its full path...
+  */
+
+  if ((cachedir = getenv("CUPS_CACHEDIR")) == NULL)
+    cachedir = "/var/cache/cups";
+
+  for (ptr = filename; *ptr; ptr ++)
+    hash = (hash ^ (*ptr & 255)) * 16777619U;
+
+  if ((base = strrchr(filename, '/')) != NULL)
+    base ++;
+  else
+    base = filename;
+
+  snprintf(path, sizeof(path), "%s/%s-%08x.ppdsnap", cachedir, base, hash);
+
+  if ((built = labelppd_load(ppd, filename, &info, path)) != 0 &&
+      labelppd_build(ppd, filename, &info, path))
+  {
+    free(ppd);
+    return (NULL);
+  }
+
+ /*
+  * Mark the defaults, then the job's choices...
+  */
+
+  if ((ppd->marked = malloc((ppd->header->num_options + 1) *
+                            sizeof(int))) == NULL ||
+      (ppd->filename = strdup(filename)) == NULL)
+  {
+    LabelPPDClose(ppd);
+    return (NULL);
+  }
+
+  LabelPPDMark(ppd, num_options, options);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  LabelLogDebug("%s PPD snapshot \"%s\" in %.3f ms.\n",
+                built ? "Built" : "Loaded", path,
+		(end.tv_sec - start.tv_sec) * 1000.0 +
+		(end.tv_nsec - start.tv_nsec) / 1000000.0);
+
+  return (ppd);
+}
+
+
+/*
+ * 'LabelPPDMark()' - Mark the defaults and another job's choices.
+ */
+
+void
+LabelPPDMark(labelppd_t    *ppd,	/* I - PPD snapshot */
+             int           num_options,	/* I - Number of job options */
+	     cups_option_t *options)	/* I - Job options */
+{
+  int	i;				/* Looping var */
+
+
+  if (!ppd)
+    return;
+
+  for (i = 0; i < ppd->header->num_options; i ++)
+    ppd->marked[i] = ppd->options[i].defchoice;
+
+ /*
+  * ppdMarkDefaults() leaves PageRegion unmarked...
+  */
+
+  labelppd_unmark(ppd, "PageRegion");
+
+  for (i = 0; i < num_options; i ++)
+    labelppd_mark(ppd, options[i].name, options[i].value);
+}
+
+
+/*
+ * 'LabelPPDCurrent()' - Check that a snapshot still matches its PPD file.
+ *
+ * A snapshot kept open across jobs is current when a job names the same
+ * PPD file and that file has the size and time the snapshot was made from.
+ */
+
+int					/* O - 1 if current, 0 otherwise */
+LabelPPDCurrent(labelppd_t *ppd,	/* I - PPD snapshot */
+                const char *filename)	/* I - PPD file for the job */
+{
+  struct stat	info;			/* PPD file information */
+
+
+  return (ppd && filename && !strcmp(ppd->filename, filename) &&
+          !stat(filename, &info) &&
+	  ppd->header->size == (long long)info.st_size &&
+	  ppd->header->mtime == LABELPPD_MTIME(&info));
+}
+
+
+/*
+ * 'LabelPPDClose()' - Close a PPD snapshot.
+ */
+
+void
+LabelPPDClose(labelppd_t *ppd)		/* I - PPD snapshot */
+{
+  if (!ppd)
+    return;
+
+  if (ppd->mapped)
+    munmap(ppd->data, ppd->length);
+  else
+    free(ppd->data);
+
+  free(ppd->marked);
+  free(ppd->filename);
+  free(ppd);
+}
+
+
+/*
+ * 'LabelPPDChoice()' - Return the marked choice for an option.
+ */
+
+const char *				/* O - Choice name or NULL */
+LabelPPDChoice(labelppd_t *ppd,		/* I - PPD snapshot */
+               const char *keyword)	/* I - Option keyword */
+{
+  int	i;				/* Option index */
+
+
+  if ((i = labelppd_find(ppd, keyword)) < 0 || ppd->marked[i] < 0)
+    return (NULL);
+
+  return (ppd->strings + ppd->choices[ppd->marked[i]]);
+}
+
+
+/*
+ * 'LabelPPDIsMarked()' - Check whether a choice is marked.
+ */
+
+int					/* O - 1 if marked, 0 otherwise */
+LabelPPDIsMarked(labelppd_t *ppd,	/* I - PPD snapshot */
+                 const char *keyword,	/* I - Option keyword */
+		 const char *choice)	/* I - Choice name */
+{
+  const char	*marked;		/* Marked choice */
+
+
+  return ((marked = LabelPPDChoice(ppd, keyword)) != NULL &&
+          !strcmp(marked, choice));
+}
+
+
+/*
+ * 'LabelPPDKeyword()' - Return the keyword of an option by index.
+ *
+ * Options are in keyword order.
+ */
+
+const char *				/* O - Keyword or NULL past the end */
+LabelPPDKeyword(labelppd_t *ppd,	/* I - PPD snapshot */
+                int        n)		/* I - Option index */
+{
+  if (!ppd || n < 0 || n >= ppd->header->num_options)
+    return (NULL);
+
+  return (ppd->strings + ppd->options[n].keyword);
+}
+
+
+/*
+ * 'LabelPPDModel()' - Return the cupsModelNumber of the PPD file.
+ */
+
+int					/* O - Model number */
+LabelPPDModel(labelppd_t *ppd)		/* I - PPD snapshot */
+{
+  return (ppd ? ppd->header->model_number : 0);
+}
+
+
+/*
+ * 'labelppd_build()' - Parse the PPD file and save a new snapshot.
+ *
+ * The snapshot is used from memory if it cannot be saved.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+labelppd_build(labelppd_t  *ppd,	/* I - PPD snapshot */
+               const char  *filename,	/* I - PPD file */
+	       struct stat *info,	/* I - PPD file information */
+	       const char  *path)	/* I - Snapshot filename */
+{
+  ppd_file_t		*file;		/* PPD file */
+  ppd_option_t		*option,	/* Current option */
+			**sorted;	/* Options sorted by keyword */
+  labelppd_header_t	*header;	/* Snapshot header */
+  labelppd_option_t	*options;	/* Snapshot options */
+  unsigned		*choices;	/* Snapshot choice names */
+  char			*strings;	/* Snapshot strings */
+  size_t		length,		/* Length of snapshot */
+			used;		/* Bytes of strings used */
+  int			i, j,		/* Looping vars */
+			num_options,	/* Number of options */
+			num_choices,	/* Number of choices */
+			fd;		/* Snapshot file */
+  char			temp[1040];	/* Temporary snapshot filename */
+
+
+  if ((file = ppdOpenFile(filename)) == NULL)
+    return (-1);
+
+ /*
+  * Size the snapshot...
+  */
+
+  for (num_options = 0, num_choices = 0, length = 0,
+           option = ppdFirstOption(file);
+       option;
+       option = ppdNextOption(file))
+  {
+    num_options ++;
+    num_choices += option->num_choices;
+    length      += strlen(option->keyword) + 1;
+
+    for (j = 0; j < option->num_choices; j ++)
+      length += strlen(option->choices[j].choice) + 1;
+  }
+
+  length += sizeof(labelppd_header_t) +
+            num_options * sizeof(labelppd_option_t) +
+            num_choices * sizeof(unsigned);
+
+  if ((ppd->data = calloc(1, length)) == NULL ||
+      (sorted = calloc(num_options + 1, sizeof(ppd_option_t *))) == NULL)
+  {
+    free(ppd->data);
+    ppdClose(file);
+    return (-1);
+  }
+
+  for (i = 0, option = ppdFirstOption(file); option;
+       option = ppdNextOption(file))
+    sorted[i ++] = option;
+
+  qsort(sorted, num_options, sizeof(ppd_option_t *), labelppd_compare);
+
+ /*
+  * Fill it in...
+  */
+
+  header  = (labelppd_header_t *)ppd->data;
+  options = (labelppd_option_t *)(header + 1);
+  choices = (unsigned *)(options + num_options);
+  strings = (char *)(choices + num_choices);
+
+  memcpy(header->magic, "LPPD", 4);
+  header->version      = LABELPPD_VERSION;
+  header->length       = (unsigned)length;
+  header->model_number = file->model_number;
+  header->num_options  = num_options;
+  header->num_choices  = num_choices;
+  header->size         = (long long)info->st_size;
+  header->mtime        = LABELPPD_MTIME(info);
+  header->hash         = labelppd_hash(filename);
+
+  for (i = 0, num_choices = 0, used = 0; i < num_options; i ++)
+  {
+    option = sorted[i];
+
+    options[i].keyword   = (unsigned)used;
+    options[i].defchoice = -1;
+    options[i].first     = num_choices;
+    options[i].count     = option->num_choices;
+
+    strcpy(strings + used, option->keyword);
+    used += strlen(option->keyword) + 1;
+
+    for (j = 0; j < option->num_choices; j ++, num_choices ++)
+    {
+      if (!strcmp(option->choices[j].choice, option->defchoice))
+        options[i].defchoice = num_choices;
+
+      choices[num_choices] = (unsigned)used;
+
+      strcpy(strings + used, option->choices[j].choice);
+      used += strlen(option->choices[j].choice) + 1;
+    }
+  }
+
+  free(sorted);
+  ppdClose(file);
+
+  ppd->length  = length;
+  ppd->header  = header;
+  ppd->options = options;
+  ppd->choices = choices;
+  ppd->strings = strings;
+
+ /*
+  * Save it for the next job; the rename makes it appear all at once...
+  */
+
+  snprintf(temp, sizeof(temp), "%s.XXXXXX", path);
+
+  if ((fd = mkstemp(temp)) < 0)
+  {
+    LabelLogDebug("Unable to save PPD snapshot \"%s\": %s\n", path,
+                  strerror(errno));
+    return (0);
+  }
+
+  fchmod(fd, 0644);
+
+  if (write(fd, ppd->data, length) != (ssize_t)length || close(fd) ||
+      rename(temp, path))
+  {
+    LabelLogDebug("Unable to save PPD snapshot \"%s\": %s\n", path,
+                  strerror(errno));
+    unlink(temp);
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'labelppd_compare()' - Compare the keywords of two options for qsort().
+ */
+
+static int				/* O - Result of comparison */
+labelppd_compare(const void *a,		/* I - First option */
+                 const void *b)		/* I - Second option */
+{
+  return (strcasecmp((*(ppd_option_t * const *)a)->keyword,
+                     (*(ppd_option_t * const *)b)->keyword));
+}
+
+
+/*
+ * 'labelppd_find()' - Find an option by keyword.
+ */
+
+static int				/* O - Option index or -1 */
+labelppd_find(labelppd_t *ppd,		/* I - PPD snapshot */
+              const char *keyword)	/* I - Option keyword */
+{
+  int	left,				/* Left side of search */
+	right,				/* Right side of search */
+	middle,				/* Middle of search */
+	result;				/* Result of comparison */
+
+
+  if (!ppd || !keyword)
+    return (-1);
+
+  for (left = 0, right = ppd->header->num_options - 1; left <= right;)
+  {
+    middle = (left + right) / 2;
+
+    if ((result = strcasecmp(keyword, ppd->strings +
+                                      ppd->options[middle].keyword)) == 0)
+      return (middle);
+    else if (result < 0)
+      right = middle - 1;
+    else
+      left = middle + 1;
+  }
+
+  return (-1);
+}
+
+
+/*
+ * 'labelppd_hash()' - Compute the FNV-1a hash of a file.
+ */
+
+static unsigned long long		/* O - Hash or 0 on error */
+labelppd_hash(const char *filename)	/* I - File to hash */
+{
+  int			fd;		/* File */
+  ssize_t		bytes;		/* Bytes read */
+  unsigned char		buffer[16384],	/* Read buffer */
+			*ptr;		/* Pointer into buffer */
+  unsigned long long	hash = 14695981039346656037ULL;
+					/* FNV-1a hash */
+
+
+  if ((fd = open(filename, O_RDONLY)) < 0)
+    return (0);
+
+  while ((bytes = read(fd, buffer, sizeof(buffer))) > 0)
+    for (ptr = buffer; ptr < buffer + bytes; ptr ++)
+      hash = (hash ^ *ptr) * 1099511628211ULL;
+
+  close(fd);
+
+  return (hash);
+}
+
+
+/*
+ * 'labelppd_load()' - Map a saved snapshot if it is current.
+ */
+
+static int				/* O - 0 if loaded, -1 to rebuild */
+labelppd_load(labelppd_t  *ppd,		/* I - PPD snapshot */
+              const char  *filename,	/* I - PPD file */
+	      struct stat *info,	/* I - PPD file information */
+	      const char  *path)	/* I - Snapshot filename */
+{
+  int			fd,		/* Snapshot file */
+			i;		/* Looping var */
+  struct stat		snapinfo;	/* Snapshot file information */
+  const labelppd_header_t *header;	/* Snapshot header */
+  const labelppd_option_t *option;	/* Current option */
+  size_t		strings;	/* Offset of strings */
+  long long		mtime;		/* Modification time of PPD file */
+
+
+  if ((fd = open(path, O_RDWR)) < 0 && (fd = open(path, O_RDONLY)) < 0)
+    return (-1);
+
+  if (fstat(fd, &snapinfo) ||
+      (size_t)snapinfo.st_size <= sizeof(labelppd_header_t) ||
+      (ppd->data = mmap(NULL, (size_t)snapinfo.st_size, PROT_READ,
+                        MAP_SHARED, fd, 0)) == MAP_FAILED)
+  {
+    close(fd);
+    return (-1);
+  }
+
+  ppd->length = (size_t)snapinfo.st_size;
+  ppd->mapped = 1;
+  header      = (const labelppd_header_t *)ppd->data;
+
+ /*
+  * Check that the snapshot is complete and hangs together...
+  */
+
+  strings = sizeof(labelppd_header_t) +
+            header->num_options * sizeof(labelppd_option_t) +
+	    header->num_choices * sizeof(unsigned);
+
+  if (memcmp(header->magic, "LPPD", 4) ||
+      header->version != LABELPPD_VERSION ||
+      header->length != ppd->length || header->num_options < 0 ||
+      header->num_choices < 0 || strings >= ppd->length ||
+      ppd->data[ppd->length - 1])
+    goto stale;
+
+  ppd->header  = header;
+  ppd->options = (const labelppd_option_t *)(header + 1);
+  ppd->choices = (const unsigned *)(ppd->options + header->num_options);
+  ppd->strings = ppd->data + strings;
+
+  for (i = 0, option = ppd->options; i < header->num_options; i ++, option ++)
+    if (option->keyword >= ppd->length - strings || option->first < 0 ||
+        option->count < 0 ||
+	option->first + option->count > header->num_choices ||
+	option->defchoice >= option->first + option->count ||
+	(option->defchoice < option->first && option->defchoice != -1))
+      goto stale;
+
+  for (i = 0; i < header->num_choices; i ++)
+    if (ppd->choices[i] >= ppd->length - strings)
+      goto stale;
+
+ /*
+  * Rebuild for a PPD file with new contents; a new time alone is saved
+  * so the file is not hashed again...
+  */
+
+  mtime = LABELPPD_MTIME(info);
+
+  if (header->size != (long long)info->st_size)
+    goto stale;
+
+  if (header->mtime != mtime)
+  {
+    if (header->hash != labelppd_hash(filename))
+      goto stale;
+
+    pwrite(fd, &mtime, sizeof(mtime), offsetof(labelppd_header_t, mtime));
+  }
+
+  close(fd);
+
+  return (0);
+
+  stale:
+
+  munmap(ppd->data, ppd->length);
+  close(fd);
+
+  ppd->data   = NULL;
+  ppd->length = 0;
+  ppd->mapped = 0;
+
+  return (-1);
+}
+
+
+/*
+ * 'labelppd_mark()' - Mark a choice given as a job option.
+ */
+
+static void
+labelppd_mark(labelppd_t *ppd,		/* I - PPD snapshot */
+              const char *keyword,	/* I - Option name */
+	      const char *choice)	/* I - Option value */
+{
+  int			i, j;		/* Looping vars */
+  const labelppd_option_t *option;	/* Option */
+  const char		*start,		/* Start of media name */
+			*end;		/* End of media name */
+  static const char * const media[] =	/* Options named by "media" */
+			{ "PageSize", "MediaType", "InputSlot" };
+
+
+  if (!strcasecmp(keyword, "media"))
+  {
+    for (start = choice; *start; start = *end ? end + 1 : end)
+    {
+      if ((end = strchr(start, ',')) == NULL)
+        end = start + strlen(start);
+
+      for (i = 0; i < (int)(sizeof(media) / sizeof(media[0])); i ++)
+      {
+        if ((j = labelppd_find(ppd, media[i])) < 0)
+	  continue;
+
+        option = ppd->options + j;
+
+        for (j = option->first; j < option->first + option->count; j ++)
+	  if (!strncasecmp(ppd->strings + ppd->choices[j], start,
+	                   end - start) &&
+	      !ppd->strings[ppd->choices[j] + (end - start)])
+	  {
+	    labelppd_select(ppd, (int)(option - ppd->options), j);
+	    break;
+	  }
+      }
+    }
+
+    return;
+  }
+
+  if ((i = labelppd_find(ppd, keyword)) < 0)
+    return;
+
+  option = ppd->options + i;
+
+  for (j = option->first; j < option->first + option->count; j ++)
+    if (!strcasecmp(ppd->strings + ppd->choices[j], choice))
+    {
+      labelppd_select(ppd, i, j);
+      break;
+    }
+}
+
+
+/*
+ * 'labelppd_select()' - Mark a choice and unmark the options it replaces.
+ *
+ * As with ppdMarkOption(), PageSize and PageRegion replace each other,
+ * InputSlot replaces ManualFeed, and ManualFeed=True replaces InputSlot.
+ */
+
+static void
+labelppd_select(labelppd_t *ppd,	/* I - PPD snapshot */
+                int        option,	/* I - Option index */
+		int        choice)	/* I - Choice index */
+{
+  const char	*keyword;		/* Option keyword */
+
+
+  ppd->marked[option] = choice;
+  keyword             = ppd->strings + ppd->options[option].keyword;
+
+  if (!strcasecmp(keyword, "PageSize"))
+    labelppd_unmark(ppd, "PageRegion");
+  else if (!strcasecmp(keyword, "PageRegion"))
+    labelppd_unmark(ppd, "PageSize");
+  else if (!strcasecmp(keyword, "InputSlot"))
+    labelppd_unmark(ppd, "ManualFeed");
+  else if (!strcasecmp(keyword, "ManualFeed") &&
+           !strcasecmp(ppd->strings + ppd->choices[choice], "True"))
+    labelppd_unmark(ppd, "InputSlot");
+}
+
+
+/*
+ * 'labelppd_unmark()' - Unmark an option.
+ */
+
+static void
+labelppd_unmark(labelppd_t *ppd,	/* I - PPD snapshot */
+                const char *keyword)	/* I - Option keyword */
+{
+  int	i;				/* Option index */
+
+
+  if ((i = labelppd_find(ppd, keyword)) >= 0)
+    ppd->marked[i] = -1;
+}
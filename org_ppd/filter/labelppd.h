@@ -0,0 +1,59 @@
+/*
+ * "$Id$"
+ *
+ *   PPD snapshots for the label printer filters.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ */
+
+#ifndef _LABELPPD_H_
+#  define _LABELPPD_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include <cups/cups.h>
+
+
+/*
+ * Types...
+ */
+
+typedef struct labelppd_s labelppd_t;	/**** PPD options and marked choices ****/
+
+
+/*
+ * Prototypes...
+ */
+
+#  ifdef __cplusplus
+extern "C" {
+#  endif /* __cplusplus */
+
+extern labelppd_t	*LabelPPDOpen(const char *filename, int num_options,
+			              cups_option_t *options);
+extern void		LabelPPDMark(labelppd_t *ppd, int num_options,
+			             cups_option_t *options);
+extern int		LabelPPDCurrent(labelppd_t *ppd, const char *filename);
+extern void		LabelPPDClose(labelppd_t *ppd);
+extern const char	*LabelPPDChoice(labelppd_t *ppd, const char *keyword);
+extern int		LabelPPDIsMarked(labelppd_t *ppd, const char *keyword,
+			                 const char *choice);
+extern const char	*LabelPPDKeyword(labelppd_t *ppd, int n);
+extern int		LabelPPDModel(labelppd_t *ppd);
+
+#  ifdef __cplusplus
+}
+#  endif /* __cplusplus */
+
+#endif /* !_LABELPPD_H_ */
+
+
+/*
+ * End of "$Id$".
+ */
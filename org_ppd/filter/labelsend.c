@@ -0,0 +1,919 @@
+/*
+ * "$Id$"
+ *
+ *   Raw socket sender for networked label printers.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ *
+ *   Usage:
+ *
+ *     labelsend [-l labels] [-t seconds] [-w bytes] [host[:port] file ...]
+ *
+ *   Each file holds printer data such as the output of rastertolabel and
+ *   is queued for the given printer, which defaults to port 9100.  With no
+ *   files on the command line, "host[:port] file" lines are read from the
+ *   standard input and queued as they arrive.  All printers are driven
+ *   from one event loop: writes never block, a printer that drops its
+ *   connection is reconnected and sent the interrupted label again, and
+ *   ZPL labels are paced by polling ~HS host status between them.
+ *
+ * Contents:
+ *
+ *   main()          - Send queued jobs to their printers.
+ *   ls_add_job()    - Queue a job file for a printer.
+ *   ls_close()      - Close the connection to a printer.
+ *   ls_connect()    - Start connecting to a printer.
+ *   ls_fail()       - Drop a failed connection and schedule a retry.
+ *   ls_find()       - Find or add a printer.
+ *   ls_next()       - Find the end of the next label to send.
+ *   ls_now()        - Return the monotonic time in milliseconds.
+ *   ls_read_jobs()  - Queue job lines read from the standard input.
+ *   ls_service()    - Advance a printer after poll() or a timer.
+ *   ls_status()     - Read and act on a ~HS status reply.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE			/* For memmem() */
+#endif /* !_GNU_SOURCE */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+
+/*
+ * Constants...
+ */
+
+#define LS_PORT		"9100"		/* Default printer port */
+#define LS_WINDOW	65536		/* Default bytes per write */
+#define LS_LABELS	2		/* Default labels queued in printer */
+#define LS_GIVE_UP	300		/* Default seconds to keep retrying */
+#define LS_STATUS_WAIT	5000		/* Milliseconds to wait for ~HS status */
+#define LS_POLL		500		/* Milliseconds between status polls */
+#define LS_RETRY_MIN	1000		/* First reconnect delay in ms */
+#define LS_RETRY_MAX	30000		/* Longest reconnect delay in ms */
+
+#define LS_IDLE		0		/* Not connected */
+#define LS_CONNECT	1		/* Connection in progress */
+#define LS_SEND		2		/* Sending a label */
+#define LS_QUERY	3		/* Sending a ~HS status query */
+#define LS_STATUS	4		/* Waiting for the status reply */
+#define LS_HOLD		5		/* Waiting to poll status again */
+#define LS_RETRY	6		/* Waiting to reconnect */
+
+
+/*
+ * Types...
+ */
+
+typedef struct ls_job_s			/**** Queued job ****/
+{
+  struct ls_job_s *next;		/* Next job for printer */
+  char		*filename;		/* Job file */
+  char		*data;			/* Job data */
+  size_t	length;			/* Length of job data */
+  int		zpl;			/* Non-zero if the job holds ZPL labels */
+} ls_job_t;
+
+typedef struct ls_printer_s		/**** Printer and its queue ****/
+{
+  struct ls_printer_s *next;		/* Next printer */
+  char		*name;			/* "host:port" */
+  struct addrinfo *addrs;		/* Printer addresses */
+  int		fd,			/* Socket or -1 */
+		state,			/* LS_ state */
+		polling,		/* Non-zero to poll status */
+		held,			/* Conditions reported by printer */
+		retry;			/* Next reconnect delay in ms */
+  ls_job_t	*jobs,			/* First queued job */
+		*last;			/* Last queued job */
+  size_t	label,			/* Start of current label */
+		offset,			/* Bytes of current job sent */
+		end,			/* End of current label */
+		query;			/* Bytes of status query sent */
+  char		reply[1024];		/* Status reply */
+  size_t	replylen;		/* Bytes of status reply */
+  long long	wake,			/* Time of next timer event or 0 */
+		failed;			/* Time of first failed connect or 0 */
+  long		bytes,			/* Bytes sent */
+		labels,			/* Labels sent */
+		done,			/* Jobs sent */
+		dropped,		/* Jobs dropped */
+		reconnects;		/* Connections retried */
+} ls_printer_t;
+
+
+/*
+ * Globals...
+ */
+
+static ls_printer_t	*Printers = NULL;
+					/* List of printers */
+static int		Labels = LS_LABELS,
+					/* Most labels queued in printer */
+			GiveUp = LS_GIVE_UP;
+					/* Seconds to keep retrying */
+static size_t		Window = LS_WINDOW;
+					/* Most bytes per write */
+
+
+/*
+ * Local functions...
+ */
+
+static void		ls_add_job(const char *name, const char *filename);
+static void		ls_close(ls_printer_t *p);
+static void		ls_connect(ls_printer_t *p, long long now);
+static void		ls_fail(ls_printer_t *p, long long now,
+			        const char *message);
+static ls_printer_t	*ls_find(const char *name);
+static void		ls_next(ls_printer_t *p);
+static long long	ls_now(void);
+static int		ls_read_jobs(int fd);
+static void		ls_service(ls_printer_t *p, int revents, long long now);
+static void		ls_status(ls_printer_t *p, long long now);
+
+
+/*
+ * 'main()' - Send queued jobs to their printers.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line args */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		i;			/* Looping var */
+  int		opt;			/* Current option */
+  int		input;			/* Standard input or -1 when done */
+  int		count;			/* Number of poll entries */
+  int		timeout;		/* Poll timeout in ms */
+  int		busy;			/* Non-zero while jobs are queued */
+  long long	now;			/* Current time */
+  ls_printer_t	*p;			/* Current printer */
+  ls_printer_t	**polled;		/* Printer for each poll entry */
+  struct pollfd	*pfds;			/* Poll entries */
+  int		status;			/* Exit status */
+
+
+  signal(SIGPIPE, SIG_IGN);
+
+  while ((opt = getopt(argc, argv, "l:t:w:")) != -1)
+    switch (opt)
+    {
+      case 'l' :
+          Labels = atoi(optarg);
+	  break;
+
+      case 't' :
+          GiveUp = atoi(optarg);
+	  break;
+
+      case 'w' :
+          if ((Window = (size_t)atol(optarg)) < 1)
+	    Window = LS_WINDOW;
+	  break;
+
+      default :
+          fputs("Usage: labelsend [-l labels] [-t seconds] [-w bytes] "
+	        "[host[:port] file ...]\n", stderr);
+	  return (1);
+    }
+
+  if ((argc - optind) % 2)
+  {
+    fputs("ERROR: Each printer needs a file.\n", stderr);
+    return (1);
+  }
+
+  for (i = optind; i < argc; i += 2)
+    ls_add_job(argv[i], argv[i + 1]);
+
+  if (optind < argc)
+    input = -1;
+  else
+  {
+    input = 0;
+    fcntl(input, F_SETFL, fcntl(input, F_GETFL) | O_NONBLOCK);
+  }
+
+ /*
+  * Run the event loop until the input is done and every queue is empty...
+  */
+
+  pfds   = NULL;
+  polled = NULL;
+
+  for (;;)
+  {
+    for (count = 1, busy = 0, p = Printers; p; p = p->next)
+    {
+      count ++;
+
+      if (p->jobs)
+        busy = 1;
+    }
+
+    if (input < 0 && !busy)
+      break;
+
+    if ((pfds = realloc(pfds, count * sizeof(struct pollfd))) == NULL ||
+        (polled = realloc(polled, count * sizeof(ls_printer_t *))) == NULL)
+    {
+      fputs("ERROR: Unable to allocate memory.\n", stderr);
+      return (1);
+    }
+
+    now     = ls_now();
+    timeout = -1;
+    count   = 0;
+
+    if (input >= 0)
+    {
+      pfds[count].fd      = input;
+      pfds[count].events  = POLLIN;
+      pfds[count].revents = 0;
+      polled[count]       = NULL;
+      count ++;
+    }
+
+    for (p = Printers; p; p = p->next)
+    {
+      if (p->state == LS_IDLE && p->jobs)
+        ls_connect(p, now);
+
+      if (p->wake && (timeout < 0 || p->wake - now < timeout))
+        timeout = p->wake > now ? (int)(p->wake - now) : 0;
+
+      if (p->fd < 0)
+        continue;
+
+      pfds[count].fd      = p->fd;
+      pfds[count].events  = p->state == LS_STATUS ? POLLIN :
+                            p->state == LS_HOLD ? 0 : POLLOUT;
+      pfds[count].revents = 0;
+      polled[count]       = p;
+      count ++;
+    }
+
+    if (poll(pfds, count, timeout) < 0 && errno != EINTR)
+    {
+      fprintf(stderr, "ERROR: poll failed: %s\n", strerror(errno));
+      return (1);
+    }
+
+    now = ls_now();
+
+    for (i = 0; i < count; i ++)
+      if (!polled[i] && pfds[i].revents)
+      {
+        if (ls_read_jobs(input))
+	  input = -1;
+      }
+      else if (polled[i])
+        ls_service(polled[i], pfds[i].revents, now);
+
+    for (p = Printers; p; p = p->next)
+      if (p->wake && p->wake <= now)
+        ls_service(p, 0, now);
+  }
+
+ /*
+  * Report what was sent...
+  */
+
+  for (status = 0, p = Printers; p; p = p->next)
+  {
+    fprintf(stderr,
+            "INFO: %s: %ld jobs, %ld labels, %ld bytes sent, %ld reconnects.\n",
+            p->name, p->done, p->labels, p->bytes, p->reconnects);
+
+    if (p->dropped)
+      status = 1;
+  }
+
+  free(pfds);
+  free(polled);
+
+  return (status);
+}
+
+
+/*
+ * 'ls_add_job()' - Queue a job file for a printer.
+ */
+
+static void
+ls_add_job(const char *name,		/* I - Printer "host[:port]" */
+           const char *filename)	/* I - Job file */
+{
+  int		fd;			/* Job file */
+  struct stat	info;			/* Job file information */
+  ssize_t	bytes;			/* Bytes read */
+  ls_printer_t	*p;			/* Printer */
+  ls_job_t	*job;			/* New job */
+
+
+  if ((p = ls_find(name)) == NULL)
+    return;
+
+  if ((fd = open(filename, O_RDONLY)) < 0 || fstat(fd, &info))
+  {
+    fprintf(stderr, "ERROR: Unable to open \"%s\": %s\n", filename,
+            strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    return;
+  }
+
+  if ((job = calloc(1, sizeof(ls_job_t))) == NULL ||
+      (job->data = malloc(info.st_size ? info.st_size : 1)) == NULL)
+  {
+    fputs("ERROR: Unable to allocate memory.\n", stderr);
+    free(job);
+    close(fd);
+    return;
+  }
+
+  while (job->length < (size_t)info.st_size &&
+         (bytes = read(fd, job->data + job->length,
+	               info.st_size - job->length)) > 0)
+    job->length += bytes;
+
+  close(fd);
+
+  job->filename = strdup(filename);
+
+ /*
+  * Only ZPL printers answer ~HS, so other jobs are sent without polling
+  * rather than waiting out the status timeout...
+  */
+
+  job->zpl = memmem(job->data, job->length, "^XA", 3) != NULL;
+
+  if (p->last)
+    p->last->next = job;
+  else
+    p->jobs = job;
+
+  p->last = job;
+
+  fprintf(stderr, "DEBUG: Queued \"%s\" (%ld bytes) for %s.\n", filename,
+          (long)job->length, p->name);
+}
+
+
+/*
+ * 'ls_close()' - Close the connection to a printer.
+ */
+
+static void
+ls_close(ls_printer_t *p)		/* I - Printer */
+{
+  if (p->fd >= 0)
+    close(p->fd);
+
+  p->fd    = -1;
+  p->state = LS_IDLE;
+  p->wake  = 0;
+}
+
+
+/*
+ * 'ls_connect()' - Start connecting to a printer.
+ */
+
+static void
+ls_connect(ls_printer_t *p,		/* I - Printer */
+           long long    now)		/* I - Current time */
+{
+  struct addrinfo	*addr;		/* Current address */
+
+
+  for (addr = p->addrs; addr; addr = addr->ai_next)
+  {
+    if ((p->fd = socket(addr->ai_family, addr->ai_socktype,
+                        addr->ai_protocol)) < 0)
+      continue;
+
+    fcntl(p->fd, F_SETFL, fcntl(p->fd, F_GETFL) | O_NONBLOCK);
+
+    if (!connect(p->fd, addr->ai_addr, addr->ai_addrlen) ||
+        errno == EINPROGRESS)
+      break;
+
+    close(p->fd);
+    p->fd = -1;
+  }
+
+  if (p->fd < 0)
+  {
+    ls_fail(p, now, strerror(errno));
+    return;
+  }
+
+  p->state = LS_CONNECT;
+  p->wake  = 0;
+}
+
+
+/*
+ * 'ls_fail()' - Drop a failed connection and schedule a retry.
+ *
+ * The interrupted label is sent again on the next connection, since there
+ * is no telling how much of it the printer got.  Jobs are dropped once the
+ * printer has been unreachable for GiveUp seconds.
+ */
+
+static void
+ls_fail(ls_printer_t *p,		/* I - Printer */
+        long long    now,		/* I - Current time */
+	const char   *message)		/* I - Error message */
+{
+  ls_job_t	*job;			/* Dropped job */
+
+
+  fprintf(stderr, "DEBUG: %s: %s\n", p->name, message);
+
+  ls_close(p);
+
+  p->offset = p->label;
+  p->end    = 0;
+
+  if (!p->failed)
+    p->failed = now;
+  else if (GiveUp > 0 && now - p->failed >= GiveUp * 1000LL)
+  {
+    fprintf(stderr, "ERROR: %s: Printer unreachable, dropping queued jobs.\n",
+            p->name);
+
+    while ((job = p->jobs) != NULL)
+    {
+      p->jobs = job->next;
+      p->dropped ++;
+
+      free(job->filename);
+      free(job->data);
+      free(job);
+    }
+
+    p->last   = NULL;
+    p->label  = 0;
+    p->offset = 0;
+    p->failed = 0;
+    p->retry  = LS_RETRY_MIN;
+    return;
+  }
+
+  fprintf(stderr, "INFO: %s: Retrying in %d seconds.\n", p->name,
+          p->retry / 1000);
+
+  p->state = LS_RETRY;
+  p->wake  = now + p->retry;
+
+  p->reconnects ++;
+
+  if ((p->retry *= 2) > LS_RETRY_MAX)
+    p->retry = LS_RETRY_MAX;
+}
+
+
+/*
+ * 'ls_find()' - Find or add a printer.
+ */
+
+static ls_printer_t *			/* O - Printer or NULL on error */
+ls_find(const char *name)		/* I - Printer "host[:port]" */
+{
+  ls_printer_t		*p;		/* Current printer */
+  char			host[256],	/* Host name */
+			*port;		/* Port number */
+  struct addrinfo	hints;		/* Address lookup hints */
+  int			error;		/* Lookup error */
+
+
+  for (p = Printers; p; p = p->next)
+    if (!strcmp(p->name, name))
+      return (p);
+
+  strncpy(host, name, sizeof(host) - 1);
+  host[sizeof(host) - 1] = '\0';
+
+  if ((port = strrchr(host, ':')) != NULL && !strchr(port + 1, ']'))
+    *port++ = '\0';
+  else
+    port = LS_PORT;
+
+  if (host[0] == '[' && host[strlen(host) - 1] == ']')
+  {
+    host[strlen(host) - 1] = '\0';
+    memmove(host, host + 1, strlen(host));
+  }
+
+  if ((p = calloc(1, sizeof(ls_printer_t))) == NULL)
+  {
+    fputs("ERROR: Unable to allocate memory.\n", stderr);
+    return (NULL);
+  }
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  if ((error = getaddrinfo(host, port, &hints, &(p->addrs))) != 0)
+  {
+    fprintf(stderr, "ERROR: Unable to look up \"%s\": %s\n", name,
+            gai_strerror(error));
+    free(p);
+    return (NULL);
+  }
+
+  p->name    = strdup(name);
+  p->fd      = -1;
+  p->polling = Labels > 0;
+  p->retry   = LS_RETRY_MIN;
+  p->next    = Printers;
+  Printers   = p;
+
+  return (p);
+}
+
+
+/*
+ * 'ls_next()' - Find the end of the next label to send.
+ *
+ * A label ends with "^XZ", or if it is left open, where the commands for
+ * the next label start, so graphics downloaded ahead of the next "^XA" go
+ * with it.  Data without ZPL labels is sent as one piece.
+ */
+
+static void
+ls_next(ls_printer_t *p)		/* I - Printer */
+{
+  ls_job_t	*job = p->jobs;		/* Current job */
+  char		*start,			/* Start of this label */
+		*next,			/* Start of next label */
+		*ptr,			/* End of this label */
+		*end = job->data + job->length;
+					/* End of job */
+
+
+  p->label = p->offset;
+  p->end   = job->length;
+
+  if ((start = memmem(job->data + p->offset, end - job->data - p->offset,
+                      "^XA", 3)) == NULL)
+    return;
+
+  if ((next = memmem(start + 3, end - start - 3, "^XA", 3)) == NULL)
+    next = end;
+
+  if ((ptr = memmem(start, next - start, "^XZ", 3)) != NULL)
+    p->end = ptr + 3 - job->data;
+  else if ((ptr = memmem(start, next - start, "\n~", 2)) != NULL)
+    p->end = ptr + 1 - job->data;
+  else
+    p->end = next - job->data;
+}
+
+
+/*
+ * 'ls_now()' - Return the monotonic time in milliseconds.
+ */
+
+static long long			/* O - Time in milliseconds */
+ls_now(void)
+{
+  struct timespec	now;		/* Current time */
+
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (now.tv_sec * 1000LL + now.tv_nsec / 1000000);
+}
+
+
+/*
+ * 'ls_read_jobs()' - Queue job lines read from the standard input.
+ */
+
+static int				/* O - 1 at end of input, 0 otherwise */
+ls_read_jobs(int fd)			/* I - Input file */
+{
+  ssize_t	bytes;			/* Bytes read */
+  char		*line,			/* Current line */
+		*next,			/* Next line */
+		*filename;		/* Job file */
+  static char	buffer[8192];		/* Input buffer */
+  static size_t	used = 0;		/* Bytes in buffer */
+
+
+  if ((bytes = read(fd, buffer + used, sizeof(buffer) - used - 1)) < 0)
+    return (errno != EAGAIN && errno != EINTR);
+
+  used += bytes;
+  buffer[used] = '\0';
+
+  for (line = buffer; (next = strchr(line, '\n')) != NULL || bytes == 0;
+       line = next)
+  {
+    if (next)
+      *next++ = '\0';
+
+    if ((filename = strpbrk(line, " \t")) != NULL)
+    {
+      *filename++ = '\0';
+      filename   += strspn(filename, " \t");
+
+      if (*filename)
+        ls_add_job(line, filename);
+    }
+    else if (*line)
+      fprintf(stderr, "ERROR: Bad job line \"%s\".\n", line);
+
+    if (!next)
+      break;
+  }
+
+  if (bytes == 0 || used == sizeof(buffer) - 1)
+  {
+    used = 0;
+    return (bytes == 0);
+  }
+
+  used -= line - buffer;
+  memmove(buffer, line, used);
+
+  return (0);
+}
+
+
+/*
+ * 'ls_service()' - Advance a printer after poll() or a timer.
+ */
+
+static void
+ls_service(ls_printer_t *p,		/* I - Printer */
+           int          revents,	/* I - Poll events */
+	   long long    now)		/* I - Current time */
+{
+  ssize_t	bytes;			/* Bytes written */
+  int		error;			/* Connection error */
+  socklen_t	len;			/* Length of error */
+  ls_job_t	*job;			/* Current job */
+
+
+  if (p->wake && p->wake <= now)
+  {
+   /*
+    * Timer...
+    */
+
+    p->wake = 0;
+
+    switch (p->state)
+    {
+      case LS_RETRY :
+          ls_connect(p, now);
+	  return;
+
+      case LS_HOLD :
+          p->state = LS_QUERY;
+	  p->query = 0;
+	  return;
+
+      case LS_STATUS :
+          fprintf(stderr, "DEBUG: %s: No host status from printer, turning "
+	                  "polling off.\n", p->name);
+	  p->polling = 0;
+	  p->state   = LS_SEND;
+	  return;
+    }
+  }
+
+  if (!revents || p->fd < 0)
+    return;
+
+  if (p->state == LS_CONNECT)
+  {
+    len = sizeof(error);
+
+    if (getsockopt(p->fd, SOL_SOCKET, SO_ERROR, &error, &len) || error)
+    {
+      ls_fail(p, now, strerror(error ? error : errno));
+      return;
+    }
+
+    fprintf(stderr, "DEBUG: %s: Connected.\n", p->name);
+
+    p->failed = 0;
+    p->end    = 0;
+    p->state  = p->polling && p->jobs->zpl ? LS_QUERY : LS_SEND;
+    p->query  = 0;
+    return;
+  }
+
+  if (revents & (POLLERR | POLLHUP | POLLNVAL))
+  {
+    ls_fail(p, now, "Connection closed by printer.");
+    return;
+  }
+
+  switch (p->state)
+  {
+    case LS_QUERY :
+        if ((bytes = send(p->fd, "~HS\n" + p->query, 4 - p->query,
+	                  MSG_NOSIGNAL)) < 0)
+	{
+	  if (errno != EAGAIN && errno != EINTR)
+	    ls_fail(p, now, strerror(errno));
+	  return;
+	}
+
+	if ((p->query += bytes) < 4)
+	  return;
+
+        p->state    = LS_STATUS;
+	p->replylen = 0;
+	p->wake     = now + LS_STATUS_WAIT;
+	break;
+
+    case LS_STATUS :
+        ls_status(p, now);
+	break;
+
+    case LS_SEND :
+        job = p->jobs;
+
+        if (!p->end)
+	  ls_next(p);
+
+	if ((bytes = send(p->fd, job->data + p->offset,
+	                  p->end - p->offset > Window ? Window :
+			                                p->end - p->offset,
+			  MSG_NOSIGNAL)) < 0)
+	{
+	  if (errno != EAGAIN && errno != EINTR)
+	    ls_fail(p, now, strerror(errno));
+	  return;
+	}
+
+        p->offset += bytes;
+	p->bytes  += bytes;
+
+	if (p->offset < p->end)
+	  return;
+
+       /*
+        * Finished a label; move on to the next job if this one is done...
+	*/
+
+        p->labels ++;
+	p->end   = 0;
+	p->retry = LS_RETRY_MIN;
+
+	if (p->offset >= job->length)
+	{
+	  fprintf(stderr, "DEBUG: %s: Sent \"%s\".\n", p->name, job->filename);
+
+	  p->done ++;
+	  p->offset = 0;
+	  p->label  = 0;
+
+	  if ((p->jobs = job->next) == NULL)
+	    p->last = NULL;
+
+	  free(job->filename);
+	  free(job->data);
+	  free(job);
+
+	  if (!p->jobs)
+	  {
+	    ls_close(p);
+	    return;
+	  }
+	}
+
+	if (p->polling && p->jobs->zpl)
+	{
+	  p->state = LS_QUERY;
+	  p->query = 0;
+	}
+        break;
+  }
+}
+
+
+/*
+ * 'ls_status()' - Read and act on a ~HS status reply.
+ *
+ * The next label is held while the printer is paused, out of media or
+ * ribbon, or has its head open, and while its receive buffer is full or
+ * holds Labels formats.
+ */
+
+static void
+ls_status(ls_printer_t *p,		/* I - Printer */
+          long long    now)		/* I - Current time */
+{
+  ssize_t	bytes;			/* Bytes read */
+  int		i,			/* Looping var */
+		strings,		/* Number of strings read */
+		held,			/* Conditions that hold the printer */
+		paper_out,		/* Out of media? */
+		paused,			/* Paused? */
+		formats,		/* Formats in receive buffer */
+		buffer_full,		/* Receive buffer full? */
+		head_up,		/* Print head open? */
+		ribbon_out;		/* Out of ribbon? */
+  char		*string1,		/* First string */
+		*string2,		/* Second string */
+		*ptr;			/* Pointer into reply */
+  static const char * const messages[] =
+		{			/* Messages for held conditions */
+		  "Printer is out of media.",
+		  "Printer is paused.",
+		  "Printer head is open.",
+		  "Printer is out of ribbon."
+		};
+
+
+  if ((bytes = recv(p->fd, p->reply + p->replylen,
+                    sizeof(p->reply) - p->replylen - 1, 0)) <= 0)
+  {
+    if (bytes == 0 || (errno != EAGAIN && errno != EINTR))
+      ls_fail(p, now, bytes ? strerror(errno) : "Connection closed by printer.");
+    return;
+  }
+
+  p->replylen += bytes;
+  p->reply[p->replylen] = '\0';
+
+  for (strings = 0, ptr = p->reply; *ptr; ptr ++)
+    if (*ptr == 3)
+      strings ++;
+
+  if (strings < 3 && p->replylen < sizeof(p->reply) - 1)
+    return;
+
+  p->wake = 0;
+
+ /*
+  * String 1 is "aaa,b,c,dddd,eee,f,..." and string 2 is "mmm,n,o,p,..."...
+  */
+
+  if ((string1 = strchr(p->reply, 2)) == NULL ||
+      (string2 = strchr(string1 + 1, 2)) == NULL ||
+      sscanf(string1 + 1, "%*d,%d,%d,%*d,%d,%d", &paper_out, &paused,
+             &formats, &buffer_full) != 4 ||
+      sscanf(string2 + 1, "%*d,%*d,%d,%d", &head_up, &ribbon_out) != 2)
+  {
+    fprintf(stderr, "DEBUG: %s: Bad host status from printer, turning "
+                    "polling off.\n", p->name);
+    p->polling = 0;
+    p->state   = LS_SEND;
+    return;
+  }
+
+  held = (paper_out ? 1 : 0) | (paused ? 2 : 0) | (head_up ? 4 : 0) |
+         (ribbon_out ? 8 : 0);
+
+  for (i = 0; i < 4; i ++)
+    if ((held & ~p->held) & (1 << i))
+      fprintf(stderr, "WARNING: %s: %s\n", p->name, messages[i]);
+
+  if (!held && p->held)
+    fprintf(stderr, "INFO: %s: Printer is ready.\n", p->name);
+
+  p->held = held;
+
+  if (!held && !buffer_full && formats < Labels)
+    p->state = LS_SEND;
+  else
+  {
+    p->state = LS_HOLD;
+    p->wake  = now + LS_POLL;
+  }
+}
+
+
+/*
+ * End of "$Id$".
+ */
@@ -0,0 +1,121 @@
+/*
+ * "$Id$"
+ *
+ *   Thin filter that hands label jobs to a served rastertolabel.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ *
+ *   Usage:
+ *
+ *     labelshim job-id user title copies options [file]
+ *
+ *   Start "rastertolabel -d queue" for a queue and make labelshim its
+ *   filter in place of rastertolabel (the cupsFilter line of the PPD).
+ *   Each job's raster, output, status and back channel files are then
+ *   handed with its arguments and environment to that rastertolabel,
+ *   listening on a socket named for the queue in $LABELD_DIR (default
+ *   /var/run/labeld), which prints the job with the PPD snapshot and
+ *   buffers of the jobs before it.  Page and status messages still go to
+ *   CUPS from the job's own status file, and canceling the job cancels it
+ *   there.  When nothing serves the queue, rastertolabel is run from
+ *   $CUPS_SERVERBIN/filter as usual.
+ *
+ * Contents:
+ *
+ *   main() - Hand a job to the served filter, or run the filter.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "labelbatch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+
+/*
+ * Constants...
+ */
+
+#define LABELSHIM_SERVERBIN	"/usr/lib/cups"
+					/* Default CUPS_SERVERBIN */
+
+
+/*
+ * 'main()' - Hand a job to the served filter, or run the filter.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line args */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		fd;			/* Raster file */
+  int		status;			/* Exit status of job */
+  const char	*dir,			/* LABELD_DIR env var */
+		*printer,		/* PRINTER env var */
+		*serverbin;		/* CUPS_SERVERBIN env var */
+  char		path[1024],		/* Socket filename */
+		filter[1024];		/* Filter to run */
+
+
+  if (argc < 6 || argc > 7)
+  {
+    fprintf(stderr, "Usage: %s job-id user title copies options [file]\n",
+            argv[0]);
+    return (1);
+  }
+
+ /*
+  * Hand the job over; the raster file is opened here so the served filter
+  * needs no access to the spool directory...
+  */
+
+  if ((printer = getenv("PRINTER")) != NULL)
+  {
+    if ((dir = getenv("LABELD_DIR")) == NULL)
+      dir = LABELD_DIR;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, printer);
+
+    fd = argc == 7 ? open(argv[6], O_RDONLY) : 0;
+
+    if (fd >= 0 && LabelBatchSend(path, fd, argv, &status) > 0)
+      return (status);
+
+    if (fd > 0)
+      close(fd);
+
+    fprintf(stderr, "DEBUG: No filter serving \"%s\", running it here.\n",
+            path);
+  }
+
+ /*
+  * Otherwise print the job with the filter itself...
+  */
+
+  if ((serverbin = getenv("CUPS_SERVERBIN")) == NULL)
+    serverbin = LABELSHIM_SERVERBIN;
+
+  snprintf(filter, sizeof(filter), "%s/filter/rastertolabel", serverbin);
+
+  execv(filter, argv);
+
+  fprintf(stderr, "ERROR: Unable to run \"%s\": %s\n", filter,
+          strerror(errno));
+
+  return (1);
+}
+
+
+/*
+ * End of "$Id$".
+ */
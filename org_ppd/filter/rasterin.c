@@ -0,0 +1,668 @@
+/*
+ * "$Id$"
+ *
+ *   Raster input stream for the label printer filters.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ *
+ * Contents:
+ *
+ *   RasterInOpen()       - Open a raster stream for reading.
+ *   RasterInClose()      - Close a raster stream and log the read rate.
+ *   RasterInReadHeader() - Read the next page header.
+ *   RasterInReadLine()   - Read the next line of a page.
+ *   RasterInReadPixels() - Copy the next line of a page.
+ *   rasterin_decode()    - Decode a compressed line.
+ *   rasterin_fill()      - Make bytes available in the input buffer.
+ *   rasterin_header()    - Read and check a page header from the stream.
+ *   rasterin_swap()      - Swap the bytes of 16-bit pixels.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "rasterin.h"
+#include "labellog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+
+/*
+ * Sync words, as read in the byte order of this machine...
+ */
+
+#define RASTERIN_SYNCv1		0x52615374	/* "RaSt" - uncompressed */
+#define RASTERIN_SYNCv2		0x52615332	/* "RaS2" - compressed */
+#define RASTERIN_SYNCv3		0x52615333	/* "RaS3" - uncompressed */
+#define RASTERIN_REVSYNCv1	0x74536152	/* Byte-swapped versions */
+#define RASTERIN_REVSYNCv2	0x32536152
+#define RASTERIN_REVSYNCv3	0x33536152
+
+#define RASTERIN_BUFSIZE	262144	/* Size of stream input buffer */
+
+
+/*
+ * Raster input stream...
+ */
+
+struct raster_in_s			/**** Raster input stream ****/
+{
+  int			fd;		/* File descriptor */
+  cups_raster_t		*cups;		/* libcups stream, if used */
+  unsigned char		*buffer,	/* Input buffer or file mapping */
+			*bufptr,	/* Next byte in buffer */
+			*bufend;	/* End of data in buffer */
+  size_t		bufsize;	/* Size of buffer or mapping */
+  int			mapped,		/* Is the buffer a file mapping? */
+			eof,		/* Has the end of the stream been read? */
+			compressed,	/* Are lines compressed? */
+			swapped;	/* Is the byte order swapped? */
+  cups_page_header2_t	header;		/* Current page header */
+  unsigned		bpp,		/* Bytes per compressed pixel */
+			remaining,	/* Lines left on page */
+			count;		/* Times left to repeat line */
+  int			fill;		/* Byte to clear the end of a line */
+  unsigned char		*line;		/* Decoded line */
+  unsigned		linesize;	/* Size of decoded line */
+  long			rows;		/* Number of lines read */
+  double		seconds;	/* Time spent reading lines */
+};
+
+
+/*
+ * Local functions...
+ */
+
+static const unsigned char	*rasterin_decode(raster_in_t *r);
+static size_t			rasterin_fill(raster_in_t *r, size_t bytes);
+static int			rasterin_header(raster_in_t *r);
+static void			rasterin_swap(unsigned char *line,
+				              unsigned length);
+
+
+/*
+ * 'RasterInOpen()' - Open a raster stream for reading.
+ *
+ * Regular files are mapped into memory; pipes are read through a large
+ * buffer.  With "use_cups" set the stream is read through libcups
+ * instead, which is slower but handles any raster variant it knows.
+ */
+
+raster_in_t *				/* O - Raster stream or NULL */
+RasterInOpen(int fd,			/* I - File descriptor */
+             int use_cups)		/* I - Read with libcups? */
+{
+  raster_in_t	*r;			/* Raster stream */
+  struct stat	fileinfo;		/* File information */
+  off_t		offset;			/* Current file offset */
+  unsigned	sync;			/* Sync word */
+
+
+  if ((r = calloc(1, sizeof(raster_in_t))) == NULL)
+    return (NULL);
+
+  r->fd = fd;
+
+  if (use_cups)
+  {
+    if ((r->cups = cupsRasterOpen(fd, CUPS_RASTER_READ)) == NULL)
+    {
+      free(r);
+      return (NULL);
+    }
+
+    return (r);
+  }
+
+ /*
+  * Map regular files, starting wherever the descriptor is positioned...
+  */
+
+  if (!fstat(fd, &fileinfo) && S_ISREG(fileinfo.st_mode) &&
+      fileinfo.st_size > 0 && (offset = lseek(fd, 0, SEEK_CUR)) >= 0 &&
+      offset < fileinfo.st_size)
+  {
+    r->buffer = mmap(NULL, (size_t)fileinfo.st_size, PROT_READ, MAP_PRIVATE,
+                     fd, 0);
+
+    if (r->buffer != MAP_FAILED)
+    {
+#ifdef MADV_SEQUENTIAL
+      madvise(r->buffer, (size_t)fileinfo.st_size, MADV_SEQUENTIAL);
+#endif /* MADV_SEQUENTIAL */
+
+      r->mapped  = 1;
+      r->eof     = 1;
+      r->bufsize = (size_t)fileinfo.st_size;
+      r->bufptr  = r->buffer + offset;
+      r->bufend  = r->buffer + r->bufsize;
+    }
+    else
+      r->buffer = NULL;
+  }
+
+  if (!r->mapped)
+  {
+    if ((r->buffer = malloc(RASTERIN_BUFSIZE)) == NULL)
+    {
+      free(r);
+      return (NULL);
+    }
+
+    r->bufsize = RASTERIN_BUFSIZE;
+    r->bufptr  = r->buffer;
+    r->bufend  = r->buffer;
+  }
+
+ /*
+  * Check the sync word; an unknown one just means no pages are read...
+  */
+
+  if (rasterin_fill(r, sizeof(sync)) < sizeof(sync))
+    return (r);
+
+  memcpy(&sync, r->bufptr, sizeof(sync));
+  r->bufptr += sizeof(sync);
+
+  switch (sync)
+  {
+    case RASTERIN_REVSYNCv2 :
+        r->swapped = 1;
+	/* Fall through */
+    case RASTERIN_SYNCv2 :
+        r->compressed = 1;
+        break;
+
+    case RASTERIN_REVSYNCv1 :
+    case RASTERIN_REVSYNCv3 :
+        r->swapped = 1;
+	/* Fall through */
+    case RASTERIN_SYNCv1 :
+    case RASTERIN_SYNCv3 :
+        break;
+
+    default :
+        LabelLogDebug("Unknown raster sync word %08X\n", sync);
+	r->eof    = 1;
+	r->bufptr = r->bufend;
+        break;
+  }
+
+  return (r);
+}
+
+
+/*
+ * 'RasterInClose()' - Close a raster stream and log the read rate.
+ */
+
+void
+RasterInClose(raster_in_t *r)		/* I - Raster stream */
+{
+  if (!r)
+    return;
+
+  if (r->rows > 0)
+    LabelLogDebug("Read %ld raster lines in %.3f seconds (%.0f lines/sec) "
+		  "using the %s raster reader.\n", r->rows, r->seconds,
+		  r->seconds > 0.0 ? r->rows / r->seconds : 0.0,
+		  r->cups ? "libcups" : r->mapped ? "mapped" : "streamed");
+
+  if (r->cups)
+    cupsRasterClose(r->cups);
+  else if (r->mapped)
+    munmap(r->buffer, r->bufsize);
+  else
+    free(r->buffer);
+
+  free(r->line);
+  free(r);
+}
+
+
+/*
+ * 'RasterInReadHeader()' - Read the next page header.
+ *
+ * Any lines left on the previous page are skipped.
+ */
+
+unsigned				/* O - 1 on success, 0 at end of stream */
+RasterInReadHeader(
+    raster_in_t         *r,		/* I - Raster stream */
+    cups_page_header2_t *header)	/* O - Page header */
+{
+  if (!r)
+    return (0);
+
+  if (r->cups)
+  {
+    if (!cupsRasterReadHeader2(r->cups, &(r->header)))
+      return (0);
+  }
+  else if (!rasterin_header(r))
+    return (0);
+
+  if (r->linesize < r->header.cupsBytesPerLine)
+  {
+    free(r->line);
+
+    if ((r->line = malloc(r->header.cupsBytesPerLine)) == NULL)
+    {
+      r->linesize = 0;
+      return (0);
+    }
+
+    r->linesize = r->header.cupsBytesPerLine;
+  }
+
+  memcpy(header, &(r->header), sizeof(r->header));
+
+  return (1);
+}
+
+
+/*
+ * 'RasterInReadLine()' - Read the next line of a page.
+ *
+ * The line is returned in place when possible: uncompressed lines point
+ * into the file mapping or input buffer, and repeated compressed lines
+ * are not decoded again.  The pointer is good until the next read.
+ */
+
+const unsigned char *			/* O - Line or NULL at end of page */
+RasterInReadLine(raster_in_t *r)	/* I - Raster stream */
+{
+  const unsigned char	*line;		/* Line to return */
+  unsigned		bytes;		/* Bytes per line */
+  struct timespec	start,		/* Start of read */
+			end;		/* End of read */
+
+
+  if (!r || !r->line || (!r->cups && r->remaining == 0))
+    return (NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  bytes = r->header.cupsBytesPerLine;
+
+  if (r->cups)
+  {
+    if (cupsRasterReadPixels(r->cups, r->line, bytes) < 1)
+      return (NULL);
+
+    line = r->line;
+  }
+  else
+  {
+    r->remaining --;
+
+    if (r->count > 0)
+    {
+      r->count --;
+      line = r->line;
+    }
+    else if (r->compressed)
+    {
+      if ((line = rasterin_decode(r)) == NULL)
+      {
+        r->remaining = 0;
+	return (NULL);
+      }
+    }
+    else if (rasterin_fill(r, bytes) < bytes)
+    {
+      r->remaining = 0;
+      return (NULL);
+    }
+    else
+    {
+      line      = r->bufptr;
+      r->bufptr += bytes;
+
+      if (r->swapped && (r->header.cupsBitsPerColor == 16 ||
+                         r->header.cupsBitsPerPixel == 12 ||
+			 r->header.cupsBitsPerPixel == 16))
+      {
+        memcpy(r->line, line, bytes);
+	rasterin_swap(r->line, bytes);
+	line = r->line;
+      }
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  r->rows ++;
+  r->seconds += (end.tv_sec - start.tv_sec) +
+                0.000000001 * (end.tv_nsec - start.tv_nsec);
+
+  return (line);
+}
+
+
+/*
+ * 'RasterInReadPixels()' - Copy the next line of a page.
+ *
+ * Unlike cupsRasterReadPixels(), each call reads a whole line; "len" is
+ * normally the page's cupsBytesPerLine.
+ */
+
+unsigned				/* O - Bytes copied or 0 at end of page */
+RasterInReadPixels(raster_in_t   *r,	/* I - Raster stream */
+                   unsigned char *p,	/* I - Line buffer */
+		   unsigned      len)	/* I - Size of line buffer */
+{
+  const unsigned char	*line;		/* Line read */
+
+
+  if ((line = RasterInReadLine(r)) == NULL)
+    return (0);
+
+  if (len > r->header.cupsBytesPerLine)
+    len = r->header.cupsBytesPerLine;
+
+  memcpy(p, line, len);
+
+  return (len);
+}
+
+
+/*
+ * 'rasterin_decode()' - Decode a compressed line.
+ *
+ * Each line starts with a repeat count, then runs of literal or repeated
+ * pixels.  Runs are filled with memset() and memcpy() rather than a pixel
+ * at a time, so they are copied with the C library's vector code.
+ */
+
+static const unsigned char *		/* O - Decoded line or NULL on error */
+rasterin_decode(raster_in_t *r)		/* I - Raster stream */
+{
+  const unsigned char	*ptr,		/* Pointer into compressed data */
+			*end;		/* End of compressed data */
+  unsigned char		*out;		/* Pointer into line */
+  size_t		avail;		/* Compressed bytes available */
+  unsigned		left,		/* Bytes left in line */
+			count,		/* Bytes in run */
+			done,		/* Bytes of run filled */
+			bpp;		/* Bytes per pixel */
+  int			byte;		/* Run code */
+
+
+ /*
+  * A compressed line is never more than twice its size plus the repeat
+  * count...
+  */
+
+  left  = r->header.cupsBytesPerLine;
+  bpp   = r->bpp;
+  avail = rasterin_fill(r, 2 * (size_t)left + 1);
+  ptr   = r->bufptr;
+  end   = ptr + avail;
+
+  if (ptr >= end)
+    return (NULL);
+
+  r->count = *ptr++;
+
+  for (out = r->line; left > 0;)
+  {
+    if (ptr >= end)
+      return (NULL);
+
+    byte = *ptr++;
+
+    if (byte == 128)
+    {
+     /*
+      * Clear to the end of the line...
+      */
+
+      memset(out, r->fill, left);
+      out  += left;
+      left = 0;
+    }
+    else if (byte & 128)
+    {
+     /*
+      * Copy literal pixels...
+      */
+
+      if ((count = (unsigned)(257 - byte) * bpp) > left)
+        count = left;
+
+      if ((size_t)(end - ptr) < count)
+        return (NULL);
+
+      memcpy(out, ptr, count);
+      ptr  += count;
+      out  += count;
+      left -= count;
+    }
+    else
+    {
+     /*
+      * Repeat one pixel, doubling the filled part each time for wide
+      * pixels...
+      */
+
+      if ((count = (unsigned)(byte + 1) * bpp) > left)
+        count = left;
+
+      if (count < bpp || (size_t)(end - ptr) < bpp)
+        return (NULL);
+
+      if (bpp == 1)
+        memset(out, *ptr, count);
+      else
+      {
+        memcpy(out, ptr, bpp);
+
+        for (done = bpp; done < count; done += done)
+	  memcpy(out + done, out, done < count - done ? done : count - done);
+      }
+
+      ptr  += bpp;
+      out  += count;
+      left -= count;
+    }
+  }
+
+  r->bufptr = (unsigned char *)ptr;
+
+  if (r->swapped && (r->header.cupsBitsPerColor == 16 ||
+                     r->header.cupsBitsPerPixel == 12 ||
+		     r->header.cupsBitsPerPixel == 16))
+    rasterin_swap(r->line, r->header.cupsBytesPerLine);
+
+  return (r->line);
+}
+
+
+/*
+ * 'rasterin_fill()' - Make bytes available in the input buffer.
+ */
+
+static size_t				/* O - Bytes available */
+rasterin_fill(raster_in_t *r,		/* I - Raster stream */
+              size_t      bytes)	/* I - Bytes wanted */
+{
+  size_t	avail;			/* Bytes available */
+  ssize_t	count;			/* Bytes read */
+  unsigned char	*buffer;		/* New buffer */
+
+
+  avail = (size_t)(r->bufend - r->bufptr);
+
+  if (avail >= bytes || r->eof)
+    return (avail);
+
+ /*
+  * Move what is left to the front, growing the buffer for very long
+  * lines, then read until we have enough...
+  */
+
+  if (bytes > r->bufsize)
+  {
+    if ((buffer = malloc(bytes + RASTERIN_BUFSIZE)) == NULL)
+      return (avail);
+
+    memcpy(buffer, r->bufptr, avail);
+    free(r->buffer);
+
+    r->buffer  = buffer;
+    r->bufsize = bytes + RASTERIN_BUFSIZE;
+  }
+  else if (r->bufptr > r->buffer)
+    memmove(r->buffer, r->bufptr, avail);
+
+  r->bufptr = r->buffer;
+  r->bufend = r->buffer + avail;
+
+  while (avail < bytes)
+  {
+    if ((count = read(r->fd, r->bufend, r->bufsize - avail)) < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+
+      r->eof = 1;
+      break;
+    }
+    else if (count == 0)
+    {
+      r->eof = 1;
+      break;
+    }
+
+    r->bufend += count;
+    avail     += (size_t)count;
+  }
+
+  return (avail);
+}
+
+
+/*
+ * 'rasterin_header()' - Read and check a page header from the stream.
+ */
+
+static int				/* O - 1 on success, 0 on error */
+rasterin_header(raster_in_t *r)		/* I - Raster stream */
+{
+  unsigned	*word;			/* Header word to swap */
+  int		i;			/* Looping var */
+
+
+  while (r->remaining > 0)
+    if (!RasterInReadLine(r))
+      return (0);
+
+  if (rasterin_fill(r, sizeof(r->header)) < sizeof(r->header))
+    return (0);
+
+  memcpy(&(r->header), r->bufptr, sizeof(r->header));
+  r->bufptr += sizeof(r->header);
+
+ /*
+  * Swap the numeric fields from AdvanceDistance through cupsReal...
+  */
+
+  if (r->swapped)
+    for (i = 81, word = &(r->header.AdvanceDistance); i > 0; i --, word ++)
+      *word = ((*word & 0xff) << 24) | ((*word & 0xff00) << 8) |
+              ((*word >> 8) & 0xff00) | (*word >> 24);
+
+  if (r->header.cupsColorOrder == CUPS_ORDER_CHUNKED)
+    r->bpp = (r->header.cupsBitsPerPixel + 7) / 8;
+  else
+    r->bpp = (r->header.cupsBitsPerColor + 7) / 8;
+
+  if (r->bpp == 0)
+    r->bpp = 1;
+
+  if (r->header.cupsBitsPerPixel > 240 || r->header.cupsBitsPerColor > 16 ||
+      r->header.cupsBytesPerLine == 0 || r->header.cupsHeight == 0 ||
+      r->header.cupsBytesPerLine > 0x7fffffff ||
+      (r->header.cupsBytesPerLine % r->bpp))
+    return (0);
+
+ /*
+  * Like libcups, refuse a line length that doesn't match the width...
+  */
+
+  if (r->header.cupsBytesPerLine !=
+          ((unsigned long long)r->header.cupsWidth *
+	   r->header.cupsBitsPerPixel + 7) / 8)
+    return (0);
+
+  r->remaining = r->header.cupsHeight;
+  r->count     = 0;
+
+  if (r->header.cupsColorOrder == CUPS_ORDER_PLANAR &&
+      r->header.cupsNumColors > 1)
+    r->remaining *= r->header.cupsNumColors;
+
+ /*
+  * Additive color spaces have a white background; the gamma-corrected
+  * ones came with CUPS 1.4.5...
+  */
+
+  switch (r->header.cupsColorSpace)
+  {
+    case CUPS_CSPACE_W :
+    case CUPS_CSPACE_RGB :
+    case CUPS_CSPACE_RGBW :
+#if CUPS_VERSION_MAJOR > 1 || (CUPS_VERSION_MAJOR == 1 && \
+    (CUPS_VERSION_MINOR > 4 || (CUPS_VERSION_MINOR == 4 && \
+                                CUPS_VERSION_PATCH >= 5)))
+    case CUPS_CSPACE_SW :
+    case CUPS_CSPACE_SRGB :
+    case CUPS_CSPACE_ADOBERGB :
+#endif /* CUPS 1.4.5 and later */
+        r->fill = 0xff;
+	break;
+
+    default :
+        r->fill = 0x00;
+	break;
+  }
+
+  return (1);
+}
+
+
+/*
+ * 'rasterin_swap()' - Swap the bytes of 16-bit pixels.
+ */
+
+static void
+rasterin_swap(unsigned char *line,	/* I - Line to swap */
+              unsigned      length)	/* I - Length of line */
+{
+  unsigned char	temp;			/* Swapped byte */
+
+
+  for (; length > 1; length -= 2, line += 2)
+  {
+    temp    = line[0];
+    line[0] = line[1];
+    line[1] = temp;
+  }
+}
+
+
+/*
+ * End of "$Id$".
+ */
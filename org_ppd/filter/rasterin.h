@@ -0,0 +1,56 @@
+/*
+ * "$Id$"
+ *
+ *   Raster input stream for the label printer filters.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ */
+
+#ifndef _RASTERIN_H_
+#  define _RASTERIN_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include <cups/raster.h>
+
+
+/*
+ * Types...
+ */
+
+typedef struct raster_in_s raster_in_t;	/**** Raster input stream ****/
+
+
+/*
+ * Prototypes...
+ */
+
+#  ifdef __cplusplus
+extern "C" {
+#  endif /* __cplusplus */
+
+extern raster_in_t		*RasterInOpen(int fd, int use_cups);
+extern void			RasterInClose(raster_in_t *r);
+extern unsigned			RasterInReadHeader(raster_in_t *r,
+				                   cups_page_header2_t *header);
+extern const unsigned char	*RasterInReadLine(raster_in_t *r);
+extern unsigned			RasterInReadPixels(raster_in_t *r,
+				                   unsigned char *p,
+						   unsigned len);
+
+#  ifdef __cplusplus
+}
+#  endif /* __cplusplus */
+
+#endif /* !_RASTERIN_H_ */
+
+
+/*
+ * End of "$Id$".
+ */
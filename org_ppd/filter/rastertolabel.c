@@ -1,1350 +1,3335 @@
-/*
- * "$Id: rastertolabel.c,v 1.5 2009/07/07 20:39:18 pgrenning Exp $"
- *
- *   Label printer filter for the Common UNIX Printing System (CUPS).
- *
- *   Copyright 2007-2008 by Apple Inc.
- *   Copyright 2001-2007 by Easy Software Products.
- *
- *   These coded instructions, statements, and computer programs are the
- *   property of Apple Inc. and are protected by Federal copyright
- *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
- *   which should have been included with this file.  If this file is
- *   file is missing or damaged, see the license at "http://www.cups.org/".
- *
- *   This file is subject to the Apple OS-Developed Software exception.
- *
- * Contents:
- *
- *   Setup()        - Prepare the printer for printing.
- *   StartPage()    - Start a page of graphics.
- *   EndPage()      - Finish a page of graphics.
- *   CancelJob()    - Cancel the current job...
- *   OutputLine()   - Output a line of graphics.
- *   PCLCompress()  - Output a PCL (mode 3) compressed line.
- *   ZPLCompress()  - Output a run-length compression sequence.
- *   main()         - Main entry and processing of driver.
- */
-
-/*
- * Include necessary headers...
- */
-
-#include <cups/cups.h>
-#include <cups/string.h>
-#include <cups/i18n.h>
-#include <cups/raster.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <signal.h>
-
-
-/*
- * This driver filter currently supports Dymo, Intellitech, and Zebra
- * label printers.
- *
- * The Dymo portion of the driver has been tested with the 300, 330,
- * and 330 Turbo label printers; it may also work with other models.
- * The Dymo printers support printing at 136, 203, and 300 DPI.
- *
- * The Intellitech portion of the driver has been tested with the
- * Intellibar 408, 412, and 808 and supports their PCL variant.
- *
- * The Zebra portion of the driver has been tested with the LP-2844,
- * LP-2844Z, QL-320, and QL-420 label printers; it may also work with
- * other models.  The driver supports EPL line mode, EPL page mode,
- * ZPL, and CPCL as defined in Zebra's on-line developer documentation.
- */
-
-/*
- * Model number constants...
- */
-
-#define DYMO_3x0	0		/* Dymo Labelwriter 300/330/330 Turbo */
-
-#define ZEBRA_EPL_LINE	0x10		/* Zebra EPL line mode printers */
-#define ZEBRA_EPL_PAGE	0x11		/* Zebra EPL page mode printers */
-#define ZEBRA_ZPL	0x12		/* Zebra ZPL-based printers */
-#define ZEBRA_CPCL	0x13		/* Zebra CPCL-based printers */
-
-#define INTELLITECH_PCL	0x20		/* Intellitech PCL-based printers */
-
-
-/*
- * Globals...
- */
-
-unsigned char	*Buffer;		/* Output buffer */
-unsigned char	*CompBuffer;		/* Compression buffer */
-unsigned char	*LastBuffer;		/* Last buffer */
-int		LastSet;		/* Number of repeat characters */
-int		ModelNumber,		/* cupsModelNumber attribute */
-		Page,			/* Current page */
-		Feed,			/* Number of lines to skip */
-		Canceled;		/* Non-zero if job is canceled */
-
-
-/*
- * Prototypes...
- */
-
-void	Setup(ppd_file_t *ppd);
-void	StartPage(ppd_file_t *ppd, cups_page_header2_t *header);
-void	EndPage(ppd_file_t *ppd, cups_page_header2_t *header);
-void	CancelJob(int sig);
-void	OutputLine(ppd_file_t *ppd, cups_page_header2_t *header, int y);
-void	PCLCompress(unsigned char *line, int length);
-void	ZPLCompress(char repeat_char, int repeat_count);
-
-
-/*
- * 'Setup()' - Prepare the printer for printing.
- */
-
-void
-Setup(ppd_file_t *ppd)			/* I - PPD file */
-{
-  int		i;			/* Looping var */
-
-
- /*
-  * Get the model number from the PPD file...
-  */
-
-  if (ppd)
-    ModelNumber = ppd->model_number;
-
- /*
-  * Initialize based on the model number...
-  */
-
-  switch (ModelNumber)
-  {
-    case DYMO_3x0 :
-       /*
-	* Clear any remaining data...
-	*/
-
-	for (i = 0; i < 100; i ++)
-	  putchar(0x1b);
-
-       /*
-	* Reset the printer...
-	*/
-
-	fputs("\033@", stdout);
-	break;
-
-    case ZEBRA_EPL_LINE :
-	break;
-
-    case ZEBRA_EPL_PAGE :
-	break;
-
-    case ZEBRA_ZPL :
-        break;
-
-    case ZEBRA_CPCL :
-        break;
-
-    case INTELLITECH_PCL :
-       /*
-	* Send a PCL reset sequence.
-	*/
-
-	putchar(0x1b);
-	putchar('E');
-        break;
-  }
-}
-
-
-/*
- * 'StartPage()' - Start a page of graphics.
- */
-
-void
-StartPage(ppd_file_t         *ppd,	/* I - PPD file */
-          cups_page_header2_t *header)	/* I - Page header */
-{
-  ppd_choice_t	*choice;		/* Marked choice */
-  int		length;			/* Actual label length */
-
-
- /*
-  * Show page device dictionary...
-  */
-
-  fprintf(stderr, "DEBUG: StartPage...\n");
-  fprintf(stderr, "DEBUG: MediaClass = \"%s\"\n", header->MediaClass);
-  fprintf(stderr, "DEBUG: MediaColor = \"%s\"\n", header->MediaColor);
-  fprintf(stderr, "DEBUG: MediaType = \"%s\"\n", header->MediaType);
-  fprintf(stderr, "DEBUG: OutputType = \"%s\"\n", header->OutputType);
-
-  fprintf(stderr, "DEBUG: AdvanceDistance = %d\n", header->AdvanceDistance);
-  fprintf(stderr, "DEBUG: AdvanceMedia = %d\n", header->AdvanceMedia);
-  fprintf(stderr, "DEBUG: Collate = %d\n", header->Collate);
-  fprintf(stderr, "DEBUG: CutMedia = %d\n", header->CutMedia);
-  fprintf(stderr, "DEBUG: Duplex = %d\n", header->Duplex);
-  fprintf(stderr, "DEBUG: HWResolution = [ %d %d ]\n", header->HWResolution[0],
-          header->HWResolution[1]);
-  fprintf(stderr, "DEBUG: ImagingBoundingBox = [ %d %d %d %d ]\n",
-          header->ImagingBoundingBox[0], header->ImagingBoundingBox[1],
-          header->ImagingBoundingBox[2], header->ImagingBoundingBox[3]);
-  fprintf(stderr, "DEBUG: InsertSheet = %d\n", header->InsertSheet);
-  fprintf(stderr, "DEBUG: Jog = %d\n", header->Jog);
-  fprintf(stderr, "DEBUG: LeadingEdge = %d\n", header->LeadingEdge);
-  fprintf(stderr, "DEBUG: Margins = [ %d %d ]\n", header->Margins[0],
-          header->Margins[1]);
-  fprintf(stderr, "DEBUG: ManualFeed = %d\n", header->ManualFeed);
-  fprintf(stderr, "DEBUG: MediaPosition = %d\n", header->MediaPosition);
-  fprintf(stderr, "DEBUG: MediaWeight = %d\n", header->MediaWeight);
-  fprintf(stderr, "DEBUG: MirrorPrint = %d\n", header->MirrorPrint);
-  fprintf(stderr, "DEBUG: NegativePrint = %d\n", header->NegativePrint);
-  fprintf(stderr, "DEBUG: NumCopies = %d\n", header->NumCopies);
-  fprintf(stderr, "DEBUG: Orientation = %d\n", header->Orientation);
-  fprintf(stderr, "DEBUG: OutputFaceUp = %d\n", header->OutputFaceUp);
-  fprintf(stderr, "DEBUG: PageSize = [ %d %d ]\n", header->PageSize[0],
-          header->PageSize[1]);
-  fprintf(stderr, "DEBUG: Separations = %d\n", header->Separations);
-  fprintf(stderr, "DEBUG: TraySwitch = %d\n", header->TraySwitch);
-  fprintf(stderr, "DEBUG: Tumble = %d\n", header->Tumble);
-  fprintf(stderr, "DEBUG: cupsWidth = %d\n", header->cupsWidth);
-  fprintf(stderr, "DEBUG: cupsHeight = %d\n", header->cupsHeight);
-  fprintf(stderr, "DEBUG: cupsMediaType = %d\n", header->cupsMediaType);
-  fprintf(stderr, "DEBUG: cupsBitsPerColor = %d\n", header->cupsBitsPerColor);
-  fprintf(stderr, "DEBUG: cupsBitsPerPixel = %d\n", header->cupsBitsPerPixel);
-  fprintf(stderr, "DEBUG: cupsBytesPerLine = %d\n", header->cupsBytesPerLine);
-  fprintf(stderr, "DEBUG: cupsColorOrder = %d\n", header->cupsColorOrder);
-  fprintf(stderr, "DEBUG: cupsColorSpace = %d\n", header->cupsColorSpace);
-  fprintf(stderr, "DEBUG: cupsCompression = %d\n", header->cupsCompression);
-  fprintf(stderr, "DEBUG: cupsRowCount = %d\n", header->cupsRowCount);
-  fprintf(stderr, "DEBUG: cupsRowFeed = %d\n", header->cupsRowFeed);
-  fprintf(stderr, "DEBUG: cupsRowStep = %d\n", header->cupsRowStep);
-
-  switch (ModelNumber)
-  {
-    case DYMO_3x0 :
-       /*
-	* Setup printer/job attributes...
-	*/
-
-	length = header->PageSize[1] * header->HWResolution[1] / 72;
-
-	printf("\033L%c%c", length >> 8, length);
-	printf("\033D%c", header->cupsBytesPerLine);
-
-	printf("\033%c", header->cupsCompression + 'c'); /* Darkness */
-	break;
-
-    case ZEBRA_EPL_LINE :
-       /*
-        * Set print rate...
-	*/
-
-	if ((choice = ppdFindMarkedChoice(ppd, "zePrintRate")) != NULL &&
-	    strcmp(choice->choice, "Default"))
-	  printf("\033S%.0f", atof(choice->choice) * 2.0 - 2.0);
-
-       /*
-        * Set darkness...
-
-	*/
-
-
-        if (header->cupsCompression > 0 && header->cupsCompression <= 100)
-	  printf("\033D%d", 7 * header->cupsCompression / 100);
-
-       /*
-        * Set left margin to 0...
-	*/
-
-	fputs("\033M01", stdout);
-
-       /*
-        * Start buffered output...
-	*/
-
-        fputs("\033B", stdout);
-        break;
-
-    case ZEBRA_EPL_PAGE :
-       /*
-        * Start a new label...
-	*/
-
-        puts("");
-	puts("N");
-
-       /*
-        * Set hardware options...
-	*/
-
-	if (!strcmp(header->MediaType, "Direct"))
-	  puts("OD");
-
-       /*
-        * Set print rate...
-	*/
-
-	if ((choice = ppdFindMarkedChoice(ppd, "zePrintRate")) != NULL &&
-	    strcmp(choice->choice, "Default"))
-	{
-	  float val = atof(choice->choice);
-
-	  if (val >= 3.0)
-	    printf("S%.0f\n", val);
-	  else
-	    printf("S%.0f\n", val * 2.0 - 2.0);
-        }
-
-       /*
-        * Set darkness...
-	*/
-
-        if (header->cupsCompression > 0 && header->cupsCompression <= 100)
-	  printf("D%d\n", 15 * header->cupsCompression / 100);
-
-       /*
-        * Set label size...
-	*/
-
-        printf("q%d\n", (header->cupsWidth + 7) & ~7);
-        break;
-
-    case ZEBRA_ZPL :
-       /*
-        * Set darkness...
-	*/
-
-        if (header->cupsCompression > 0 && header->cupsCompression <= 100)
-	  printf("~SD%02d\n", 30 * header->cupsCompression / 100);
-
-       /*
-        * Start bitmap graphics...
-	*/
-
-        printf("~DGR:CUPS.GRF,%d,%d,\n",
-	       header->cupsHeight * header->cupsBytesPerLine,
-	       header->cupsBytesPerLine);
-
-       /*
-        * Allocate compression buffers...
-	*/
-
-	CompBuffer = malloc(2 * header->cupsBytesPerLine + 1);
-	LastBuffer = malloc(header->cupsBytesPerLine);
-	LastSet    = 0;
-        break;
-
-    case ZEBRA_CPCL :
-       /*
-        * Start label...
-	*/
-
-        printf("! 0 %u %u %u %u\r\n", header->HWResolution[0],
-	       header->HWResolution[1], header->cupsHeight,
-	       header->NumCopies);
-	printf("PAGE-WIDTH %d\r\n", header->cupsWidth);
-	printf("PAGE-HEIGHT %d\r\n", header->cupsWidth);
-        break;
-
-    case INTELLITECH_PCL :
-       /*
-        * Set the media size...
-	*/
-
-	printf("\033&l6D\033&k12H");	/* Set 6 LPI, 10 CPI */
-	printf("\033&l0O");		/* Set portrait orientation */
-
-	switch (header->PageSize[1])
-	{
-	  case 540 : /* Monarch Envelope */
-              printf("\033&l80A");	/* Set page size */
-	      break;
-
-	  case 624 : /* DL Envelope */
-              printf("\033&l90A");	/* Set page size */
-	      break;
-
-	  case 649 : /* C5 Envelope */
-              printf("\033&l91A");	/* Set page size */
-	      break;
-
-	  case 684 : /* COM-10 Envelope */
-              printf("\033&l81A");	/* Set page size */
-	      break;
-
-	  case 756 : /* Executive */
-              printf("\033&l1A");	/* Set page size */
-	      break;
-
-	  case 792 : /* Letter */
-              printf("\033&l2A");	/* Set page size */
-	      break;
-
-	  case 842 : /* A4 */
-              printf("\033&l26A");	/* Set page size */
-	      break;
-
-	  case 1008 : /* Legal */
-              printf("\033&l3A");	/* Set page size */
-	      break;
-
-          default : /* Custom size */
-	      printf("\033!f%dZ", header->PageSize[1] * 300 / 72);
-	      break;
-	}
-
-	printf("\033&l%dP",		/* Set page length */
-               header->PageSize[1] / 12);
-	printf("\033&l0E");		/* Set top margin to 0 */
-        printf("\033&l%dX", header->NumCopies);
-					/* Set number copies */
-        printf("\033&l0L");		/* Turn off perforation skip */
-
-       /*
-        * Print settings...
-	*/
-
-	if (Page == 1)
-	{
-          if (header->cupsRowFeed)	/* inPrintRate */
-	    printf("\033!p%dS", header->cupsRowFeed);
-
-          if (header->cupsCompression != ~0)
-	  				/* inPrintDensity */
-	    printf("\033&d%dA", 30 * header->cupsCompression / 100 - 15);
-
-	  if ((choice = ppdFindMarkedChoice(ppd, "inPrintMode")) != NULL)
-	  {
-	    if (!strcmp(choice->choice, "Standard"))
-	      fputs("\033!p0M", stdout);
-	    else if (!strcmp(choice->choice, "Tear"))
-	    {
-	      fputs("\033!p1M", stdout);
-
-              if (header->cupsRowCount)	/* inTearInterval */
-		printf("\033!n%dT", header->cupsRowCount);
-            }
-	    else
-	    {
-	      fputs("\033!p2M", stdout);
-
-              if (header->cupsRowStep)	/* inCutInterval */
-		printf("\033!n%dC", header->cupsRowStep);
-            }
-	  }
-        }
-
-       /*
-	* Setup graphics...
-	*/
-
-	printf("\033*t%dR", header->HWResolution[0]);
-					/* Set resolution */
-
-	printf("\033*r%dS", header->cupsWidth);
-					/* Set width */
-	printf("\033*r%dT", header->cupsHeight);
-					/* Set height */
-
-	printf("\033&a0H");		/* Set horizontal position */
-	printf("\033&a0V");		/* Set vertical position */
-        printf("\033*r1A");		/* Start graphics */
-        printf("\033*b3M");		/* Set compression */
-
-       /*
-        * Allocate compression buffers...
-	*/
-
-	CompBuffer = malloc(2 * header->cupsBytesPerLine + 1);
-	LastBuffer = malloc(header->cupsBytesPerLine);
-	LastSet    = 0;
-        break;
-  }
-
- /*
-  * Allocate memory for a line of graphics...
-  */
-
-  Buffer = malloc(header->cupsBytesPerLine);
-  Feed   = 0;
-}
-
-
-/*
- * 'EndPage()' - Finish a page of graphics.
- */
-
-void
-EndPage(ppd_file_t *ppd,		/* I - PPD file */
-        cups_page_header2_t *header)	/* I - Page header */
-{
-  int		val;			/* Option value */
-  ppd_choice_t	*choice;		/* Marked choice */
-  ppd_choice_t	*PrintMode;		/* Marked choice */
-
-
-  switch (ModelNumber)
-  {
-    case DYMO_3x0 :
-       /*
-	* Eject the current page...
-	*/
-
-	fputs("\033E", stdout);
-	break;
-
-    case ZEBRA_EPL_LINE :
-       /*
-        * End buffered output, eject the label...
-	*/
-
-        fputs("\033E\014", stdout);
-	break;
-
-    case ZEBRA_EPL_PAGE :
-       /*
-        * Print the label...
-	*/
-
-        puts("P1");
-	break;
-
-    case ZEBRA_ZPL :
-        if (Canceled)
-	{
-	 /*
-	  * Cancel bitmap download...
-	  */
-
-	  puts("~DN");
-	  break;
-	}
-
-       /*
-        * Start label...
-	*/
-
-        puts("^XA");
-
-       /*
-        * Set print rate...
-	*/
-
-	if ((choice = ppdFindMarkedChoice(ppd, "zePrintRate")) != NULL &&
-	    strcmp(choice->choice, "Default"))
-	{
-	  val = atoi(choice->choice);
-	  printf("^PR%d,%d,%d\n", val, val, val);
-	}
-
-       /*
-        * Put label home in default position (0,0)...
-        */
-
-	printf("^LH0,0\n");
-
-       /*
-        * Set media tracking...
-	*/
-
-	if (ppdIsMarked(ppd, "zeMediaTracking", "Continuous"))
-	{
-         /*
-	  * Add label length command for continuous...
-	  */
-
-	  printf("^LL%d\n", header->cupsHeight);
-	  printf("^MNN\n");
-	}
-	else if (ppdIsMarked(ppd, "zeMediaTracking", "Web"))
-          printf("^MNY\n");
-	else if (ppdIsMarked(ppd, "zeMediaTracking", "Mark"))
-	  printf("^MNM\n");
-	else if (ppdIsMarked(ppd, "zeMediaTracking", "VariableLength"))
-	{
-		printf("^MNV\n");
-		printf("^LL10\n");
-	}
-	 
-       /*
-        * Set label top
-	*/
-
-	if (header->cupsRowStep != 200)
-	  printf("^LT%u\n", header->cupsRowStep);
-
-       /*
-        * Set media type...
-	*/
-
-	if (!strcmp(header->MediaType, "Thermal"))
-	  printf("^MTT\n");
-	else if (!strcmp(header->MediaType, "Direct"))
-	  printf("^MTD\n");
-
-       /*
-        * Set print mode...
-	*/
-
-	if ((PrintMode = ppdFindMarkedChoice(ppd, "zePrintMode")) != NULL &&
-	    strcmp(PrintMode->choice, "Saved"))
-	{
-	  printf("^MM");
-
-	  if (!strcmp(PrintMode->choice, "Tear"))
-	    printf("T,Y\n");
-	  else if (!strcmp(PrintMode->choice, "Peel"))
-	    printf("P,Y\n");
-	  else if (!strcmp(PrintMode->choice, "Rewind"))
-	    printf("R,Y\n");
-	  else if (!strcmp(PrintMode->choice, "Applicator"))
-	    printf("A,Y\n");
-	  else if (!strcmp(PrintMode->choice, "Kiosk"))
-	    printf("K,Y\n");
-	  else
-	    printf("C,Y\n");
-	}
-
-	
-	if (!strcmp(PrintMode->choice, "Kiosk")) {
-		/*
-		* Set Kiosk Values...
-		*/
-		int loop_length = 0; /* Holds the Sum of zePresenterLoopLength and zePresenterLoopLengthTens */      
-		printf("^KV");
-		if ((choice = ppdFindMarkedChoice(ppd, "zeCutAmount")) != NULL)
-		{
-			printf("%s", choice->choice);
-		} else {
-			printf("0");
-		}
-		if ((choice = ppdFindMarkedChoice(ppd, "zeCutMargin")) != NULL)
-		{
-			printf(",%s", choice->choice);
-		} else {
-			printf(",9");
-		}
-		if ((choice = ppdFindMarkedChoice(ppd, "zePresentType")) != NULL)
-		{
-			printf(",%s", choice->choice);
-		} else {
-			printf(",0");
-		}
-		if ((choice = ppdFindMarkedChoice(ppd, "zePresentTimeout")) != NULL)
-		{
-			printf(",%s", choice->choice);
-		} else {
-			printf(",0");
-		}
-		if ((choice = ppdFindMarkedChoice(ppd, "zePresenterLoopLength")) != NULL)
-		{
-			loop_length = atoi(choice->choice);
-		} else {
-			loop_length = 400;
-		}
-		if ((choice = ppdFindMarkedChoice(ppd, "zePresenterLoopLengthTens")) != NULL)
-		{
-			loop_length = loop_length + atoi(choice->choice);	
-			if(loop_length < 3)
-			{
-				loop_length = 0;
-			}	
-		} 
-		printf(",%d", loop_length); /* Sets the Presenter Loop Length */
-	}
-       /*
-        * Set tear-off adjust position...
-	*/
-
-	if (header->AdvanceDistance != 1000)
-	{
-	  if ((int)header->AdvanceDistance < 0)
-	    printf("~TA%04d\n", (int)header->AdvanceDistance);
-	  else
-	    printf("~TA%03d\n", (int)header->AdvanceDistance);
-	}
-
-       /*
-        * Allow for reprinting after an error...
-	*/
-
-	if (ppdIsMarked(ppd, "zeErrorReprint", "Always"))
-	  printf("^JZY\n");
-	else if (ppdIsMarked(ppd, "zeErrorReprint", "Never"))
-	  printf("^JZN\n");
-
-       /*
-        * Print multiple copies
-	*/
-
-	if (header->NumCopies > 1)
-	  printf("^PQ%d, 0, 0, N\n", header->NumCopies);
-
-       /*
-        * Display the label image...
-	*/
-
-	puts("^FO0,0^XGR:CUPS.GRF,1,1^FS");
-
-       /*
-        * End the label and eject...
-	*/
-
-        puts("^IDR:CUPS.GRF^FS");
-	
-	if (!strcmp(PrintMode->choice, "Kiosk")) 
-	{
-		puts("^XZ^XA^CN0^PN1^XZ");
-	}
-
-       /*
-        * Free compression buffers...
-	*/
-
-	free(CompBuffer);
-	free(LastBuffer);
-        break;
-
-    case ZEBRA_CPCL :
-       /*
-        * Set tear-off adjust position...
-	*/
-
-	if (header->AdvanceDistance != 1000)
-          printf("PRESENT-AT %d 1\r\n", (int)header->AdvanceDistance);
-
-       /*
-        * Allow for reprinting after an error...
-	*/
-
-	if (ppdIsMarked(ppd, "zeErrorReprint", "Always"))
-	  puts("ON-OUT-OF-PAPER WAIT\r");
-	else if (ppdIsMarked(ppd, "zeErrorReprint", "Never"))
-	  puts("ON-OUT-OF-PAPER PURGE\r");
-
-       /*
-        * Cut label?
-	*/
-
-	if (header->CutMedia)
-	  puts("CUT\r");
-
-       /*
-        * Set darkness...
-	*/
-
-	if (header->cupsCompression > 0)
-	  printf("TONE %u\r\n", 2 * header->cupsCompression);
-
-       /*
-        * Set print rate...
-	*/
-
-	if ((choice = ppdFindMarkedChoice(ppd, "zePrintRate")) != NULL &&
-	    strcmp(choice->choice, "Default"))
-	{
-	  val = atoi(choice->choice);
-	  printf("SPEED %d\r\n", val);
-	}
-
-       /*
-        * Print the label...
-	*/
-
-	if ((choice = ppdFindMarkedChoice(ppd, "zeMediaTracking")) == NULL ||
-	    strcmp(choice->choice, "Continuous"))
-          puts("FORM\r");
-
-	puts("PRINT\r");
-	break;
-
-    case INTELLITECH_PCL :
-        printf("\033*rB");		/* End GFX */
-        printf("\014");			/* Eject current page */
-        break;
-  }
-
-  fflush(stdout);
-
- /*
-  * Free memory...
-  */
-
-  free(Buffer);
-}
-
-
-/*
- * 'CancelJob()' - Cancel the current job...
- */
-
-void
-CancelJob(int sig)			/* I - Signal */
-{
- /*
-  * Tell the main loop to stop...
-  */
-
-  (void)sig;
-
-  Canceled = 1;
-}
-
-
-/*
- * 'OutputLine()' - Output a line of graphics...
- */
-
-void
-OutputLine(ppd_file_t         *ppd,	/* I - PPD file */
-           cups_page_header2_t *header,	/* I - Page header */
-           int                y)	/* I - Line number */
-{
-  int		i;			/* Looping var */
-  unsigned char	*ptr;			/* Pointer into buffer */
-  unsigned char	*compptr;		/* Pointer into compression buffer */
-  char		repeat_char;		/* Repeated character */
-  int		repeat_count;		/* Number of repeated characters */
-  static const char *hex = "0123456789ABCDEF";
-					/* Hex digits */
-
-
-  switch (ModelNumber)
-  {
-    case DYMO_3x0 :
-       /*
-	* See if the line is blank; if not, write it to the printer...
-	*/
-
-	if (Buffer[0] ||
-            memcmp(Buffer, Buffer + 1, header->cupsBytesPerLine - 1))
-	{
-          if (Feed)
-	  {
-	    while (Feed > 255)
-	    {
-	      printf("\033f\001%c", 255);
-	      Feed -= 255;
-	    }
-
-	    printf("\033f\001%c", Feed);
-	    Feed = 0;
-          }
-
-          putchar(0x16);
-	  fwrite(Buffer, header->cupsBytesPerLine, 1, stdout);
-	  fflush(stdout);
-
-#ifdef __sgi
-	 /*
-          * This hack works around a bug in the IRIX serial port driver when
-	  * run at high baud rates (e.g. 115200 baud)...  This results in
-	  * slightly slower label printing, but at least the labels come
-	  * out properly.
-	  */
-
-	  sginap(1);
-#endif /* __sgi */
-	}
-	else
-          Feed ++;
-	break;
-
-    case ZEBRA_EPL_LINE :
-        printf("\033g%03d", header->cupsBytesPerLine);
-	fwrite(Buffer, 1, header->cupsBytesPerLine, stdout);
-	fflush(stdout);
-        break;
-
-    case ZEBRA_EPL_PAGE :
-        if (Buffer[0] || memcmp(Buffer, Buffer + 1, header->cupsBytesPerLine))
-	{
-          printf("GW0,%d,%d,1\n", y, header->cupsBytesPerLine);
-	  for (i = header->cupsBytesPerLine, ptr = Buffer; i > 0; i --, ptr ++)
-	    putchar(~*ptr);
-	  putchar('\n');
-	  fflush(stdout);
-	}
-        break;
-
-    case ZEBRA_ZPL :
-       /*
-	* Determine if this row is the same as the previous line.
-        * If so, output a ':' and return...
-        */
-
-        if (LastSet)
-	{
-	  if (!memcmp(Buffer, LastBuffer, header->cupsBytesPerLine))
-	  {
-	    putchar(':');
-	    return;
-	  }
-	}
-
-       /*
-        * Convert the line to hex digits...
-	*/
-
-	for (ptr = Buffer, compptr = CompBuffer, i = header->cupsBytesPerLine;
-	     i > 0;
-	     i --, ptr ++)
-        {
-	  *compptr++ = hex[*ptr >> 4];
-	  *compptr++ = hex[*ptr & 15];
-	}
-
-        *compptr = '\0';
-
-       /*
-        * Run-length compress the graphics...
-	*/
-
-	for (compptr = CompBuffer + 1, repeat_char = CompBuffer[0], repeat_count = 1;
-	     *compptr;
-	     compptr ++)
-	  if (*compptr == repeat_char)
-	    repeat_count ++;
-	  else
-	  {
-	    ZPLCompress(repeat_char, repeat_count);
-	    repeat_char  = *compptr;
-	    repeat_count = 1;
-	  }
-
-        if (repeat_char == '0')
-	{
-	 /*
-	  * Handle 0's on the end of the line...
-	  */
-
-	  if (repeat_count & 1)
-	  {
-	    repeat_count --;
-	    putchar('0');
-	  }
-
-          if (repeat_count > 0)
-	    putchar(',');
-	}
-	else
-	  ZPLCompress(repeat_char, repeat_count);
-
-	fflush(stdout);
-
-       /*
-        * Save this line for the next round...
-	*/
-
-	memcpy(LastBuffer, Buffer, header->cupsBytesPerLine);
-	LastSet = 1;
-        break;
-
-    case ZEBRA_CPCL :
-        if (Buffer[0] || memcmp(Buffer, Buffer + 1, header->cupsBytesPerLine))
-	{
-	  printf("CG %u 1 0 %d ", header->cupsBytesPerLine, y);
-          fwrite(Buffer, 1, header->cupsBytesPerLine, stdout);
-	  puts("\r");
-	  fflush(stdout);
-	}
-	break;
-
-    case INTELLITECH_PCL :
-	if (Buffer[0] ||
-            memcmp(Buffer, Buffer + 1, header->cupsBytesPerLine - 1))
-        {
-	  if (Feed)
-	  {
-	    printf("\033*b%dY", Feed);
-	    Feed    = 0;
-	    LastSet = 0;
-	  }
-
-          PCLCompress(Buffer, header->cupsBytesPerLine);
-	}
-	else
-	  Feed ++;
-        break;
-  }
-}
-
-
-/*
- * 'PCLCompress()' - Output a PCL (mode 3) compressed line.
- */
-
-void
-PCLCompress(unsigned char *line,	/* I - Line to compress */
-            int           length)	/* I - Length of line */
-{
-  unsigned char	*line_ptr,		/* Current byte pointer */
-        	*line_end,		/* End-of-line byte pointer */
-        	*comp_ptr,		/* Pointer into compression buffer */
-        	*start,			/* Start of compression sequence */
-		*seed;			/* Seed buffer pointer */
-  int           count,			/* Count of bytes for output */
-		offset;			/* Offset of bytes for output */
-
-
- /*
-  * Do delta-row compression...
-  */
-
-  line_ptr = line;
-  line_end = line + length;
-
-  comp_ptr = CompBuffer;
-  seed     = LastBuffer;
-
-  while (line_ptr < line_end)
-  {
-   /*
-    * Find the next non-matching sequence...
-    */
-
-    start = line_ptr;
-
-    if (!LastSet)
-    {
-     /*
-      * The seed buffer is invalid, so do the next 8 bytes, max...
-      */
-
-      offset = 0;
-
-      if ((count = line_end - line_ptr) > 8)
-	count = 8;
-
-      line_ptr += count;
-    }
-    else
-    {
-     /*
-      * The seed buffer is valid, so compare against it...
-      */
-
-      while (*line_ptr == *seed &&
-             line_ptr < line_end)
-      {
-        line_ptr ++;
-        seed ++;
-      }
-
-      if (line_ptr == line_end)
-        break;
-
-      offset = line_ptr - start;
-
-     /*
-      * Find up to 8 non-matching bytes...
-      */
-
-      start = line_ptr;
-      count = 0;
-      while (*line_ptr != *seed &&
-             line_ptr < line_end &&
-             count < 8)
-      {
-        line_ptr ++;
-        seed ++;
-        count ++;
-      }
-    }
-
-   /*
-    * Place mode 3 compression data in the buffer; see HP manuals
-    * for details...
-    */
-
-    if (offset >= 31)
-    {
-     /*
-      * Output multi-byte offset...
-      */
-
-      *comp_ptr++ = ((count - 1) << 5) | 31;
-
-      offset -= 31;
-      while (offset >= 255)
-      {
-        *comp_ptr++ = 255;
-        offset    -= 255;
-      }
-
-      *comp_ptr++ = offset;
-    }
-    else
-    {
-     /*
-      * Output single-byte offset...
-      */
-
-      *comp_ptr++ = ((count - 1) << 5) | offset;
-    }
-
-    memcpy(comp_ptr, start, count);
-    comp_ptr += count;
-  }
-
- /*
-  * Set the length of the data and write it...
-  */
-
-  printf("\033*b%dW", (int)(comp_ptr - CompBuffer));
-  fwrite(CompBuffer, comp_ptr - CompBuffer, 1, stdout);
-
- /*
-  * Save this line as a "seed" buffer for the next...
-  */
-
-  memcpy(LastBuffer, line, length);
-  LastSet = 1;
-}
-
-
-/*
- * 'ZPLCompress()' - Output a run-length compression sequence.
- */
-
-void
-ZPLCompress(char repeat_char,		/* I - Character to repeat */
-	    int  repeat_count)		/* I - Number of repeated characters */
-{
-  if (repeat_count > 1)
-  {
-   /*
-    * Print as many z's as possible - they are the largest denomination
-    * representing 400 characters (zC stands for 400 adjacent C's)	
-    */	
-
-    while (repeat_count >= 400)
-    {
-      putchar('z');
-      repeat_count -= 400;
-    }
-
-   /*
-    * Then print 'g' through 'y' as multiples of 20 characters...
-    */
-
-    if (repeat_count >= 20)
-    {
-      putchar('f' + repeat_count / 20);
-      repeat_count %= 20;
-    }
-
-   /*
-    * Finally, print 'G' through 'Y' as 1 through 19 characters...
-    */
-
-    if (repeat_count > 0)
-      putchar('F' + repeat_count);
-  }
-
- /*
-  * Then the character to be repeated...
-  */
-
-  putchar(repeat_char);
-}
-
-
-/*
- * 'main()' - Main entry and processing of driver.
- */
-
-int					/* O - Exit status */
-main(int  argc,				/* I - Number of command-line arguments */
-     char *argv[])			/* I - Command-line arguments */
-{
-  int			fd;		/* File descriptor */
-  cups_raster_t		*ras;		/* Raster stream for printing */
-  cups_page_header2_t	header;		/* Page header from file */
-  int			y;		/* Current line */
-  ppd_file_t		*ppd;		/* PPD file */
-  int			num_options;	/* Number of options */
-  cups_option_t		*options;	/* Options */
-#if defined(HAVE_SIGACTION) && !defined(HAVE_SIGSET)
-  struct sigaction action;		/* Actions for POSIX signals */
-#endif /* HAVE_SIGACTION && !HAVE_SIGSET */
-
-
- /*
-  * Make sure status messages are not buffered...
-  */
-
-  setbuf(stderr, NULL);
-
- /*
-  * Check command-line...
-  */
-
-  if (argc < 6 || argc > 7)
-  {
-   /*
-    * We don't have the correct number of arguments; write an error message
-    * and return.
-    */
-
-    fprintf(stderr, _("Usage: %s job-id user title copies options [file]\n"),
-            argv[0]);
-    return (1);
-  }
-
- /*
-  * Open the page stream...
-  */
-
-  if (argc == 7)
-  {
-    if ((fd = open(argv[6], O_RDONLY)) == -1)
-    {
-      perror("ERROR: Unable to open raster file - ");
-      sleep(1);
-      return (1);
-    }
-  }
-  else
-    fd = 0;
-
-  ras = cupsRasterOpen(fd, CUPS_RASTER_READ);
-
- /*
-  * Register a signal handler to eject the current page if the
-  * job is cancelled.
-  */
-
-  Canceled = 0;
-
-#ifdef HAVE_SIGSET /* Use System V signals over POSIX to avoid bugs */
-  sigset(SIGTERM, CancelJob);
-#elif defined(HAVE_SIGACTION)
-  memset(&action, 0, sizeof(action));
-
-  sigemptyset(&action.sa_mask);
-  action.sa_handler = CancelJob;
-  sigaction(SIGTERM, &action, NULL);
-#else
-  signal(SIGTERM, CancelJob);
-#endif /* HAVE_SIGSET */
-
- /*
-  * Open the PPD file and apply options...
-  */
-
-  num_options = cupsParseOptions(argv[5], 0, &options);
-
-  if ((ppd = ppdOpenFile(getenv("PPD"))) != NULL)
-  {
-    ppdMarkDefaults(ppd);
-    cupsMarkOptions(ppd, num_options, options);
-  }
-
- /*
-  * Initialize the print device...
-  */
-
-  Setup(ppd);
-
- /*
-  * Process pages as needed...
-  */
-
-  Page = 0;
-
-  while (cupsRasterReadHeader2(ras, &header))
-  {
-   /*
-    * Write a status message with the page number and number of copies.
-    */
-
-    if (Canceled)
-      break;
-
-    Page ++;
-
-    fprintf(stderr, "PAGE: %d 1\n", Page);
-
-   /*
-    * Start the page...
-    */
-
-    StartPage(ppd, &header);
-
-   /*
-    * Loop for each line on the page...
-    */
-
-    for (y = 0; y < header.cupsHeight && !Canceled; y ++)
-    {
-     /*
-      * Let the user know how far we have progressed...
-      */
-
-      if (Canceled)
-	break;
-
-      if ((y & 15) == 0)
-        fprintf(stderr, _("INFO: Printing page %d, %d%% complete...\n"), Page,
-	        100 * y / header.cupsHeight);
-
-     /*
-      * Read a line of graphics...
-      */
-
-      if (cupsRasterReadPixels(ras, Buffer, header.cupsBytesPerLine) < 1)
-        break;
-
-     /*
-      * Write it to the printer...
-      */
-
-      OutputLine(ppd, &header, y);
-    }
-
-   /*
-    * Eject the page...
-    */
-
-    EndPage(ppd, &header);
-
-    if (Canceled)
-      break;
-  }
-
- /*
-  * Close the raster stream...
-  */
-
-  cupsRasterClose(ras);
-  if (fd != 0)
-    close(fd);
-
- /*
-  * Close the PPD file and free the options...
-  */
-
-  ppdClose(ppd);
-  cupsFreeOptions(num_options, options);
-
- /*
-  * If no pages were printed, send an error message...
-  */
-
-  if (Page == 0)
-    fputs(_("ERROR: No pages found!\n"), stderr);
-  else
-    fputs(_("INFO: Ready to print.\n"), stderr);
-
-  return (Page == 0);
-}
-
-
-/*
- * End of "$Id: rastertolabel.c,v 1.5 2010/12/08 11:39:18 mwilner Exp $".
- */
+/*
+ * "$Id: rastertolabel.c,v 1.5 2009/07/07 20:39:18 pgrenning Exp $"
+ *
+ *   Label printer filter for the Common UNIX Printing System (CUPS).
+ *
+ *   Copyright 2007-2008 by Apple Inc.
+ *   Copyright 2001-2007 by Easy Software Products.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ *
+ *   This file is subject to the Apple OS-Developed Software exception.
+ *
+ * Contents:
+ *
+ *   Setup()        - Prepare the printer for printing.
+ *   PageAlloc()    - Get a page buffer, reusing the last one when it fits.
+ *   PageKeep()     - Keep a page buffer for the next page.
+ *   StartPage()    - Start a page of graphics.
+ *   EndPage()      - Finish a page of graphics.
+ *   CancelJob()    - Cancel the current job...
+ *   OutputLine()   - Output a line of graphics.
+ *   InkFind()      - Find the inked regions of a page.
+ *   InkCut()       - Split a region at blank rows and columns.
+ *   InkTrim()      - Shrink a region to the ink inside it.
+ *   InkCopy()      - Copy a region of a page.
+ *   ZPLPatchPage() - Find or output the changes from the previous page.
+ *   ZPLChooseEncoding() - Choose the cheapest graphic encoding for a page.
+ *   ZPLWriteGraphic() - Output page graphics in the given encoding.
+ *   ZPLWriteASCII() - Output ASCII graphics, encoding bands in parallel.
+ *   ZPLEncodeBand() - Encode a band of ASCII graphics in a thread.
+ *   ZPLWriteRows() - Output a range of lines as ASCII graphics.
+ *   ZPLWriteFields() - Output page graphics as banded ^GF fields.
+ *   ZPLWriteZ64()  - Output graphics in the ZPL :Z64: format.
+ *   ZPLHash()      - Compute the content hash of a page.
+ *   ZPLCacheReserve() - Make room for a graphic in the printer cache.
+ *   ZPLCacheAdd()  - Add a downloaded graphic to the printer cache.
+ *   ZPLCacheFind() - Find a graphic in the printer cache.
+ *   ZPLCacheLoad() - Load the printer cache index.
+ *   ZPLCacheSave() - Save the printer cache index.
+ *   ZPLCacheSync() - Update the cache index from the printer's directory.
+ *   ZPLPipeline()  - Read, encode, and write pages in parallel.
+ *   ZPLEncodePages() - Encode pages in an encoder thread.
+ *   ZPLWritePages() - Write encoded pages in order in the writer thread.
+ *   ZPLWritePage() - Write an encoded page.
+ *   ZPLReserveThreads() - Reserve spare threads for band encoding.
+ *   ZPLReleaseThreads() - Return spare threads.
+ *   ZPLReadStatus() - Ask the printer for its host status.
+ *   ZPLWaitPrinter() - Wait until the printer can take another label.
+ *   BatchKey()     - Compute the batch key for the queue and its options.
+ *   PrintJob()     - Print the pages of a raster file.
+ *   Serve()        - Print jobs handed over by labelshim until stopped.
+ *   main()         - Main entry and processing of driver.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include <cups/cups.h>
+#include <cups/string.h>
+#include <cups/i18n.h>
+#include <cups/raster.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "labelout.h"
+#include "labelbatch.h"
+#include "labelenc.h"
+#include "labellog.h"
+#include "labelppd.h"
+#include "rasterin.h"
+
+
+/*
+ * This driver filter currently supports Dymo, Intellitech, and Zebra
+ * label printers.
+ *
+ * The Dymo portion of the driver has been tested with the 300, 330,
+ * and 330 Turbo label printers; it may also work with other models.
+ * The Dymo printers support printing at 136, 203, and 300 DPI.
+ *
+ * The Intellitech portion of the driver has been tested with the
+ * Intellibar 408, 412, and 808 and supports their PCL variant.
+ *
+ * The Zebra portion of the driver has been tested with the LP-2844,
+ * LP-2844Z, QL-320, and QL-420 label printers; it may also work with
+ * other models.  The driver supports EPL line mode, EPL page mode,
+ * ZPL, and CPCL as defined in Zebra's on-line developer documentation.
+ */
+
+/*
+ * ZPL graphic encodings...
+ */
+
+#define ZEBRA_GRF_ASCII	0		/* ASCII hex with run-length compression */
+#define ZEBRA_GRF_Z64	1		/* Deflate + base64 (:Z64:) */
+#define ZEBRA_GRF_HEX	2		/* Uncompressed ASCII hex (^GFA) */
+#define ZEBRA_GRF_BINARY 3		/* Binary (^GFB) */
+#define ZEBRA_GRF_AUTO	4		/* Cheapest of the above for each page */
+
+#define ZPL_SAMPLE_BLOCKS 8		/* Number of row blocks to sample */
+#define ZPL_SAMPLE_ROWS	8		/* Rows per sampled block */
+
+#define ZPL_PATCH_ROWS	16		/* Rows per band for incremental pages */
+#define ZPL_PATCH_PERCENT 50		/* Largest patch as percent of page */
+
+
+/*
+ * Printer flow control...
+ */
+
+#define ZPL_STATUS_WAIT	5.0		/* Seconds to wait for ~HS status */
+#define ZPL_STATUS_POLL	500000		/* Microseconds between status polls */
+
+typedef struct				/**** ~HS host status ****/
+{
+  int		paper_out,		/* Non-zero if out of media */
+		paused,			/* Non-zero if paused */
+		formats,		/* Formats in receive buffer */
+		buffer_full,		/* Non-zero if receive buffer is full */
+		head_up,		/* Non-zero if print head is open */
+		ribbon_out;		/* Non-zero if out of ribbon */
+} zpl_status_t;
+
+
+/*
+ * Ink region analysis...
+ */
+
+#define INK_MAX_REGIONS	32		/* Most regions sent for a page */
+#define INK_MAX_DEPTH	8		/* Deepest split of a region */
+#define INK_GAP_ROWS	16		/* Blank rows between regions */
+#define INK_GAP_BYTES	4		/* Blank bytes between regions */
+
+typedef struct				/**** Inked region of a page ****/
+{
+  int		x,			/* Left edge in bytes */
+		y,			/* Top edge in lines */
+		width,			/* Width in bytes */
+		height;			/* Height in lines */
+} ink_region_t;
+
+
+/*
+ * Printer-resident graphic cache...
+ */
+
+#define ZPL_CACHE_NAME(h) ((unsigned)((h) ^ ((h) >> 32)))
+					/* 8 hex digit object name for hash */
+#define ZPL_CACHE_WAIT	1.0		/* Seconds to wait for ^HW listing */
+#define ZPL_CACHE_RECHECK 60		/* Seconds a served queue trusts its index */
+
+typedef struct				/**** Cached graphic ****/
+{
+  uint64_t	hash;			/* Content hash */
+  int		size;			/* Size in printer memory */
+  unsigned	used;			/* Last use for LRU eviction */
+} zpl_graphic_t;
+
+
+/*
+ * Page encoding pipeline...
+ */
+
+#define ZPL_MAX_THREADS	16		/* Most encoder threads */
+#define ZPL_BAND_BYTES	65536		/* Smallest band encoded in parallel */
+
+typedef struct				/**** Page in the pipeline ****/
+{
+  cups_page_header2_t header;		/* Page header */
+  int		number;			/* Page number */
+  unsigned char	*page;			/* Page bitmap */
+  size_t	size;			/* Allocated size of bitmap */
+  int		encoding,		/* Graphic encoding */
+		estimate,		/* Estimated bytes of graphics */
+		bytes,			/* Bytes of graphics */
+		last_inked,		/* Last inked line or -1 */
+		encoded;		/* Non-zero when encoded */
+  char		*data;			/* Encoded graphics */
+  size_t	length;			/* Length of encoded graphics */
+} zpl_page_t;
+
+typedef struct				/**** Page encoding pipeline ****/
+{
+  pthread_mutex_t mutex;		/* Lock for counters */
+  pthread_cond_t cond;			/* Signaled when counters change */
+  labelppd_t	*ppd;			/* PPD file */
+  zpl_page_t	*pages;			/* Ring of pages */
+  int		num_pages,		/* Number of pages in ring */
+		num_read,		/* Number of pages read */
+		num_taken,		/* Number of pages taken by encoders */
+		num_written,		/* Number of pages written */
+		done;			/* Non-zero when all pages are read */
+} zpl_pipeline_t;
+
+typedef struct				/**** Band of ASCII graphics ****/
+{
+  const unsigned char *data;		/* Page data */
+  int		bpl,			/* Bytes per line */
+		first,			/* First line of band */
+		last,			/* Line after band */
+		bytes;			/* Bytes of graphics */
+  pthread_t	thread;			/* Encoding thread */
+  char		*buffer;		/* Encoded graphics */
+  size_t	length;			/* Length of encoded graphics */
+  int		started;		/* Non-zero if thread was started */
+} zpl_band_t;
+
+
+/*
+ * Globals...
+ */
+
+unsigned char	*Buffer;		/* Output buffer */
+unsigned char	*PageBuffer;		/* Page buffer for Z64/auto graphics */
+unsigned char	*PrevBuffer;		/* Previous page for incremental pages */
+unsigned char	*SpareBuffer;		/* Page buffer kept for the next page */
+size_t		PageSize,		/* Allocated size of PageBuffer */
+		PrevSize,		/* Allocated size of PrevBuffer */
+		SpareSize;		/* Allocated size of SpareBuffer */
+int		LineSize;		/* Allocated size of Buffer */
+labelenc_t	*Encoder;		/* Encoder for the line-by-line paths */
+int		ModelNumber,		/* cupsModelNumber attribute */
+		Page,			/* Current page */
+		GraphicEncoding,	/* zeGraphicEncoding option */
+		Incremental,		/* Non-zero for incremental pages */
+		PendingLabel,		/* Non-zero if label needs ^MC */
+		PrevBytes,		/* Bytes per line of previous page */
+		PrevHeight,		/* Height of previous page */
+		BandRows,		/* Rows per graphic field on this page */
+		InkRegions,		/* Non-zero to send only inked regions */
+		LastInked,		/* Last inked line of page or -1 */
+		Threads,		/* Number of encoder threads or 0 */
+		SpareThreads,		/* Threads free for band encoding */
+		FlowFormats,		/* Most formats queued in printer or 0 */
+		BatchWindow,		/* zeBatchWindow in ms, -1 if served */
+		Encoding;		/* Encoding for the current page */
+volatile sig_atomic_t Canceled;	/* Non-zero if job is canceled */
+float		LinkCost;		/* zeLinkCost option */
+char		CacheDrive;		/* Graphic cache drive or 0 for none */
+long		CacheSize;		/* Graphic cache size budget */
+unsigned	CacheClock;		/* Graphic cache use counter */
+int		NumCache,		/* Number of cached graphics */
+		AllocCache;		/* Allocated cache entries */
+zpl_graphic_t	*Cache;			/* Cached graphics */
+pthread_mutex_t	SpareLock = PTHREAD_MUTEX_INITIALIZER;
+					/* Lock for SpareThreads */
+char		CacheFile[1024],	/* Cache index filename */
+		CacheSynced[1026];	/* Drive and index last checked */
+time_t		CacheSyncTime;		/* Time index was last checked */
+
+
+/*
+ * Prototypes...
+ */
+
+void	Setup(labelppd_t *ppd);
+void	PageAlloc(cups_page_header2_t *header);
+void	PageKeep(unsigned char *page, size_t size);
+void	StartPage(labelppd_t *ppd, cups_page_header2_t *header);
+void	EndPage(labelppd_t *ppd, cups_page_header2_t *header);
+void	CancelJob(int sig);
+void	OutputLine(labelppd_t *ppd, cups_page_header2_t *header, int y);
+int	InkFind(const unsigned char *page, int bpl, int rows,
+	        ink_region_t *regions);
+int	InkCut(const unsigned char *page, int bpl, ink_region_t *box,
+	       int depth, ink_region_t *regions, int num);
+int	InkTrim(const unsigned char *page, int bpl, ink_region_t *box);
+unsigned char *InkCopy(const unsigned char *page, int bpl,
+	               const ink_region_t *box, int invert);
+long	ZPLPatchPage(const unsigned char *prev, const unsigned char *cur,
+	             int bpl, int rows, unsigned char *patch);
+int	ZPLChooseEncoding(const unsigned char *data, int bpl, int rows,
+	                  int inline_ok, int *estimate);
+int	ZPLWriteGraphic(FILE *fp, const unsigned char *data, int bpl,
+	                int rows, int encoding);
+int	ZPLWriteASCII(FILE *fp, const unsigned char *data, int bpl,
+	              int rows);
+void	*ZPLEncodeBand(void *data);
+int	ZPLWriteRows(FILE *fp, const unsigned char *data, int bpl, int first,
+	             int last);
+int	ZPLWriteFields(FILE *fp, const unsigned char *data, int bpl,
+	               int rows, int band_rows, int encoding);
+int	ZPLWriteZ64(FILE *fp, const unsigned char *data, int bpl,
+	            int rows);
+uint64_t ZPLHash(const unsigned char *data, int bpl, int rows);
+int	ZPLCacheReserve(uint64_t hash, int size);
+zpl_graphic_t *ZPLCacheAdd(uint64_t hash, int size);
+zpl_graphic_t *ZPLCacheFind(uint64_t hash);
+void	ZPLCacheLoad(void);
+void	ZPLCacheSave(void);
+void	ZPLCacheSync(void);
+int	ZPLPipeline(raster_in_t *ras, labelppd_t *ppd);
+void	*ZPLEncodePages(void *data);
+void	*ZPLWritePages(void *data);
+void	ZPLWritePage(labelppd_t *ppd, zpl_page_t *page);
+int	ZPLReserveThreads(int count);
+void	ZPLReleaseThreads(int count);
+int	ZPLReadStatus(zpl_status_t *status);
+void	ZPLWaitPrinter(void);
+void	BatchKey(labelppd_t *ppd, char *key, int keysize);
+int	PrintJob(labelppd_t *ppd, int fd);
+int	Serve(const char *queue);
+
+
+/*
+ * 'Setup()' - Prepare the printer for printing.
+ */
+
+void
+Setup(labelppd_t *ppd)			/* I - PPD file */
+{
+  int		i;			/* Looping var */
+  int		mux;			/* Sending through the multiplexer? */
+  int		num_options;		/* Number of encoder options */
+  cups_option_t	*options;		/* Encoder options */
+  const char	*keyword,		/* Option keyword */
+		*choice;		/* Marked choice */
+  const char	*cachedir,		/* CUPS_CACHEDIR env var */
+		*printer;		/* PRINTER env var */
+  char		path[sizeof(CacheSynced)];
+					/* Drive and index filename */
+
+
+ /*
+  * Get the model number from the PPD file...
+  */
+
+  if (ppd)
+    ModelNumber = LabelPPDModel(ppd);
+
+ /*
+  * Get the graphic encoding for ZPL printers...
+  */
+
+  GraphicEncoding = ZEBRA_GRF_ASCII;
+
+  if ((choice = LabelPPDChoice(ppd, "zeGraphicEncoding")) != NULL)
+  {
+    if (!strcmp(choice, "Z64"))
+      GraphicEncoding = ZEBRA_GRF_Z64;
+    else if (!strcmp(choice, "Auto"))
+      GraphicEncoding = ZEBRA_GRF_AUTO;
+  }
+
+  InkRegions = LabelPPDIsMarked(ppd, "zeInkRegions", "True");
+
+  if ((choice = LabelPPDChoice(ppd, "zeLinkCost")) != NULL &&
+      atof(choice) > 0.0)
+    LinkCost = atof(choice);
+  else
+    LinkCost = 1.0;
+
+ /*
+  * With a priority set, labels go through the label multiplexer, which
+  * may put other jobs' labels between ours.  Each label must then stand
+  * on its own and nothing is read back from the printer, so graphics are
+  * neither cached nor patched and flow control is left off...
+  */
+
+  if ((choice = LabelPPDChoice(ppd, "zePriority")) != NULL &&
+      atoi(choice) > 0)
+    mux = !LabelOutMux(atoi(choice));
+  else
+    mux = 0;
+
+ /*
+  * Buffer the printer output, holding it no longer than the latency bound
+  * between output lines if one is set, and optionally write it while the
+  * next rows encode; a batcher writes each job's output before moving on
+  * to the next...
+  */
+
+  if ((choice = LabelPPDChoice(ppd, "zeFlushLatency")) != NULL)
+    i = atoi(choice);
+  else
+    i = 0;
+
+  LabelOutStart(LABELOUT_BUFSIZE, i,
+                LabelPPDIsMarked(ppd, "zeAsyncOutput", "True") && !BatchWindow);
+
+ /*
+  * Hand the marked choices to the encoder, which compiles the options used
+  * for each page once and resets the printer...
+  */
+
+  if (!Encoder && (Encoder = LabelEncNew(LabelOutWrite, NULL)) == NULL)
+  {
+    fputs("ERROR: Unable to allocate memory for encoder.\n", stderr);
+    exit(1);
+  }
+
+  for (i = 0, num_options = 0, options = NULL;
+       (keyword = LabelPPDKeyword(ppd, i)) != NULL;
+       i ++)
+    if ((choice = LabelPPDChoice(ppd, keyword)) != NULL)
+      num_options = cupsAddOption(keyword, choice, num_options, &options);
+
+  LabelEncStartJob(Encoder, ModelNumber, num_options, options);
+
+  cupsFreeOptions(num_options, options);
+
+ /*
+  * Get the graphic cache settings; inline graphics are never stored on
+  * the printer...
+  */
+
+  CacheDrive = 0;
+
+  if ((choice = LabelPPDChoice(ppd, "zeGraphicCache")) != NULL &&
+      (!strcmp(choice, "R") || !strcmp(choice, "E")) &&
+      !Encoder->inline_graphics && !mux)
+  {
+    if ((printer = getenv("PRINTER")) == NULL)
+      LabelLogDebug("PRINTER not set, graphic cache disabled.\n");
+    else
+    {
+      if ((cachedir = getenv("CUPS_CACHEDIR")) == NULL)
+        cachedir = "/var/cache/cups";
+
+      snprintf(CacheFile, sizeof(CacheFile), "%s/%s.zplcache", cachedir,
+               printer);
+
+      CacheDrive = choice[0];
+    }
+  }
+
+  Incremental  = LabelPPDIsMarked(ppd, "zeIncremental", "True") &&
+                 !Encoder->kiosk && !mux;
+  PendingLabel = 0;
+  PrevBuffer   = NULL;
+
+  if ((choice = LabelPPDChoice(ppd, "zeGraphicCacheSize")) != NULL &&
+      atol(choice) > 0)
+    CacheSize = 1024 * atol(choice);
+  else
+    CacheSize = 1024 * 1024;
+
+ /*
+  * Encode ZPL pages on several threads; pages that depend on the ones
+  * before them or are streamed are done one at a time...
+  */
+
+  if ((choice = LabelPPDChoice(ppd, "zeEncoderThreads")) == NULL)
+    Threads = 0;
+  else if (!strcmp(choice, "Auto"))
+    Threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  else
+    Threads = atoi(choice);
+
+  if (Threads > ZPL_MAX_THREADS)
+    Threads = ZPL_MAX_THREADS;
+
+  SpareThreads = Threads > 1 ? Threads - 1 : 0;
+
+  if (ModelNumber != ZEBRA_ZPL || Incremental || CacheDrive || InkRegions ||
+      Encoder->tracking == LABELENC_TRACK_VARIABLE)
+    Threads = 0;
+
+ /*
+  * Hold labels back while the printer is busy or needs attention, if the
+  * printer can answer status queries on the back channel...
+  */
+
+  if (ModelNumber == ZEBRA_ZPL && !mux &&
+      (choice = LabelPPDChoice(ppd, "zeFlowControl")) != NULL)
+    FlowFormats = atoi(choice);
+  else
+    FlowFormats = 0;
+
+ /*
+  * Load the graphic cache index and check it against the printer; a
+  * served queue keeps the index from its last job for a while, since the
+  * listing costs a round trip on the back channel...
+  */
+
+  if (ModelNumber == ZEBRA_ZPL && CacheDrive)
+  {
+    snprintf(path, sizeof(path), "%c%s", CacheDrive, CacheFile);
+
+    if (strcmp(path, CacheSynced) ||
+        time(NULL) - CacheSyncTime > ZPL_CACHE_RECHECK)
+    {
+      ZPLCacheLoad();
+      ZPLCacheSync();
+
+      snprintf(CacheSynced, sizeof(CacheSynced), "%s", path);
+      CacheSyncTime = time(NULL);
+    }
+  }
+
+  LabelOutPreamble();
+}
+
+
+/*
+ * 'PageAlloc()' - Get a page buffer, reusing the last one when it fits.
+ *
+ * Sets PageBuffer, or leaves it NULL if no memory is available.  The page
+ * is not cleared; every line is copied in by OutputLine(), and PrintJob()
+ * clears the lines of short pages.
+ */
+
+void
+PageAlloc(cups_page_header2_t *header)	/* I - Page header */
+{
+  size_t	size;			/* Size of page */
+
+
+  size = (size_t)header->cupsHeight * header->cupsBytesPerLine;
+
+  if (size > SpareSize)
+  {
+    free(SpareBuffer);
+
+    SpareBuffer = NULL;
+    SpareSize   = 0;
+
+    if ((PageBuffer = malloc(size)) != NULL)
+      PageSize = size;
+  }
+  else
+  {
+    PageBuffer  = SpareBuffer;
+    PageSize    = SpareSize;
+    SpareBuffer = NULL;
+    SpareSize   = 0;
+  }
+}
+
+
+/*
+ * 'PageKeep()' - Keep a page buffer for the next page.
+ *
+ * Only the larger of the page and the kept buffer is kept.
+ */
+
+void
+PageKeep(unsigned char *page,		/* I - Page buffer or NULL */
+         size_t        size)		/* I - Allocated size */
+{
+  if (!page)
+    return;
+
+  if (size > SpareSize)
+  {
+    free(SpareBuffer);
+
+    SpareBuffer = page;
+    SpareSize   = size;
+  }
+  else
+    free(page);
+}
+
+
+/*
+ * 'StartPage()' - Start a page of graphics.
+ */
+
+void
+StartPage(labelppd_t         *ppd,	/* I - PPD file */
+          cups_page_header2_t *header)	/* I - Page header */
+{
+  int		streaming;		/* Non-zero to stream variable length */
+
+
+ /*
+  * Show page device dictionary...
+  */
+
+  (void)ppd;
+
+  LABELLOG_PAGE(("StartPage...\n"));
+  LABELLOG_PAGE(("MediaClass = \"%s\"\n", header->MediaClass));
+  LABELLOG_PAGE(("MediaColor = \"%s\"\n", header->MediaColor));
+  LABELLOG_PAGE(("MediaType = \"%s\"\n", header->MediaType));
+  LABELLOG_PAGE(("OutputType = \"%s\"\n", header->OutputType));
+
+  LABELLOG_PAGE(("AdvanceDistance = %d\n", header->AdvanceDistance));
+  LABELLOG_PAGE(("AdvanceMedia = %d\n", header->AdvanceMedia));
+  LABELLOG_PAGE(("Collate = %d\n", header->Collate));
+  LABELLOG_PAGE(("CutMedia = %d\n", header->CutMedia));
+  LABELLOG_PAGE(("Duplex = %d\n", header->Duplex));
+  LABELLOG_PAGE(("HWResolution = [ %d %d ]\n", header->HWResolution[0],
+                 header->HWResolution[1]));
+  LABELLOG_PAGE(("ImagingBoundingBox = [ %d %d %d %d ]\n",
+                 header->ImagingBoundingBox[0], header->ImagingBoundingBox[1],
+                 header->ImagingBoundingBox[2],
+                 header->ImagingBoundingBox[3]));
+  LABELLOG_PAGE(("InsertSheet = %d\n", header->InsertSheet));
+  LABELLOG_PAGE(("Jog = %d\n", header->Jog));
+  LABELLOG_PAGE(("LeadingEdge = %d\n", header->LeadingEdge));
+  LABELLOG_PAGE(("Margins = [ %d %d ]\n", header->Margins[0],
+                 header->Margins[1]));
+  LABELLOG_PAGE(("ManualFeed = %d\n", header->ManualFeed));
+  LABELLOG_PAGE(("MediaPosition = %d\n", header->MediaPosition));
+  LABELLOG_PAGE(("MediaWeight = %d\n", header->MediaWeight));
+  LABELLOG_PAGE(("MirrorPrint = %d\n", header->MirrorPrint));
+  LABELLOG_PAGE(("NegativePrint = %d\n", header->NegativePrint));
+  LABELLOG_PAGE(("NumCopies = %d\n", header->NumCopies));
+  LABELLOG_PAGE(("Orientation = %d\n", header->Orientation));
+  LABELLOG_PAGE(("OutputFaceUp = %d\n", header->OutputFaceUp));
+  LABELLOG_PAGE(("PageSize = [ %d %d ]\n", header->PageSize[0],
+                 header->PageSize[1]));
+  LABELLOG_PAGE(("Separations = %d\n", header->Separations));
+  LABELLOG_PAGE(("TraySwitch = %d\n", header->TraySwitch));
+  LABELLOG_PAGE(("Tumble = %d\n", header->Tumble));
+  LABELLOG_PAGE(("cupsWidth = %d\n", header->cupsWidth));
+  LABELLOG_PAGE(("cupsHeight = %d\n", header->cupsHeight));
+  LABELLOG_PAGE(("cupsMediaType = %d\n", header->cupsMediaType));
+  LABELLOG_PAGE(("cupsBitsPerColor = %d\n", header->cupsBitsPerColor));
+  LABELLOG_PAGE(("cupsBitsPerPixel = %d\n", header->cupsBitsPerPixel));
+  LABELLOG_PAGE(("cupsBytesPerLine = %d\n", header->cupsBytesPerLine));
+  LABELLOG_PAGE(("cupsColorOrder = %d\n", header->cupsColorOrder));
+  LABELLOG_PAGE(("cupsColorSpace = %d\n", header->cupsColorSpace));
+  LABELLOG_PAGE(("cupsCompression = %d\n", header->cupsCompression));
+  LABELLOG_PAGE(("cupsRowCount = %d\n", header->cupsRowCount));
+  LABELLOG_PAGE(("cupsRowFeed = %d\n", header->cupsRowFeed));
+  LABELLOG_PAGE(("cupsRowStep = %d\n", header->cupsRowStep));
+
+ /*
+  * Grow the line buffer as needed; it is kept from page to page...
+  */
+
+  if ((int)header->cupsBytesPerLine > LineSize)
+  {
+    free(Buffer);
+
+    Buffer   = malloc(header->cupsBytesPerLine);
+    LineSize = header->cupsBytesPerLine;
+  }
+
+  switch (ModelNumber)
+  {
+    case ZEBRA_EPL_PAGE :
+    case ZEBRA_CPCL :
+       /*
+        * Collect the page to send only the inked regions...
+	*/
+
+        if (InkRegions)
+	  PageAlloc(header);
+        break;
+
+    case ZEBRA_ZPL :
+       /*
+        * Wait for room in the printer...
+	*/
+
+        if (FlowFormats)
+	  ZPLWaitPrinter();
+
+       /*
+        * Z64, automatically chosen, cached, incremental and inked region
+	* graphics need the whole page, so collect it and send it from
+	* EndPage(); so do trimmed inline graphics, since the label length
+	* comes first, and graphics encoded on several threads.  Streamed
+	* pages and everything else are encoded line by line...
+	*/
+
+        streaming = LabelEncStreaming(Encoder, header);
+        BandRows  = LabelEncBandRows(Encoder, header->cupsBytesPerLine,
+	                             header->cupsHeight);
+        Encoding  = streaming ? ZEBRA_GRF_ASCII : GraphicEncoding;
+	LastInked = -1;
+
+        if (!streaming &&
+	    (Encoding != ZEBRA_GRF_ASCII || CacheDrive || Incremental ||
+	     InkRegions ||
+	     (Encoder->inline_graphics && Encoder->trim_margin >= 0) ||
+	     SpareThreads > 0))
+	{
+	  PageAlloc(header);
+
+	  if (!PageBuffer)
+	  {
+	    LabelLogDebug("Unable to allocate page buffer, using ASCII "
+	                  "graphics.\n");
+	    Encoding = ZEBRA_GRF_ASCII;
+	  }
+	  else if (Incremental)
+	    return;
+	}
+
+       /*
+        * Finish the previous label; this page is not a patch for it...
+	*/
+
+        if (PendingLabel)
+	{
+	  puts("^MCY");
+	  PendingLabel = 0;
+	}
+
+        if (PageBuffer)
+	{
+	 /*
+	  * Set darkness...
+	  */
+
+          if (header->cupsCompression > 0 && header->cupsCompression <= 100)
+	    printf("~SD%02d\n", 30 * header->cupsCompression / 100);
+
+	  return;
+	}
+        break;
+  }
+
+ /*
+  * Start the page in the encoder...
+  */
+
+  LabelEncStartPage(Encoder, header);
+}
+
+
+/*
+ * 'EndPage()' - Finish a page of graphics.
+ */
+
+void
+EndPage(labelppd_t *ppd,		/* I - PPD file */
+        cups_page_header2_t *header)	/* I - Page header */
+{
+  int		bytes,			/* Bytes of graphics sent */
+		estimate;		/* Estimated bytes of graphics */
+  size_t	size;			/* Size of swapped page buffer */
+  uint64_t	hash;			/* Content hash of page */
+  int		whole,			/* Non-zero for a whole ZPL page */
+		patch,			/* Non-zero if page is a patch */
+		ink;			/* Non-zero to send inked regions */
+  long		changed;		/* Bytes changed from previous page */
+  unsigned char	*ptr,			/* Pointer to buffer */
+		*patches;		/* Patch graphics */
+  int		i,			/* Looping var */
+		num_regions;		/* Number of inked regions */
+  ink_region_t	regions[INK_MAX_REGIONS];
+					/* Inked regions */
+  unsigned char	*region;		/* Copy of inked region */
+  zpl_graphic_t	*graphic;		/* Cached graphic */
+  char		name[32];		/* Name of downloaded graphic */
+  static const char * const encodings[] =
+		{			/* Graphic encoding names */
+		  "ASCII",
+		  "Z64",
+		  "HEX",
+		  "BINARY"
+		};
+
+
+ /*
+  * Whole ZPL pages are sent from here; the encoder finishes the rest...
+  */
+
+  (void)ppd;
+
+  whole = ModelNumber == ZEBRA_ZPL && PageBuffer != NULL;
+
+  switch (ModelNumber)
+  {
+    case ZEBRA_EPL_PAGE :
+       /*
+        * Send the inked regions as needed; GW uses 0 bits for black...
+	*/
+
+        if (PageBuffer)
+	{
+	  num_regions = InkFind(PageBuffer, header->cupsBytesPerLine,
+	                        header->cupsHeight, regions);
+
+          for (i = 0; i < num_regions && !Canceled; i ++)
+	  {
+	    if ((region = InkCopy(PageBuffer, header->cupsBytesPerLine,
+	                          regions + i, 1)) == NULL)
+	      break;
+
+	    printf("GW%d,%d,%d,%d\n", 8 * regions[i].x, regions[i].y,
+	           regions[i].width, regions[i].height);
+	    fwrite(region, regions[i].width, regions[i].height, stdout);
+	    putchar('\n');
+
+	    free(region);
+	  }
+
+	  PageKeep(PageBuffer, PageSize);
+	  PageBuffer = NULL;
+	}
+        break;
+
+    case ZEBRA_ZPL :
+        if (!whole)
+	  break;
+
+        if (Canceled)
+	{
+	 /*
+	  * Nothing has been sent for the page yet...
+	  */
+
+	  PageKeep(PageBuffer, PageSize);
+	  PageBuffer = NULL;
+	  break;
+	}
+
+        bytes    = 0;
+	estimate = 0;
+	graphic  = NULL;
+	patch    = 0;
+	patches  = NULL;
+
+	strcpy(name, "R:CUPS.GRF");
+
+        if (Incremental)
+	{
+	 /*
+	  * Send only the changes when the page is close enough to the
+	  * previous one, which is then kept with ^MCN...
+	  */
+
+          if (PendingLabel)
+	  {
+	    if (PrevBuffer && PrevBytes == (int)header->cupsBytesPerLine &&
+	        PrevHeight == (int)header->cupsHeight)
+	    {
+	      changed = ZPLPatchPage(PrevBuffer, PageBuffer,
+	                             header->cupsBytesPerLine,
+				     header->cupsHeight, NULL);
+
+             /*
+	      * The patch buffer is allocated before anything is sent, so the
+	      * page goes out whole if there is no memory for it...
+	      */
+
+	      if (changed <= (long)header->cupsBytesPerLine *
+	                     header->cupsHeight * ZPL_PATCH_PERCENT / 100)
+	        patch = (patches = malloc((size_t)changed + 1)) != NULL;
+	    }
+
+	    printf("^MC%c\n", patch ? 'N' : 'Y');
+	    PendingLabel = 0;
+	  }
+
+          if (header->cupsCompression > 0 && header->cupsCompression <= 100)
+	    printf("~SD%02d\n", 30 * header->cupsCompression / 100);
+	}
+
+       /*
+        * Cached graphics are always whole pages...
+	*/
+
+        ink = !patch && InkRegions && !CacheDrive;
+
+        if (ink)
+	{
+	 /*
+	  * Send only the inked regions of the page as graphic fields...
+	  */
+
+	  num_regions = InkFind(PageBuffer, header->cupsBytesPerLine,
+	                        header->cupsHeight, regions);
+
+          if (GraphicEncoding == ZEBRA_GRF_AUTO)
+	    Encoding = ZPLChooseEncoding(PageBuffer, header->cupsBytesPerLine,
+	                                 header->cupsHeight, 1, &estimate);
+
+	  LabelEncStartLabel(Encoder, header, 0, LastInked);
+
+          if (num_regions == 0)
+	    puts("^FO0,0^GB8,1,1,W^FS");
+
+          for (i = 0; i < num_regions; i ++)
+	  {
+	    if ((region = InkCopy(PageBuffer, header->cupsBytesPerLine,
+	                          regions + i, 0)) == NULL)
+	      break;
+
+	    printf("^FO%d,%d^GF%c,%d,%d,%d,", 8 * regions[i].x, regions[i].y,
+	           Encoding == ZEBRA_GRF_BINARY ? 'B' : 'A',
+		   regions[i].width * regions[i].height,
+		   regions[i].width * regions[i].height, regions[i].width);
+	    bytes += ZPLWriteGraphic(stdout, region, regions[i].width,
+	                             regions[i].height, Encoding);
+	    puts("^FS");
+
+	    free(region);
+	  }
+
+	  LABELLOG_PAGE(("Sent %d inked regions.\n", num_regions));
+	}
+        else if (!patch && CacheDrive &&
+	    header->cupsHeight * header->cupsBytesPerLine <= CacheSize)
+	{
+	 /*
+	  * Look for the page in the printer's graphic cache; if it is there
+	  * we only need to recall it...
+	  */
+
+          hash = ZPLHash(PageBuffer, header->cupsBytesPerLine,
+	                 header->cupsHeight);
+
+          if ((graphic = ZPLCacheFind(hash)) != NULL)
+	  {
+	    LABELLOG_PAGE(("Graphic %c:%08X.GRF is cached.\n", CacheDrive,
+	                   ZPL_CACHE_NAME(hash)));
+
+	    graphic->used = ++ CacheClock;
+	  }
+	  else if (!ZPLCacheReserve(hash, header->cupsHeight *
+	                                  header->cupsBytesPerLine))
+	  {
+	    if (GraphicEncoding == ZEBRA_GRF_AUTO)
+	      Encoding = ZPLChooseEncoding(PageBuffer, header->cupsBytesPerLine,
+	                                   header->cupsHeight, 0, &estimate);
+
+	    printf("~DG%c:%08X.GRF,%d,%d,", CacheDrive, ZPL_CACHE_NAME(hash),
+		   header->cupsHeight * header->cupsBytesPerLine,
+		   header->cupsBytesPerLine);
+	    bytes = ZPLWriteGraphic(stdout, PageBuffer,
+	                            header->cupsBytesPerLine,
+	                            header->cupsHeight, Encoding);
+	    putchar('\n');
+
+           /*
+	    * Only index the graphic once all of it has been sent...
+	    */
+
+            if (bytes > 0 && !Canceled)
+	      graphic = ZPLCacheAdd(hash, header->cupsHeight *
+	                                  header->cupsBytesPerLine);
+	  }
+
+          if (graphic)
+	    snprintf(name, sizeof(name), "%c:%08X.GRF", CacheDrive,
+	             ZPL_CACHE_NAME(hash));
+	}
+
+        if (!patch && !graphic && !ink)
+	{
+	 /*
+	  * Pick an encoding for the page as needed...
+	  */
+
+          if (GraphicEncoding == ZEBRA_GRF_AUTO)
+	    Encoding = ZPLChooseEncoding(PageBuffer, header->cupsBytesPerLine,
+	                                 header->cupsHeight, 1, &estimate);
+
+         /*
+	  * Download the page; inline, hex and binary graphics are sent with
+	  * the label below...
+	  */
+
+          if (!Encoder->inline_graphics &&
+	      (Encoding == ZEBRA_GRF_ASCII || Encoding == ZEBRA_GRF_Z64))
+	  {
+	    printf("~DGR:CUPS.GRF,%d,%d,",
+		   header->cupsHeight * header->cupsBytesPerLine,
+		   header->cupsBytesPerLine);
+	    bytes = ZPLWriteGraphic(stdout, PageBuffer,
+	                            header->cupsBytesPerLine,
+	                            header->cupsHeight, Encoding);
+	    putchar('\n');
+	  }
+	}
+
+       /*
+        * Start label...
+	*/
+
+        if (!ink)
+	  LabelEncStartLabel(Encoder, header, 0, LastInked);
+
+       /*
+        * Display the label image...
+	*/
+
+        if (ink)
+	{
+	 /*
+	  * Inked regions were sent above...
+	  */
+	}
+	else if (patch)
+	{
+	 /*
+	  * Send the changed parts of the page...
+	  */
+
+          bytes = ZPLPatchPage(PrevBuffer, PageBuffer,
+	                       header->cupsBytesPerLine, header->cupsHeight,
+			       patches);
+	  free(patches);
+
+	  LABELLOG_PAGE(("Incremental page, %d of %d bytes changed.\n", bytes,
+	                 header->cupsBytesPerLine * header->cupsHeight));
+	}
+	else if (Encoder->inline_graphics || Encoding == ZEBRA_GRF_HEX ||
+	         Encoding == ZEBRA_GRF_BINARY)
+	  bytes = ZPLWriteFields(stdout, PageBuffer, header->cupsBytesPerLine,
+	                         header->cupsHeight, BandRows, Encoding);
+	else
+	{
+	  printf("^FO0,0^XG%s,1,1^FS\n", name);
+
+	 /*
+	  * End the label and eject; cached graphics stay on the printer...
+	  */
+
+          if (!graphic)
+	    puts("^IDR:CUPS.GRF^FS");
+	}
+
+        if (GraphicEncoding == ZEBRA_GRF_AUTO && !patch && bytes)
+	  LabelLogDebug("ZPL graphic encoding %s, estimated %d bytes, "
+	                "actual %d bytes\n", encodings[Encoding], estimate, bytes);
+	
+	if (Encoder->kiosk)
+	{
+		puts("^XZ^XA^CN0^PN1^XZ");
+	}
+
+       /*
+        * Keep the page for the next incremental page; the label is finished
+	* with ^MCN or ^MCY once we know what the next page looks like...
+	*/
+
+        if (Incremental)
+	{
+	  ptr          = PrevBuffer;
+	  PrevBuffer   = PageBuffer;
+	  PageBuffer   = ptr;
+	  size         = PrevSize;
+	  PrevSize     = PageSize;
+	  PageSize     = size;
+	  PrevBytes    = header->cupsBytesPerLine;
+	  PrevHeight   = header->cupsHeight;
+	  PendingLabel = 1;
+	}
+
+       /*
+        * Keep the page buffer for the next page...
+	*/
+
+	PageKeep(PageBuffer, PageSize);
+	PageBuffer = NULL;
+        break;
+
+    case ZEBRA_CPCL :
+       /*
+        * Send the inked regions as needed...
+	*/
+
+        if (PageBuffer)
+	{
+	  num_regions = InkFind(PageBuffer, header->cupsBytesPerLine,
+	                        header->cupsHeight, regions);
+
+          for (i = 0; i < num_regions && !Canceled; i ++)
+	  {
+	    if ((region = InkCopy(PageBuffer, header->cupsBytesPerLine,
+	                          regions + i, 0)) == NULL)
+	      break;
+
+	    printf("CG %d %d %d %d ", regions[i].width, regions[i].height,
+	           8 * regions[i].x, regions[i].y);
+	    fwrite(region, regions[i].width, regions[i].height, stdout);
+	    puts("\r");
+
+	    free(region);
+	  }
+
+	  PageKeep(PageBuffer, PageSize);
+	  PageBuffer = NULL;
+	}
+        break;
+  }
+
+ /*
+  * Finish the page in the encoder...
+  */
+
+  if (!whole)
+    LabelEncEndPage(Encoder, Canceled);
+
+  LabelOutFlush();
+}
+
+
+/*
+ * 'CancelJob()' - Cancel the current job...
+ */
+
+void
+CancelJob(int sig)			/* I - Signal */
+{
+ /*
+  * Tell the main loop to stop...
+  */
+
+  (void)sig;
+
+  Canceled = 1;
+}
+
+
+/*
+ * 'OutputLine()' - Output a line of graphics...
+ */
+
+void
+OutputLine(labelppd_t         *ppd,	/* I - PPD file */
+           cups_page_header2_t *header,	/* I - Page header */
+           int                y)	/* I - Line number */
+{
+  (void)ppd;
+
+  if (PageBuffer)
+  {
+   /*
+    * Save the line for EndPage(), noting the last inked line for trimmed
+    * labels...
+    */
+
+    if (Encoder->trim_margin >= 0 &&
+        (*LabelEncSpan)(Buffer, header->cupsBytesPerLine, 0) <
+	    (int)header->cupsBytesPerLine)
+      LastInked = y;
+
+    memcpy(PageBuffer + y * header->cupsBytesPerLine, Buffer,
+	   header->cupsBytesPerLine);
+  }
+  else
+    LabelEncWriteRow(Encoder, Buffer);
+}
+
+
+/*
+ * 'InkFind()' - Find the inked regions of a page.
+ *
+ * The page is split at wide blank gaps, alternating between rows and
+ * columns, into at most INK_MAX_REGIONS boxes trimmed to their ink.  If
+ * there are more islands than that, the bounding box of the page is used.
+ */
+
+int					/* O - Number of regions, 0 if blank */
+InkFind(const unsigned char *page,	/* I - Page data */
+        int                 bpl,	/* I - Bytes per line */
+	int                 rows,	/* I - Number of lines */
+	ink_region_t        *regions)	/* O - Inked regions */
+{
+  ink_region_t	box;			/* Bounding box of page */
+  int		num_regions;		/* Number of regions */
+
+
+  box.x      = 0;
+  box.y      = 0;
+  box.width  = bpl;
+  box.height = rows;
+
+  if (!InkTrim(page, bpl, &box))
+    return (0);
+
+  if ((num_regions = InkCut(page, bpl, &box, 0, regions, 0)) < 0)
+  {
+    regions[0]  = box;
+    num_regions = 1;
+  }
+
+  return (num_regions);
+}
+
+
+/*
+ * 'InkCut()' - Split a region at blank rows and columns.
+ *
+ * The region must already be trimmed.  Even depths split at runs of at
+ * least INK_GAP_ROWS blank lines and odd depths at runs of at least
+ * INK_GAP_BYTES blank bytes; a region that cannot be split in either
+ * direction is added as is.
+ */
+
+int					/* O - Number of regions or -1 if full */
+InkCut(const unsigned char *page,	/* I - Page data */
+       int                 bpl,		/* I - Bytes per line */
+       ink_region_t        *box,	/* I - Region to split */
+       int                 depth,	/* I - Depth of split */
+       ink_region_t        *regions,	/* IO - Inked regions */
+       int                 num)		/* I - Number of regions so far */
+{
+  int		tried,			/* Number of directions tried */
+		length,			/* Lines or bytes in region */
+		min_gap,		/* Smallest gap to split at */
+		pos,			/* Current line or byte */
+		start,			/* Start of current part */
+		gap,			/* Length of blank run */
+		splits;			/* Number of splits */
+  const unsigned char *line;		/* Current line */
+  unsigned char	*inked;			/* Lines or bytes with ink */
+  ink_region_t	part;			/* Part of region */
+
+
+  for (tried = 0; tried < 2 && depth < INK_MAX_DEPTH; tried ++, depth ++)
+  {
+   /*
+    * Find the inked lines or columns of the region...
+    */
+
+    if (depth & 1)
+    {
+      length  = box->width;
+      min_gap = INK_GAP_BYTES;
+    }
+    else
+    {
+      length  = box->height;
+      min_gap = INK_GAP_ROWS;
+    }
+
+    if ((inked = calloc(1, length)) == NULL)
+      return (-1);
+
+    line = page + (long)box->y * bpl + box->x;
+
+    for (pos = 0; pos < box->height; pos ++, line += bpl)
+      if (depth & 1)
+      {
+        for (start = 0; start < box->width; start ++)
+	  inked[start] |= line[start];
+      }
+      else
+        inked[pos] = line[0] || (*LabelEncSpan)(line, box->width, 0) < box->width;
+
+   /*
+    * The region is trimmed, so it starts and ends with ink; see if there
+    * are any gaps wide enough to split at...
+    */
+
+    for (pos = 0, gap = 0, splits = 0; pos < length; pos ++)
+      if (!inked[pos])
+        gap ++;
+      else
+      {
+        if (gap >= min_gap)
+	  splits ++;
+
+	gap = 0;
+      }
+
+    if (!splits)
+    {
+      free(inked);
+      continue;
+    }
+
+   /*
+    * Split the region and look at each part...
+    */
+
+    for (pos = 0, start = 0, gap = 0; pos <= length && num >= 0; pos ++)
+    {
+      if (pos < length && !inked[pos])
+      {
+        gap ++;
+	continue;
+      }
+
+      if (pos == length || gap >= min_gap)
+      {
+        part = *box;
+
+        if (depth & 1)
+	{
+	  part.x     += start;
+	  part.width  = pos - gap - start;
+	}
+	else
+	{
+	  part.y      += start;
+	  part.height = pos - gap - start;
+	}
+
+        InkTrim(page, bpl, &part);
+
+        num   = InkCut(page, bpl, &part, depth + 1, regions, num);
+	start = pos;
+      }
+
+      gap = 0;
+    }
+
+    free(inked);
+
+    return (num);
+  }
+
+ /*
+  * Could not split the region, add it...
+  */
+
+  if (num >= INK_MAX_REGIONS)
+    return (-1);
+
+  regions[num] = *box;
+
+  return (num + 1);
+}
+
+
+/*
+ * 'InkTrim()' - Shrink a region to the ink inside it.
+ */
+
+int					/* O - 1 if inked, 0 if blank */
+InkTrim(const unsigned char *page,	/* I - Page data */
+        int                 bpl,	/* I - Bytes per line */
+	ink_region_t        *box)	/* IO - Region */
+{
+  const unsigned char *line;		/* Current line */
+  int		y,			/* Current line */
+		left,			/* Leftmost inked byte */
+		right,			/* Rightmost inked byte */
+		top,			/* First inked line */
+		bottom,			/* Last inked line */
+		span;			/* Blank bytes on the left */
+
+
+  left   = box->width;
+  right  = -1;
+  top    = -1;
+  bottom = -1;
+
+  for (y = 0, line = page + (long)box->y * bpl + box->x; y < box->height;
+       y ++, line += bpl)
+  {
+    if ((span = (*LabelEncSpan)(line, box->width, 0)) == box->width)
+      continue;
+
+    if (top < 0)
+      top = y;
+
+    bottom = y;
+
+    if (span < left)
+      left = span;
+
+    for (span = box->width - 1; span > right && !line[span]; span --);
+
+    if (span > right)
+      right = span;
+  }
+
+  if (top < 0)
+    return (0);
+
+  box->x      += left;
+  box->y      += top;
+  box->width  = right - left + 1;
+  box->height = bottom - top + 1;
+
+  return (1);
+}
+
+
+/*
+ * 'InkCopy()' - Copy a region of a page.
+ */
+
+unsigned char *				/* O - Region data or NULL */
+InkCopy(const unsigned char *page,	/* I - Page data */
+        int                 bpl,	/* I - Bytes per line */
+	const ink_region_t  *box,	/* I - Region */
+	int                 invert)	/* I - Non-zero to invert the data */
+{
+  unsigned char	*data,			/* Region data */
+		*ptr;			/* Pointer into data */
+  const unsigned char *line;		/* Current line */
+  int		y,			/* Current line */
+		x;			/* Current byte */
+
+
+  if ((data = malloc((size_t)box->width * box->height)) == NULL)
+  {
+    fputs("ERROR: Unable to allocate memory for inked region.\n", stderr);
+    return (NULL);
+  }
+
+  for (y = 0, ptr = data, line = page + (long)box->y * bpl + box->x;
+       y < box->height; y ++, ptr += box->width, line += bpl)
+    if (invert)
+    {
+      for (x = 0; x < box->width; x ++)
+        ptr[x] = ~line[x];
+    }
+    else
+      memcpy(ptr, line, box->width);
+
+  return (data);
+}
+
+
+/*
+ * 'ZPLPatchPage()' - Find or output the changes from the previous page.
+ *
+ * The pages are compared in bands of ZPL_PATCH_ROWS rows.  Each run of
+ * changed bands is cleared with a white box and redrawn with a ^GF field
+ * covering the changed columns.  Returns the number of graphic bytes in
+ * the patches.  Nothing is written unless a patch buffer is given; it
+ * must hold at least the returned number of bytes, and is allocated by
+ * the caller so a failure can still fall back to the whole page.
+ */
+
+long					/* O - Bytes in patches */
+ZPLPatchPage(const unsigned char *prev,	/* I - Previous page */
+             const unsigned char *cur,	/* I - Current page */
+	     int                 bpl,	/* I - Bytes per line */
+	     int                 rows,	/* I - Number of lines */
+	     unsigned char       *patch)	/* I - Patch buffer or NULL */
+{
+  int			y,		/* Current line */
+			row,		/* Line in patch */
+			y0, y1,		/* Lines in patch */
+			x0, x1,		/* Columns in patch */
+			first, last,	/* Changed columns in line */
+			width,		/* Width of patch in bytes */
+			height;		/* Height of patch */
+  long			bytes;		/* Bytes in patches */
+  const unsigned char	*p, *c;		/* Pointers into pages */
+  unsigned char		*pptr;		/* Pointer into patch */
+
+
+  for (y = 0, bytes = 0; y < rows;)
+  {
+   /*
+    * Find the next run of changed bands...
+    */
+
+    for (y0 = y; y0 < rows; y0 += ZPL_PATCH_ROWS)
+    {
+      height = rows - y0 < ZPL_PATCH_ROWS ? rows - y0 : ZPL_PATCH_ROWS;
+
+      if (memcmp(prev + (long)y0 * bpl, cur + (long)y0 * bpl,
+                 (size_t)height * bpl))
+        break;
+    }
+
+    if (y0 >= rows)
+      break;
+
+    for (y1 = y0 + ZPL_PATCH_ROWS; y1 < rows; y1 += ZPL_PATCH_ROWS)
+    {
+      height = rows - y1 < ZPL_PATCH_ROWS ? rows - y1 : ZPL_PATCH_ROWS;
+
+      if (!memcmp(prev + (long)y1 * bpl, cur + (long)y1 * bpl,
+                  (size_t)height * bpl))
+        break;
+    }
+
+    if (y1 > rows)
+      y1 = rows;
+
+    y = y1;
+
+   /*
+    * Find the changed columns...
+    */
+
+    for (x0 = bpl, x1 = -1, row = y0; row < y1; row ++)
+    {
+      p = prev + (long)row * bpl;
+      c = cur + (long)row * bpl;
+
+      for (first = 0; first < x0 && p[first] == c[first]; first ++);
+      for (last = bpl - 1; last > x1 && p[last] == c[last]; last --);
+
+      x0 = first;
+      x1 = last;
+    }
+
+    width  = x1 - x0 + 1;
+    height = y1 - y0;
+    bytes  += (long)width * height;
+
+    if (!patch)
+      continue;
+
+   /*
+    * Clear the area and draw the new graphics...
+    */
+
+    printf("^FO%d,%d^GB%d,%d,%d,W^FS\n", 8 * x0, y0, 8 * width, height,
+           8 * width < height ? 8 * width : height);
+
+    for (row = y0, pptr = patch; row < y1; row ++, pptr += width)
+      memcpy(pptr, cur + (long)row * bpl + x0, width);
+
+    printf("^FO%d,%d^GFA,%d,%d,%d,", 8 * x0, y0, width * height,
+           width * height, width);
+    ZPLWriteGraphic(stdout, patch, width, height, ZEBRA_GRF_ASCII);
+    puts("^FS");
+  }
+
+  return (bytes);
+}
+
+
+/*
+ * 'ZPLChooseEncoding()' - Choose the cheapest graphic encoding for a page.
+ *
+ * The cost of each encoding is the estimated number of bytes sent times
+ * the link cost plus the relative CPU cost of encoding the page, so slow
+ * serial links favor compression while fast links favor cheap encodings.
+ * The ASCII and Z64 sizes are estimated from a few blocks of rows spread
+ * over the page.  Binary graphics can only be sent inline with ^GF, so
+ * they are not considered for downloaded graphics.  Hex graphics are
+ * twice the size of binary ones and cost more to encode, so they are
+ * never the cheapest and are only used when asked for.
+ */
+
+int					/* O - Encoding */
+ZPLChooseEncoding(
+    const unsigned char *data,		/* I - Page data */
+    int                 bpl,		/* I - Bytes per line */
+    int                 rows,		/* I - Number of lines */
+    int                 inline_ok,	/* I - 1 if ^GF-only encodings are OK */
+    int                 *estimate)	/* O - Estimated bytes of graphics */
+{
+  int		i, y,			/* Looping vars */
+		block,			/* Rows between sampled blocks */
+		sampled,		/* Number of sampled rows */
+		encoding;		/* Cheapest encoding */
+  long		total,			/* Total bytes in page */
+		sizes[4],		/* Estimated size of each encoding */
+		bytes;			/* Bytes in sample */
+  double	cost,			/* Cost of encoding */
+		best;			/* Cost of cheapest encoding */
+  unsigned char	*sample,		/* Sampled rows */
+		*encoded,		/* Encoded line */
+		*comp;			/* Compressed sample */
+  uLongf	complen;		/* Length of compressed sample */
+  static const double cpu_cost[4] =
+		{			/* Relative CPU cost per raster byte */
+		  1.0,			/* ZEBRA_GRF_ASCII */
+		  4.0,			/* ZEBRA_GRF_Z64 */
+		  0.25,			/* ZEBRA_GRF_HEX */
+		  0.0			/* ZEBRA_GRF_BINARY */
+		};
+  static const int candidates[3] =
+		{			/* Encodings to choose from */
+		  ZEBRA_GRF_ASCII,
+		  ZEBRA_GRF_Z64,
+		  ZEBRA_GRF_BINARY	/* Inline only */
+		};
+
+
+  total = (long)bpl * rows;
+
+ /*
+  * The hex and binary sizes are fixed...
+  */
+
+  sizes[ZEBRA_GRF_HEX]    = 2 * total;
+  sizes[ZEBRA_GRF_BINARY] = total;
+
+ /*
+  * Collect blocks of rows spread over the page...
+  */
+
+  if (rows <= ZPL_SAMPLE_BLOCKS * ZPL_SAMPLE_ROWS)
+    block = ZPL_SAMPLE_ROWS;
+  else
+    block = rows / ZPL_SAMPLE_BLOCKS;
+
+  if ((sample = malloc((size_t)bpl * ZPL_SAMPLE_BLOCKS * ZPL_SAMPLE_ROWS +
+                       2 * bpl + 1)) == NULL)
+  {
+    *estimate = (int)total;
+    return (inline_ok ? ZEBRA_GRF_BINARY : ZEBRA_GRF_ASCII);
+  }
+
+  encoded = sample + (size_t)bpl * ZPL_SAMPLE_BLOCKS * ZPL_SAMPLE_ROWS;
+
+  for (y = 0, sampled = 0, bytes = 0;
+       y < rows && sampled < ZPL_SAMPLE_BLOCKS * ZPL_SAMPLE_ROWS;
+       y += block)
+  {
+    for (i = 0; i < ZPL_SAMPLE_ROWS && y + i < rows; i ++, sampled ++)
+    {
+      const unsigned char *line = data + (long)(y + i) * bpl;
+
+      memcpy(sample + (long)sampled * bpl, line, bpl);
+
+      if (y + i > 0 && !memcmp(line, line - bpl, bpl))
+        bytes ++;
+      else
+        bytes += LabelEncZPLLine(line, bpl, encoded);
+    }
+  }
+
+  sizes[ZEBRA_GRF_ASCII] = bytes * rows / sampled;
+
+ /*
+  * Compress the sample to estimate the Z64 size...
+  */
+
+  complen = compressBound((uLong)bpl * sampled);
+
+  if ((comp = malloc(complen)) != NULL &&
+      compress2(comp, &complen, sample, (uLong)bpl * sampled,
+                Z_BEST_COMPRESSION) == Z_OK)
+    sizes[ZEBRA_GRF_Z64] = 4 * ((long)complen * rows / sampled + 2) / 3 + 10;
+  else
+    sizes[ZEBRA_GRF_Z64] = 2 * total;
+
+  free(comp);
+  free(sample);
+
+ /*
+  * Pick the cheapest encoding...
+  */
+
+  for (i = 0, encoding = ZEBRA_GRF_ASCII, best = 0.0;
+       i < (inline_ok ? 3 : 2);
+       i ++)
+  {
+    cost = LinkCost * sizes[candidates[i]] +
+           cpu_cost[candidates[i]] * total;
+
+    if (i == 0 || cost < best)
+    {
+      encoding = candidates[i];
+      best     = cost;
+    }
+  }
+
+  *estimate = (int)sizes[encoding];
+
+  return (encoding);
+}
+
+
+/*
+ * 'ZPLWriteGraphic()' - Output page graphics in the given encoding.
+ */
+
+int					/* O - Number of bytes written */
+ZPLWriteGraphic(
+    FILE                *fp,		/* I - File to write to */
+    const unsigned char *data,		/* I - Page data */
+    int                 bpl,		/* I - Bytes per line */
+    int                 rows,		/* I - Number of lines */
+    int                 encoding)	/* I - Encoding */
+{
+  int			y,		/* Current line */
+			i,		/* Looping var */
+			bytes;		/* Bytes written */
+  const unsigned char	*line;		/* Current line */
+  unsigned char		*encoded;	/* Encoded line */
+  static const char	*hex = "0123456789ABCDEF";
+					/* Hex digits */
+
+
+  encoded = NULL;
+
+  if (encoding == ZEBRA_GRF_HEX && (encoded = malloc(2 * bpl + 1)) == NULL)
+  {
+    fputs("ERROR: Unable to allocate memory for graphics.\n", stderr);
+    return (0);
+  }
+
+  switch (encoding)
+  {
+    case ZEBRA_GRF_ASCII :
+        bytes = ZPLWriteASCII(fp, data, bpl, rows);
+        break;
+
+    case ZEBRA_GRF_Z64 :
+        bytes = ZPLWriteZ64(fp, data, bpl, rows);
+	break;
+
+    case ZEBRA_GRF_HEX :
+        for (y = 0, line = data; y < rows; y ++, line += bpl)
+	{
+	  for (i = 0; i < bpl; i ++)
+	  {
+	    encoded[2 * i]     = hex[line[i] >> 4];
+	    encoded[2 * i + 1] = hex[line[i] & 15];
+	  }
+
+	  fwrite(encoded, 1, 2 * bpl, fp);
+	}
+
+        bytes = 2 * bpl * rows;
+	break;
+
+    default :
+        fwrite(data, 1, bpl * rows, fp);
+	bytes = bpl * rows;
+	break;
+  }
+
+  free(encoded);
+
+  return (bytes);
+}
+
+
+/*
+ * 'ZPLWriteASCII()' - Output ASCII graphics, encoding bands in parallel.
+ *
+ * Large graphics are split into bands that spare threads encode at the
+ * same time.  The first line of each band is compared with the last line
+ * of the band before it, so the output is the same as encoding the lines
+ * one after another.
+ */
+
+int					/* O - Number of bytes written */
+ZPLWriteASCII(FILE                *fp,	/* I - File to write to */
+              const unsigned char *data,/* I - Graphics data */
+	      int                 bpl,	/* I - Bytes per line */
+	      int                 rows)	/* I - Number of lines */
+{
+  int		i,			/* Looping var */
+		num_bands,		/* Number of bands */
+		bytes;			/* Bytes written */
+  zpl_band_t	bands[ZPL_MAX_THREADS];	/* Bands */
+
+
+ /*
+  * Figure out how many bands to use...
+  */
+
+  num_bands = (int)((long)bpl * rows / ZPL_BAND_BYTES);
+
+  if (num_bands > ZPL_MAX_THREADS)
+    num_bands = ZPL_MAX_THREADS;
+
+  if (num_bands < 2 || (num_bands = ZPLReserveThreads(num_bands - 1) + 1) < 2)
+    return (ZPLWriteRows(fp, data, bpl, 0, rows));
+
+ /*
+  * Encode all but the first band on other threads...
+  */
+
+  memset(bands, 0, sizeof(bands));
+
+  for (i = 0; i < num_bands; i ++)
+  {
+    bands[i].data  = data;
+    bands[i].bpl   = bpl;
+    bands[i].first = (int)((long)rows * i / num_bands);
+    bands[i].last  = (int)((long)rows * (i + 1) / num_bands);
+
+    if (i > 0)
+      bands[i].started = !pthread_create(&(bands[i].thread), NULL,
+                                         ZPLEncodeBand, bands + i);
+  }
+
+ /*
+  * Write the first band while the others are encoded, then the others in
+  * order...
+  */
+
+  bytes = ZPLWriteRows(fp, data, bpl, bands[0].first, bands[0].last);
+
+  for (i = 1; i < num_bands; i ++)
+  {
+    if (bands[i].started)
+      pthread_join(bands[i].thread, NULL);
+
+    if (bands[i].buffer)
+    {
+      fwrite(bands[i].buffer, 1, bands[i].length, fp);
+      bytes += bands[i].bytes;
+      free(bands[i].buffer);
+    }
+    else
+      bytes += ZPLWriteRows(fp, data, bpl, bands[i].first, bands[i].last);
+  }
+
+  ZPLReleaseThreads(num_bands - 1);
+
+  return (bytes);
+}
+
+
+/*
+ * 'ZPLEncodeBand()' - Encode a band of ASCII graphics in a thread.
+ */
+
+void *					/* O - Thread exit status */
+ZPLEncodeBand(void *data)		/* I - Band */
+{
+  zpl_band_t	*band = (zpl_band_t *)data;
+					/* Band */
+  FILE		*fp;			/* Encoded graphics */
+
+
+ /*
+  * ZPLWriteASCII() encodes the band itself if there is no buffer...
+  */
+
+  if ((fp = open_memstream(&(band->buffer), &(band->length))) != NULL)
+  {
+    band->bytes = ZPLWriteRows(fp, band->data, band->bpl, band->first,
+                               band->last);
+    fclose(fp);
+  }
+
+  return (NULL);
+}
+
+
+/*
+ * 'ZPLWriteRows()' - Output a range of lines as ASCII graphics.
+ */
+
+int					/* O - Number of bytes written */
+ZPLWriteRows(FILE                *fp,	/* I - File to write to */
+             const unsigned char *data,	/* I - Graphics data */
+	     int                 bpl,	/* I - Bytes per line */
+	     int                 first,	/* I - First line */
+	     int                 last)	/* I - Line after the last line */
+{
+  int			y,		/* Current line */
+			bytes,		/* Bytes written */
+			length;		/* Length of encoded line */
+  const unsigned char	*line;		/* Current line */
+  unsigned char		*encoded;	/* Encoded line */
+
+
+  if ((encoded = malloc(2 * bpl + 1)) == NULL)
+  {
+    fputs("ERROR: Unable to allocate memory for graphics.\n", stderr);
+    return (0);
+  }
+
+  for (y = first, bytes = 0, line = data + (long)first * bpl; y < last;
+       y ++, line += bpl)
+  {
+    if (y > 0 && !memcmp(line, line - bpl, bpl))
+    {
+      putc(':', fp);
+      bytes ++;
+      continue;
+    }
+
+    length = LabelEncZPLLine(line, bpl, encoded);
+    fwrite(encoded, 1, length, fp);
+    bytes += length;
+  }
+
+  free(encoded);
+
+  return (bytes);
+}
+
+
+/*
+ * 'ZPLWriteFields()' - Output page graphics as banded ^GF fields.
+ *
+ * The page is split into fields of band_rows rows so the printer can work
+ * on each band as it arrives and never needs to hold more than one band
+ * of graphics.
+ */
+
+int					/* O - Number of bytes written */
+ZPLWriteFields(
+    FILE                *fp,		/* I - File to write to */
+    const unsigned char *data,		/* I - Page data */
+    int                 bpl,		/* I - Bytes per line */
+    int                 rows,		/* I - Number of lines */
+    int                 band_rows,	/* I - Lines per field */
+    int                 encoding)	/* I - Encoding */
+{
+  int	y,				/* Current line */
+	height,				/* Height of band */
+	bytes;				/* Bytes written */
+
+
+  for (y = 0, bytes = 0; y < rows; y += height)
+  {
+    height = rows - y < band_rows ? rows - y : band_rows;
+
+    fprintf(fp, "^FO0,%d^GF%c,%d,%d,%d,", y,
+            encoding == ZEBRA_GRF_BINARY ? 'B' : 'A', height * bpl,
+	    height * bpl, bpl);
+    bytes += ZPLWriteGraphic(fp, data + (long)y * bpl, bpl, height,
+                             encoding);
+    fputs("^FS\n", fp);
+  }
+
+  return (bytes);
+}
+
+
+/*
+ * 'ZPLWriteZ64()' - Output graphics in the ZPL :Z64: format.
+ *
+ * The data is compressed with zlib, encoded in base64 and followed by the
+ * CRC-16 (CCITT, initial value 0) of the base64 text in hex.  The text is
+ * built in memory first; if that fails the graphics are sent as ASCII
+ * instead, which fits the same ~DG or ^GF header.
+ */
+
+int					/* O - Number of bytes written */
+ZPLWriteZ64(FILE                *fp,	/* I - File to write to */
+            const unsigned char *data,	/* I - Graphics data */
+            int                 bpl,	/* I - Bytes per line */
+            int                 rows)	/* I - Number of lines */
+{
+  unsigned char	*comp,			/* Compressed data */
+		*b64,			/* Base64 text */
+		*b64ptr;		/* Pointer into base64 text */
+  uLongf	complen;		/* Length of compressed data */
+  uLong		i;			/* Looping var */
+  unsigned	bits,			/* Bits to encode */
+		crc;			/* CRC-16 of base64 text */
+  int		bit,			/* Looping var */
+		b64len;			/* Length of base64 text */
+  static const char *base64 =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+					/* Base64 digits */
+
+
+ /*
+  * Compress the graphics...
+  */
+
+  complen = compressBound((uLong)bpl * rows);
+  b64     = NULL;
+
+  if ((comp = malloc(complen)) == NULL ||
+      (b64 = malloc(4 * (complen / 3 + 1))) == NULL ||
+      compress2(comp, &complen, data, (uLong)bpl * rows,
+                Z_BEST_COMPRESSION) != Z_OK)
+  {
+    LabelLogDebug("Unable to compress Z64 graphics, sending ASCII.\n");
+    free(comp);
+    free(b64);
+    return (ZPLWriteASCII(fp, data, bpl, rows));
+  }
+
+ /*
+  * Encode in base64...
+  */
+
+  for (i = 0, b64ptr = b64; i < complen; i += 3)
+  {
+    bits = comp[i] << 16;
+    if (i + 1 < complen)
+      bits |= comp[i + 1] << 8;
+    if (i + 2 < complen)
+      bits |= comp[i + 2];
+
+    *b64ptr++ = base64[(bits >> 18) & 63];
+    *b64ptr++ = base64[(bits >> 12) & 63];
+    *b64ptr++ = i + 1 < complen ? base64[(bits >> 6) & 63] : '=';
+    *b64ptr++ = i + 2 < complen ? base64[bits & 63] : '=';
+  }
+
+ /*
+  * Compute the CRC of the base64 text...
+  */
+
+  b64len = (int)(b64ptr - b64);
+
+  for (crc = 0, i = 0; i < (uLong)b64len; i ++)
+  {
+    crc ^= b64[i] << 8;
+
+    for (bit = 0; bit < 8; bit ++)
+      crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) & 0xffff
+                           : (crc << 1) & 0xffff;
+  }
+
+  fputs(":Z64:", fp);
+  fwrite(b64, 1, b64len, fp);
+  fprintf(fp, ":%04X", crc);
+
+  free(comp);
+  free(b64);
+
+  return (b64len + 10);
+}
+
+
+/*
+ * 'ZPLHash()' - Compute the content hash of a page.
+ *
+ * This is a 64-bit FNV-1a hash of the page size and bitmap.
+ */
+
+uint64_t				/* O - Hash */
+ZPLHash(const unsigned char *data,	/* I - Page data */
+        int                 bpl,	/* I - Bytes per line */
+        int                 rows)	/* I - Number of lines */
+{
+  long		i,			/* Looping var */
+		length;			/* Length of data */
+  uint64_t	hash;			/* Hash */
+
+
+  hash   = 0xcbf29ce484222325ULL;
+  length = (long)bpl * rows;
+
+  hash = (hash ^ (unsigned)bpl) * 0x100000001b3ULL;
+  hash = (hash ^ (unsigned)rows) * 0x100000001b3ULL;
+
+  for (i = 0; i < length; i ++)
+    hash = (hash ^ data[i]) * 0x100000001b3ULL;
+
+  return (hash);
+}
+
+
+/*
+ * 'ZPLCacheReserve()' - Make room for a graphic in the printer cache.
+ *
+ * The least recently used graphics are deleted from the printer until the
+ * new graphic fits in the cache size budget.  The caller then downloads
+ * the graphic and adds it with ZPLCacheAdd().
+ */
+
+int					/* O - 0 on success, -1 on error */
+ZPLCacheReserve(uint64_t hash,		/* I - Content hash */
+                int      size)		/* I - Size in printer memory */
+{
+  int		i,			/* Looping var */
+		oldest;			/* Least recently used graphic */
+  long		used;			/* Memory used by cache */
+  zpl_graphic_t	*graphic;		/* Cache entries */
+
+
+ /*
+  * Forget any graphic with the same name; the download replaces it...
+  */
+
+  for (i = 0, used = 0; i < NumCache; i ++)
+    if (ZPL_CACHE_NAME(Cache[i].hash) == ZPL_CACHE_NAME(hash))
+    {
+      NumCache --;
+      memmove(Cache + i, Cache + i + 1, (NumCache - i) * sizeof(zpl_graphic_t));
+      i --;
+    }
+    else
+      used += Cache[i].size;
+
+ /*
+  * Evict graphics until the new one fits...
+  */
+
+  while (NumCache > 0 && used + size > CacheSize)
+  {
+    for (i = 1, oldest = 0; i < NumCache; i ++)
+      if (Cache[i].used < Cache[oldest].used)
+        oldest = i;
+
+    printf("^XA^ID%c:%08X.GRF^FS^XZ\n", CacheDrive,
+           ZPL_CACHE_NAME(Cache[oldest].hash));
+
+    used -= Cache[oldest].size;
+    NumCache --;
+    memmove(Cache + oldest, Cache + oldest + 1,
+            (NumCache - oldest) * sizeof(zpl_graphic_t));
+  }
+
+ /*
+  * Make room for the new entry...
+  */
+
+  if (NumCache >= AllocCache)
+  {
+    if ((graphic = realloc(Cache, (AllocCache + 64) *
+                                  sizeof(zpl_graphic_t))) == NULL)
+      return (-1);
+
+    Cache      = graphic;
+    AllocCache += 64;
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'ZPLCacheAdd()' - Add a downloaded graphic to the printer cache.
+ *
+ * ZPLCacheReserve() must have been called for the graphic first.
+ */
+
+zpl_graphic_t *				/* O - New cache entry */
+ZPLCacheAdd(uint64_t hash,		/* I - Content hash */
+            int      size)		/* I - Size in printer memory */
+{
+  zpl_graphic_t	*graphic;		/* Cache entry */
+
+
+  if (NumCache >= AllocCache)
+    return (NULL);
+
+  graphic       = Cache + NumCache;
+  graphic->hash = hash;
+  graphic->size = size;
+  graphic->used = ++ CacheClock;
+
+  NumCache ++;
+
+  return (graphic);
+}
+
+
+/*
+ * 'ZPLCacheFind()' - Find a graphic in the printer cache.
+ */
+
+zpl_graphic_t *				/* O - Cache entry or NULL */
+ZPLCacheFind(uint64_t hash)		/* I - Content hash */
+{
+  int	i;				/* Looping var */
+
+
+  for (i = 0; i < NumCache; i ++)
+    if (Cache[i].hash == hash)
+      return (Cache + i);
+
+  return (NULL);
+}
+
+
+/*
+ * 'ZPLCacheLoad()' - Load the printer cache index.
+ *
+ * The index starts with the drive letter and use counter, followed by one
+ * line with the hash, size, and last use of each graphic.
+ */
+
+void
+ZPLCacheLoad(void)
+{
+  FILE			*fp;		/* Index file */
+  char			drive;		/* Drive in index */
+  unsigned long long	hash;		/* Content hash */
+  int			size;		/* Size in printer memory */
+  unsigned		used;		/* Last use */
+  zpl_graphic_t		*graphic;	/* Cache entry */
+
+
+  NumCache   = 0;
+  CacheClock = 0;
+
+  if ((fp = fopen(CacheFile, "r")) == NULL)
+    return;
+
+  if (fscanf(fp, " %c %u", &drive, &CacheClock) != 2 || drive != CacheDrive)
+  {
+    LabelLogDebug("Ignoring graphic cache index \"%s\".\n", CacheFile);
+    fclose(fp);
+    CacheClock = 0;
+    return;
+  }
+
+  while (fscanf(fp, "%llx%d%u", &hash, &size, &used) == 3)
+  {
+    if (NumCache >= AllocCache)
+    {
+      if ((graphic = realloc(Cache, (AllocCache + 64) *
+                                    sizeof(zpl_graphic_t))) == NULL)
+        break;
+
+      Cache      = graphic;
+      AllocCache += 64;
+    }
+
+    graphic       = Cache + NumCache;
+    graphic->hash = hash;
+    graphic->size = size;
+    graphic->used = used;
+
+    NumCache ++;
+  }
+
+  fclose(fp);
+
+  LabelLogDebug("Loaded %d cached graphics from \"%s\".\n", NumCache,
+                CacheFile);
+}
+
+
+/*
+ * 'ZPLCacheSave()' - Save the printer cache index.
+ */
+
+void
+ZPLCacheSave(void)
+{
+  int		i;			/* Looping var */
+  FILE		*fp;			/* Index file */
+  char		tempfile[1040];		/* Temporary index file */
+
+
+  snprintf(tempfile, sizeof(tempfile), "%s.N", CacheFile);
+
+  if ((fp = fopen(tempfile, "w")) == NULL)
+  {
+    LabelLogDebug("Unable to create \"%s\": %s\n", tempfile,
+                  strerror(errno));
+    return;
+  }
+
+  fprintf(fp, "%c %u\n", CacheDrive, CacheClock);
+
+  for (i = 0; i < NumCache; i ++)
+    fprintf(fp, "%016llX %d %u\n", (unsigned long long)Cache[i].hash,
+            Cache[i].size, Cache[i].used);
+
+  if (fclose(fp) || rename(tempfile, CacheFile))
+  {
+    LabelLogDebug("Unable to save \"%s\": %s\n", CacheFile,
+                  strerror(errno));
+    unlink(tempfile);
+  }
+}
+
+
+/*
+ * 'ZPLCacheSync()' - Update the cache index from the printer's directory.
+ *
+ * The printer is asked for a directory listing of its graphics with ^HW,
+ * and graphics that are no longer on the printer (for example after a
+ * power cycle cleared R:) are dropped from the index.  The index is left
+ * alone if the printer does not answer on the back channel.
+ */
+
+void
+ZPLCacheSync(void)
+{
+  int		i, j;			/* Looping vars */
+  ssize_t	bytes;			/* Bytes read */
+  size_t	total;			/* Total bytes read */
+  char		listing[16384],		/* Directory listing */
+		*line,			/* Current line */
+		*next,			/* Next line */
+		drive;			/* Drive of listed object */
+  unsigned	name;			/* Name of listed object */
+  unsigned char	*found;			/* Which cached graphics were listed */
+
+
+ /*
+  * Discard anything left over from an earlier query that timed out...
+  */
+
+  while (cupsBackChannelRead(listing, sizeof(listing), 0.0) > 0);
+
+  printf("^XA^HW%c:*.GRF^XZ\n", CacheDrive);
+  LabelOutFlush();
+
+ /*
+  * Read the listing, which ends with an ETX character...
+  */
+
+  for (total = 0; total < sizeof(listing) - 1; total += bytes)
+  {
+    if ((bytes = cupsBackChannelRead(listing + total,
+                                     sizeof(listing) - total - 1,
+				     total ? 0.25 : ZPL_CACHE_WAIT)) <= 0)
+      break;
+
+    if (memchr(listing + total, 3, bytes))
+    {
+      total += bytes;
+      break;
+    }
+  }
+
+  if (total == 0)
+  {
+    LabelLogDebug("No directory listing from printer, using cache "
+                  "index.\n");
+    return;
+  }
+
+  listing[total] = '\0';
+
+ /*
+  * Mark the graphics in the listing, which look like "*R:0123ABCD.GRF 1234"...
+  */
+
+  if ((found = calloc(NumCache + 1, 1)) == NULL)
+    return;
+
+  for (line = listing; line; line = next)
+  {
+    if ((next = strchr(line, '\n')) != NULL)
+      *next++ = '\0';
+
+    while (*line == '*' || isspace(*line & 255))
+      line ++;
+
+    if (sscanf(line, "%c:%8x.GRF", &drive, &name) != 2 ||
+        toupper(drive) != CacheDrive)
+      continue;
+
+    for (i = 0; i < NumCache; i ++)
+      if (ZPL_CACHE_NAME(Cache[i].hash) == name)
+        found[i] = 1;
+  }
+
+ /*
+  * Drop graphics the printer no longer has...
+  */
+
+  for (i = 0, j = 0; i < NumCache; i ++)
+    if (found[i])
+      Cache[j ++] = Cache[i];
+
+  LabelLogDebug("%d of %d cached graphics found on printer.\n", j,
+                NumCache);
+
+  NumCache = j;
+
+  free(found);
+}
+
+
+/*
+ * 'ZPLPipeline()' - Read, encode, and write pages in parallel.
+ *
+ * The calling thread reads pages into a fixed ring of page buffers, a pool
+ * of encoder threads encodes whole pages into memory and a writer thread
+ * sends them to the printer in page order.  Each stage waits when the ring
+ * is full, so memory use does not grow with the job.
+ *
+ * -1 is returned if the threads cannot be started; no pages have been
+ * read in that case.
+ */
+
+int					/* O - Number of pages or -1 */
+ZPLPipeline(raster_in_t *ras,		/* I - Raster stream */
+            labelppd_t  *ppd)		/* I - PPD file */
+{
+  zpl_pipeline_t	pipeline;	/* Pipeline */
+  zpl_page_t		*page;		/* Current page */
+  pthread_t		encoders[ZPL_MAX_THREADS],
+					/* Encoder threads */
+			writer;		/* Writer thread */
+  int			i,		/* Looping var */
+			y,		/* Current line */
+			bpl;		/* Bytes per line */
+  size_t		size;		/* Size of page bitmap */
+
+
+ /*
+  * Start the threads...
+  */
+
+  memset(&pipeline, 0, sizeof(pipeline));
+  pthread_mutex_init(&pipeline.mutex, NULL);
+  pthread_cond_init(&pipeline.cond, NULL);
+
+  pipeline.ppd       = ppd;
+  pipeline.num_pages = 2 * Threads + 2;
+
+  if ((pipeline.pages = calloc(pipeline.num_pages,
+                               sizeof(zpl_page_t))) == NULL)
+    return (-1);
+
+  for (i = 0; i < Threads; i ++)
+    if (pthread_create(encoders + i, NULL, ZPLEncodePages, &pipeline))
+      break;
+
+  Threads = i;
+
+  if (Threads == 0 ||
+      pthread_create(&writer, NULL, ZPLWritePages, &pipeline))
+  {
+    LabelLogDebug("Unable to start encoder threads, encoding pages one at "
+                  "a time.\n");
+
+    pipeline.done = 1;
+    pthread_cond_broadcast(&pipeline.cond);
+
+    for (i = 0; i < Threads; i ++)
+      pthread_join(encoders[i], NULL);
+
+    free(pipeline.pages);
+
+    Threads = 0;
+
+    return (-1);
+  }
+
+  LabelLogDebug("Encoding pages on %d threads.\n", Threads);
+
+ /*
+  * Idle encoder threads are lent out for band encoding...
+  */
+
+  SpareThreads = Threads;
+
+ /*
+  * Read pages into free buffers in the ring...
+  */
+
+  while (!Canceled)
+  {
+    pthread_mutex_lock(&pipeline.mutex);
+
+    while (pipeline.num_read - pipeline.num_written >= pipeline.num_pages)
+      pthread_cond_wait(&pipeline.cond, &pipeline.mutex);
+
+    page = pipeline.pages + pipeline.num_read % pipeline.num_pages;
+
+    pthread_mutex_unlock(&pipeline.mutex);
+
+    if (!RasterInReadHeader(ras, &(page->header)))
+      break;
+
+    bpl  = page->header.cupsBytesPerLine;
+    size = (size_t)bpl * page->header.cupsHeight;
+
+    if (size > page->size)
+    {
+      free(page->page);
+
+      if ((page->page = malloc(size)) == NULL)
+      {
+        fputs("ERROR: Unable to allocate memory for page.\n", stderr);
+	page->size = 0;
+	break;
+      }
+
+      page->size = size;
+    }
+
+    page->number = pipeline.num_read + 1;
+
+    for (y = 0; y < (int)page->header.cupsHeight && !Canceled; y ++)
+    {
+      LabelLogProgress(page->number, y, page->header.cupsHeight);
+
+      if (RasterInReadPixels(ras, page->page + (size_t)y * bpl, bpl) < 1)
+        break;
+    }
+
+    if (y < (int)page->header.cupsHeight)
+      memset(page->page + (size_t)y * bpl, 0,
+             (size_t)(page->header.cupsHeight - y) * bpl);
+
+    pthread_mutex_lock(&pipeline.mutex);
+    pipeline.num_read ++;
+    pthread_cond_broadcast(&pipeline.cond);
+    pthread_mutex_unlock(&pipeline.mutex);
+  }
+
+ /*
+  * Let the threads finish the pages that have been read...
+  */
+
+  pthread_mutex_lock(&pipeline.mutex);
+  pipeline.done = 1;
+  pthread_cond_broadcast(&pipeline.cond);
+  pthread_mutex_unlock(&pipeline.mutex);
+
+  for (i = 0; i < Threads; i ++)
+    pthread_join(encoders[i], NULL);
+
+  pthread_join(writer, NULL);
+
+  for (i = 0; i < pipeline.num_pages; i ++)
+  {
+    free(pipeline.pages[i].page);
+    free(pipeline.pages[i].data);
+  }
+
+  free(pipeline.pages);
+
+  pthread_cond_destroy(&pipeline.cond);
+  pthread_mutex_destroy(&pipeline.mutex);
+
+  return (pipeline.num_read);
+}
+
+
+/*
+ * 'ZPLEncodePages()' - Encode pages in an encoder thread.
+ */
+
+void *					/* O - Thread exit status */
+ZPLEncodePages(void *data)		/* I - Pipeline */
+{
+  zpl_pipeline_t	*pipeline = (zpl_pipeline_t *)data;
+					/* Pipeline */
+  zpl_page_t		*page;		/* Current page */
+  FILE			*fp;		/* Encoded graphics */
+  int			bpl,		/* Bytes per line */
+			rows,		/* Number of lines */
+			busy;		/* Spare threads taken */
+
+
+  pthread_mutex_lock(&pipeline->mutex);
+
+  for (;;)
+  {
+   /*
+    * Take the next page that has been read...
+    */
+
+    while (pipeline->num_taken >= pipeline->num_read && !pipeline->done)
+      pthread_cond_wait(&pipeline->cond, &pipeline->mutex);
+
+    if (pipeline->num_taken >= pipeline->num_read)
+      break;
+
+    page = pipeline->pages + pipeline->num_taken % pipeline->num_pages;
+    pipeline->num_taken ++;
+
+    pthread_mutex_unlock(&pipeline->mutex);
+
+   /*
+    * This thread is no longer spare while it encodes the page...
+    */
+
+    busy = ZPLReserveThreads(1);
+
+   /*
+    * Encode it the same way EndPage() would...
+    */
+
+    bpl  = page->header.cupsBytesPerLine;
+    rows = page->header.cupsHeight;
+
+    page->encoding = GraphicEncoding;
+    page->estimate = 0;
+    page->bytes    = 0;
+
+    if (GraphicEncoding == ZEBRA_GRF_AUTO)
+      page->encoding = ZPLChooseEncoding(page->page, bpl, rows, 1,
+                                         &(page->estimate));
+
+    for (page->last_inked = rows - 1;
+         page->last_inked >= 0 && Encoder->trim_margin >= 0;
+	 page->last_inked --)
+      if ((*LabelEncSpan)(page->page + (size_t)page->last_inked * bpl, bpl, 0) <
+              bpl)
+        break;
+
+   /*
+    * The writer encodes the page itself if there is no memory for it...
+    */
+
+    if (!Canceled && (fp = open_memstream(&(page->data),
+                                          &(page->length))) != NULL)
+    {
+      if (!Encoder->inline_graphics && (page->encoding == ZEBRA_GRF_ASCII ||
+                              page->encoding == ZEBRA_GRF_Z64))
+        page->bytes = ZPLWriteGraphic(fp, page->page, bpl, rows,
+	                              page->encoding);
+      else
+        page->bytes = ZPLWriteFields(fp, page->page, bpl, rows,
+	                             LabelEncBandRows(Encoder, bpl, rows), page->encoding);
+
+      fclose(fp);
+    }
+
+    ZPLReleaseThreads(busy);
+
+    pthread_mutex_lock(&pipeline->mutex);
+    page->encoded = 1;
+    pthread_cond_broadcast(&pipeline->cond);
+  }
+
+  pthread_mutex_unlock(&pipeline->mutex);
+
+  return (NULL);
+}
+
+
+/*
+ * 'ZPLWritePages()' - Write encoded pages in order in the writer thread.
+ */
+
+void *					/* O - Thread exit status */
+ZPLWritePages(void *data)		/* I - Pipeline */
+{
+  zpl_pipeline_t	*pipeline = (zpl_pipeline_t *)data;
+					/* Pipeline */
+  zpl_page_t		*page;		/* Current page */
+
+
+  pthread_mutex_lock(&pipeline->mutex);
+
+  for (;;)
+  {
+   /*
+    * Wait for the next page in order to be encoded...
+    */
+
+    page = pipeline->pages + pipeline->num_written % pipeline->num_pages;
+
+    while ((pipeline->num_written >= pipeline->num_read || !page->encoded) &&
+           !(pipeline->done && pipeline->num_written >= pipeline->num_read))
+      pthread_cond_wait(&pipeline->cond, &pipeline->mutex);
+
+    if (pipeline->num_written >= pipeline->num_read)
+      break;
+
+    pthread_mutex_unlock(&pipeline->mutex);
+
+   /*
+    * Send it and give the buffer back to the reader...
+    */
+
+    if (!Canceled)
+      ZPLWritePage(pipeline->ppd, page);
+
+    free(page->data);
+    page->data    = NULL;
+    page->length  = 0;
+
+    pthread_mutex_lock(&pipeline->mutex);
+    page->encoded = 0;
+    pipeline->num_written ++;
+    pthread_cond_broadcast(&pipeline->cond);
+  }
+
+  pthread_mutex_unlock(&pipeline->mutex);
+
+  return (NULL);
+}
+
+
+/*
+ * 'ZPLWritePage()' - Write an encoded page.
+ *
+ * The output is the same as StartPage() and EndPage() send for a buffered
+ * page.
+ */
+
+void
+ZPLWritePage(labelppd_t *ppd,		/* I - PPD file */
+             zpl_page_t *page)		/* I - Page */
+{
+  cups_page_header2_t	*header = &(page->header);
+					/* Page header */
+  int			download;	/* Non-zero to download graphics */
+  static const char * const encodings[] =
+			{		/* Graphic encoding names */
+			  "ASCII",
+			  "Z64",
+			  "HEX",
+			  "BINARY"
+			};
+
+
+  (void)ppd;
+
+  if (FlowFormats)
+    ZPLWaitPrinter();
+
+  fprintf(stderr, "PAGE: %d 1\n", page->number);
+
+  download = !Encoder->inline_graphics && (page->encoding == ZEBRA_GRF_ASCII ||
+                                 page->encoding == ZEBRA_GRF_Z64);
+
+ /*
+  * Set darkness...
+  */
+
+  if (header->cupsCompression > 0 && header->cupsCompression <= 100)
+    printf("~SD%02d\n", 30 * header->cupsCompression / 100);
+
+ /*
+  * Download the graphics or send them in the label...
+  */
+
+  if (download)
+  {
+    printf("~DGR:CUPS.GRF,%d,%d,",
+	   header->cupsHeight * header->cupsBytesPerLine,
+	   header->cupsBytesPerLine);
+    if (page->data)
+      fwrite(page->data, 1, page->length, stdout);
+    else
+      page->bytes = ZPLWriteGraphic(stdout, page->page,
+                                    header->cupsBytesPerLine,
+				    header->cupsHeight, page->encoding);
+
+    putchar('\n');
+  }
+
+  LabelEncStartLabel(Encoder, header, 0, page->last_inked);
+
+  if (download)
+  {
+    puts("^FO0,0^XGR:CUPS.GRF,1,1^FS");
+    puts("^IDR:CUPS.GRF^FS");
+  }
+  else if (page->data)
+    fwrite(page->data, 1, page->length, stdout);
+  else
+    page->bytes = ZPLWriteFields(stdout, page->page, header->cupsBytesPerLine,
+                                 header->cupsHeight,
+				 LabelEncBandRows(Encoder,
+				                  header->cupsBytesPerLine,
+				                  header->cupsHeight),
+				 page->encoding);
+
+  if (GraphicEncoding == ZEBRA_GRF_AUTO && page->bytes)
+    LabelLogDebug("ZPL graphic encoding %s, estimated %d bytes, "
+                  "actual %d bytes\n", encodings[page->encoding],
+		  page->estimate, page->bytes);
+
+  if (Encoder->kiosk)
+    puts("^XZ^XA^CN0^PN1^XZ");
+
+  LabelOutFlush();
+}
+
+
+/*
+ * 'ZPLReserveThreads()' - Reserve spare threads for band encoding.
+ */
+
+int					/* O - Number of threads reserved */
+ZPLReserveThreads(int count)		/* I - Number of threads wanted */
+{
+  pthread_mutex_lock(&SpareLock);
+
+  if (count > SpareThreads)
+    count = SpareThreads > 0 ? SpareThreads : 0;
+
+  SpareThreads -= count;
+
+  pthread_mutex_unlock(&SpareLock);
+
+  return (count);
+}
+
+
+/*
+ * 'ZPLReleaseThreads()' - Return spare threads.
+ */
+
+void
+ZPLReleaseThreads(int count)		/* I - Number of threads */
+{
+  pthread_mutex_lock(&SpareLock);
+  SpareThreads += count;
+  pthread_mutex_unlock(&SpareLock);
+}
+
+
+/*
+ * 'ZPLReadStatus()' - Ask the printer for its host status.
+ *
+ * The ~HS reply is three strings framed by STX and ETX; only the first two
+ * are used.
+ */
+
+int					/* O - 0 on success, -1 on error */
+ZPLReadStatus(zpl_status_t *status)	/* O - Printer status */
+{
+  ssize_t	bytes;			/* Bytes read */
+  size_t	total;			/* Total bytes read */
+  int		strings;		/* Number of strings read */
+  char		reply[1024],		/* Status reply */
+		*string1,		/* First string */
+		*string2,		/* Second string */
+		*ptr;			/* Pointer into reply */
+
+
+ /*
+  * Discard anything left over from an earlier query that timed out...
+  */
+
+  while (cupsBackChannelRead(reply, sizeof(reply), 0.0) > 0);
+
+  fputs("~HS\n", stdout);
+  LabelOutFlush();
+
+ /*
+  * Read the reply, which ends with the third ETX character...
+  */
+
+  for (total = 0, strings = 0; strings < 3 && total < sizeof(reply) - 1;
+       total += bytes)
+  {
+    if ((bytes = cupsBackChannelRead(reply + total, sizeof(reply) - total - 1,
+                                     total ? 1.0 : ZPL_STATUS_WAIT)) <= 0)
+      break;
+
+    for (ptr = reply + total; ptr < reply + total + bytes; ptr ++)
+      if (*ptr == 3)
+        strings ++;
+  }
+
+  reply[total] = '\0';
+
+ /*
+  * String 1 is "aaa,b,c,dddd,eee,f,..." and string 2 is "mmm,n,o,p,..."...
+  */
+
+  memset(status, 0, sizeof(zpl_status_t));
+
+  if ((string1 = strchr(reply, 2)) == NULL ||
+      (string2 = strchr(string1 + 1, 2)) == NULL ||
+      sscanf(string1 + 1, "%*d,%d,%d,%*d,%d,%d", &(status->paper_out),
+             &(status->paused), &(status->formats),
+	     &(status->buffer_full)) != 4 ||
+      sscanf(string2 + 1, "%*d,%*d,%d,%d", &(status->head_up),
+             &(status->ribbon_out)) != 2)
+    return (-1);
+
+  return (0);
+}
+
+
+/*
+ * 'ZPLWaitPrinter()' - Wait until the printer can take another label.
+ *
+ * Output is held while the printer is out of media or ribbon, paused, or
+ * has its head open, and while its receive buffer is full or holds
+ * FlowFormats label formats.  The conditions that need attention are
+ * reported as printer-state-reasons.  Flow control is turned off for the
+ * rest of the job if the printer does not answer.
+ */
+
+void
+ZPLWaitPrinter(void)
+{
+  int		i;			/* Looping var */
+  zpl_status_t	status;			/* Printer status */
+  unsigned	held,			/* Reasons the printer is held */
+		reasons = 0;		/* Reasons reported */
+  int		waiting = 0;		/* Non-zero once we have waited */
+  static const char * const names[] =
+		{			/* printer-state-reasons keywords */
+		  "media-empty-error",
+		  "paused",
+		  "cover-open-error",
+		  "marker-supply-empty-error"
+		};
+
+
+  while (!Canceled)
+  {
+    if (ZPLReadStatus(&status))
+    {
+      LabelLogDebug("No host status from printer, turning flow control "
+                    "off.\n");
+      FlowFormats = 0;
+      break;
+    }
+
+    held = (status.paper_out ? 1 : 0) | (status.paused ? 2 : 0) |
+           (status.head_up ? 4 : 0) | (status.ribbon_out ? 8 : 0);
+
+    for (i = 0; i < 4; i ++)
+      if ((held ^ reasons) & (1 << i))
+        fprintf(stderr, "STATE: %c%s\n", (held & (1 << i)) ? '+' : '-',
+	        names[i]);
+
+    reasons = held;
+
+    if (!held && !status.buffer_full && status.formats < FlowFormats)
+      break;
+
+    if (!waiting)
+    {
+      LabelLogDebug("Waiting for printer, %d formats queued%s.\n",
+                    status.formats, status.buffer_full ? ", buffer full" : "");
+      waiting = 1;
+    }
+
+    usleep(ZPL_STATUS_POLL);
+  }
+
+ /*
+  * Clear anything still reported if we stopped waiting early...
+  */
+
+  for (i = 0; i < 4; i ++)
+    if (reasons & (1 << i))
+      fprintf(stderr, "STATE: -%s\n", names[i]);
+}
+
+
+/*
+ * 'BatchKey()' - Compute the batch key for the queue and its options.
+ *
+ * Only jobs for the same queue, PPD file and marked choices can share a
+ * batcher.
+ */
+
+void
+BatchKey(labelppd_t *ppd,		/* I - PPD file */
+         char       *key,		/* O - Batch key */
+	 int        keysize)		/* I - Size of key buffer */
+{
+  int		i;			/* Looping var */
+  const char	*keyword,		/* Current option */
+		*choice;		/* Marked choice */
+  const char	*ptr;			/* Pointer into string */
+  unsigned	hash = 2166136261U;	/* FNV-1a hash of options */
+  char		temp[256];		/* keyword=choice */
+
+
+  if ((ptr = getenv("PPD")) != NULL)
+    for (; *ptr; ptr ++)
+      hash = (hash ^ (*ptr & 255)) * 16777619U;
+
+  for (i = 0; (keyword = LabelPPDKeyword(ppd, i)) != NULL; i ++)
+    if ((choice = LabelPPDChoice(ppd, keyword)) != NULL)
+    {
+      snprintf(temp, sizeof(temp), "\n%s=%s", keyword, choice);
+
+      for (ptr = temp; *ptr; ptr ++)
+	hash = (hash ^ (*ptr & 255)) * 16777619U;
+    }
+
+  snprintf(key, keysize, "%s-%08x", getenv("PRINTER"), hash);
+}
+
+
+/*
+ * 'PrintJob()' - Print the pages of a raster file.
+ */
+
+int					/* O - Exit status */
+PrintJob(labelppd_t *ppd,		/* I - PPD file */
+         int        fd)			/* I - Raster file */
+{
+  raster_in_t		*ras;		/* Raster stream for printing */
+  cups_page_header2_t	header;		/* Page header from file */
+  int			y;		/* Current line */
+
+
+ /*
+  * Read the raster data directly, or through libcups if asked...
+  */
+
+  ras = RasterInOpen(fd, LabelPPDIsMarked(ppd, "zeRasterReader", "CUPS"));
+
+ /*
+  * Process pages as needed...
+  */
+
+  Page = 0;
+
+  if (Threads > 0 && (Page = ZPLPipeline(ras, ppd)) < 0)
+    Page = 0;
+
+  while (!Threads && RasterInReadHeader(ras, &header))
+  {
+   /*
+    * Write a status message with the page number and number of copies.
+    */
+
+    if (Canceled)
+      break;
+
+    Page ++;
+
+    fprintf(stderr, "PAGE: %d 1\n", Page);
+
+   /*
+    * Start the page...
+    */
+
+    StartPage(ppd, &header);
+
+   /*
+    * Loop for each line on the page...
+    */
+
+    for (y = 0; y < header.cupsHeight && !Canceled; y ++)
+    {
+     /*
+      * Let the user know how far we have progressed...
+      */
+
+      if (Canceled)
+	break;
+
+      LabelLogProgress(Page, y, header.cupsHeight);
+
+     /*
+      * Read a line of graphics...
+      */
+
+      if (RasterInReadPixels(ras, Buffer, header.cupsBytesPerLine) < 1)
+        break;
+
+     /*
+      * Write it to the printer...
+      */
+
+      OutputLine(ppd, &header, y);
+    }
+
+   /*
+    * Clear the lines of a short page, since page buffers are reused...
+    */
+
+    if (PageBuffer && y < (int)header.cupsHeight)
+      memset(PageBuffer + (size_t)y * header.cupsBytesPerLine, 0,
+             (size_t)(header.cupsHeight - y) * header.cupsBytesPerLine);
+
+   /*
+    * Eject the page...
+    */
+
+    EndPage(ppd, &header);
+
+    if (Canceled)
+      break;
+  }
+
+ /*
+  * Close the raster stream...
+  */
+
+  RasterInClose(ras);
+
+ /*
+  * Finish the last label of an incremental job...
+  */
+
+  if (PendingLabel)
+  {
+    puts("^MCY");
+    PageKeep(PrevBuffer, PrevSize);
+
+    PrevBuffer   = NULL;
+    PendingLabel = 0;
+  }
+
+ /*
+  * Save the graphic cache index...
+  */
+
+  if (CacheDrive && !Canceled)
+    ZPLCacheSave();
+
+ /*
+  * If no pages were printed, send an error message...
+  */
+
+  if (Page == 0)
+    fputs(_("ERROR: No pages found!\n"), stderr);
+  else
+    fputs(_("INFO: Ready to print.\n"), stderr);
+
+  return (Page == 0);
+}
+
+
+/*
+ * 'Serve()' - Print jobs handed over by labelshim until stopped.
+ *
+ * Jobs arrive on a socket named for the queue in $LABELD_DIR, each with
+ * its own files, arguments and environment.  The PPD snapshot stays open
+ * while jobs name the same unchanged PPD file and the output buffers are
+ * kept, so a job only costs its printer setup and pages.
+ */
+
+int					/* O - Exit status */
+Serve(const char *queue)		/* I - Queue name */
+{
+  labelppd_t		*ppd = NULL;	/* PPD file */
+  char			**args;		/* Job arguments */
+  int			status;		/* Exit status of job */
+  int			num_options;	/* Number of options */
+  cups_option_t		*options;	/* Options */
+  const char		*dir;		/* LABELD_DIR env var */
+  char			path[1024];	/* Socket filename */
+
+
+  if ((dir = getenv("LABELD_DIR")) == NULL)
+    dir = LABELD_DIR;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, queue);
+
+  if (LabelBatchServe(path))
+  {
+    fprintf(stderr, "ERROR: Unable to serve jobs on \"%s\": %s\n", path,
+            strerror(errno));
+    return (1);
+  }
+
+  LabelLogDebug("Serving jobs on \"%s\".\n", path);
+
+ /*
+  * Each job's output must be written before the next job takes over the
+  * standard output, as in a batcher...
+  */
+
+  BatchWindow = -1;
+
+  while (LabelBatchNext(-1, CancelJob) >= 0)
+  {
+    if ((args = LabelBatchArgs()) == NULL)
+    {
+      LabelBatchDone(1);
+      continue;
+    }
+
+    LabelLogStart();
+
+    num_options = cupsParseOptions(args[5], 0, &options);
+
+    if (LabelPPDCurrent(ppd, getenv("PPD")))
+      LabelPPDMark(ppd, num_options, options);
+    else
+    {
+      LabelPPDClose(ppd);
+      ppd = LabelPPDOpen(getenv("PPD"), num_options, options);
+    }
+
+    cupsFreeOptions(num_options, options);
+
+    Canceled = 0;
+
+    Setup(ppd);
+    status = PrintJob(ppd, 0);
+    LabelOutEnd(Canceled);
+
+   /*
+    * A canceled job may have stopped in the middle of a download, so
+    * check the graphic cache against the printer again...
+    */
+
+    if (Canceled)
+      CacheSynced[0] = '\0';
+
+    LabelBatchDone(status);
+  }
+
+  LabelPPDClose(ppd);
+
+  return (0);
+}
+
+
+/*
+ * 'main()' - Main entry and processing of driver.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line arguments */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int			fd;		/* File descriptor */
+  int			status;		/* Exit status */
+  int			batch;		/* LabelBatchJoin() result */
+  labelppd_t		*ppd;		/* PPD file */
+  const char		*choice;	/* Marked choice */
+  int			num_options;	/* Number of options */
+  cups_option_t		*options;	/* Options */
+  char			key[256];	/* Batch key */
+#if defined(HAVE_SIGACTION) && !defined(HAVE_SIGSET)
+  struct sigaction action;		/* Actions for POSIX signals */
+#endif /* HAVE_SIGACTION && !HAVE_SIGSET */
+
+
+ /*
+  * Make sure status messages are not buffered...
+  */
+
+  setbuf(stderr, NULL);
+
+ /*
+  * Serve a queue for labelshim...
+  */
+
+  if (argc == 3 && !strcmp(argv[1], "-d"))
+    return (Serve(argv[2]));
+
+ /*
+  * Check command-line...
+  */
+
+  if (argc < 6 || argc > 7)
+  {
+   /*
+    * We don't have the correct number of arguments; write an error message
+    * and return.
+    */
+
+    fprintf(stderr, _("Usage: %s job-id user title copies options [file]\n"),
+            argv[0]);
+    fprintf(stderr, _("       %s -d queue\n"), argv[0]);
+    return (1);
+  }
+
+ /*
+  * Open the page stream...
+  */
+
+  if (argc == 7)
+  {
+    if ((fd = open(argv[6], O_RDONLY)) == -1)
+    {
+      perror("ERROR: Unable to open raster file - ");
+      sleep(1);
+      return (1);
+    }
+  }
+  else
+    fd = 0;
+
+ /*
+  * Register a signal handler to eject the current page if the
+  * job is cancelled.
+  */
+
+  Canceled = 0;
+
+#ifdef HAVE_SIGSET /* Use System V signals over POSIX to avoid bugs */
+  sigset(SIGTERM, CancelJob);
+#elif defined(HAVE_SIGACTION)
+  memset(&action, 0, sizeof(action));
+
+  sigemptyset(&action.sa_mask);
+  action.sa_handler = CancelJob;
+  sigaction(SIGTERM, &action, NULL);
+#else
+  signal(SIGTERM, CancelJob);
+#endif /* HAVE_SIGSET */
+
+ /*
+  * Only log what the scheduler will keep...
+  */
+
+  LabelLogStart();
+
+ /*
+  * Open the PPD file and apply options...
+  */
+
+  num_options = cupsParseOptions(argv[5], 0, &options);
+
+  ppd = LabelPPDOpen(getenv("PPD"), num_options, options);
+
+ /*
+  * Hand the job to the batcher for this queue and these options; the
+  * first job starts one, which runs jobs until none arrives within the
+  * batch window...
+  */
+
+  if ((choice = LabelPPDChoice(ppd, "zeBatchWindow")) != NULL &&
+      (BatchWindow = atoi(choice)) > 0 && getenv("PRINTER"))
+  {
+    BatchKey(ppd, key, sizeof(key));
+
+    if ((batch = LabelBatchJoin(key, fd, &status)) == 0)
+    {
+      for (status = -1; LabelBatchNext(BatchWindow, CancelJob) >= 0;)
+      {
+        if (status < 0)
+	  Setup(ppd);
+
+        Canceled = 0;
+	status   = PrintJob(ppd, 0);
+
+	LabelOutFlush();
+	LabelBatchDone(status);
+      }
+
+      if (status >= 0)
+        LabelOutEnd(Canceled);
+
+      LabelPPDClose(ppd);
+      cupsFreeOptions(num_options, options);
+
+      return (0);
+    }
+    else if (batch > 0)
+    {
+      LabelPPDClose(ppd);
+      cupsFreeOptions(num_options, options);
+
+      return (status);
+    }
+
+    LabelLogDebug("No batcher for this job, printing it here.\n");
+
+    BatchWindow = 0;
+  }
+
+ /*
+  * Initialize the print device...
+  */
+
+  Setup(ppd);
+
+ /*
+  * Print the pages...
+  */
+
+  status = PrintJob(ppd, fd);
+
+  if (fd != 0)
+    close(fd);
+
+ /*
+  * Send the rest of the job...
+  */
+
+  LabelOutEnd(Canceled);
+
+ /*
+  * Close the PPD file and free the options...
+  */
+
+  LabelPPDClose(ppd);
+  cupsFreeOptions(num_options, options);
+
+  return (status);
+}
+
+
+/*
+ * End of "$Id: rastertolabel.c,v 1.5 2010/12/08 11:39:18 mwilner Exp $".
+ */
@@ -0,0 +1,7 @@
+      3 warning: "/*" within comment [-Wcomment]
+      1 warning: 'endJobCommand' defined but not used [-Wunused-const-variable=]
+      5 warning: comparison of integer expressions of different signedness: 'int' and 'unsigned int' [-Wsign-compare]
+      1 warning: comparison of integer expressions of different signedness: 'unsigned int' and 'int' [-Wsign-compare]
+      1 warning: implicit declaration of function 'close'; did you mean 'pclose'? [-Wimplicit-function-declaration]
+      1 warning: implicit declaration of function 'sleep' [-Wimplicit-function-declaration]
+      1 warning: unused parameter 'header' [-Wunused-parameter]
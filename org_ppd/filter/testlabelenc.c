@@ -0,0 +1,517 @@
+/*
+ * "$Id$"
+ *
+ *   Label encoder test program.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ *
+ *   Usage:
+ *
+ *     testlabelenc [-v]
+ *
+ *   Build with "cc -o testlabelenc testlabelenc.c labelenc.c -lcups
+ *   -lpthread".  Encodes edge-case lines with LabelEncZPLLine() and checks
+ *   that LabelEncZPLDecode() gives back the same pixels, including lines
+ *   ending in runs of 0's (',') and F's ('!'), for lines of 1, odd and
+ *   the largest number of bytes.  Then encodes whole ZPL pages, as a ~DG
+ *   download and as banded ^GF fields, and decodes every line of the
+ *   output, so lines repeating the previous one (':') are checked too.
+ *
+ * Contents:
+ *
+ *   main()        - Run the encoder tests.
+ *   check_line()  - Encode and decode one line.
+ *   check_page()  - Encode and decode a page.
+ *   fill_line()   - Fill a line with a test pattern.
+ *   line_length() - Find the end of an encoded line in ZPL output.
+ *   page_sink()   - Gather encoder output in memory.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "labelenc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/*
+ * Constants...
+ */
+
+#define TEST_MAX_BPL	4000		/* Widest line, ^PW32000 at 1 bit */
+#define TEST_ROWS	24		/* Rows in a test page */
+
+enum					/* Line patterns */
+{
+  PAT_ZEROS,				/* All 0's */
+  PAT_ONES,				/* All F's */
+  PAT_ZERO_TAIL,			/* Ink then 0's */
+  PAT_ONE_TAIL,				/* Ink then F's */
+  PAT_ODD_ZERO_TAIL,			/* Ink ending with a 0 nibble, then 0's */
+  PAT_ODD_ONE_TAIL,			/* Ink ending with an F nibble, then F's */
+  PAT_LAST_INK,				/* 0's then one inked nibble */
+  PAT_LONG_RUN,				/* One run of 5's over the whole line */
+  PAT_RUNS,				/* Runs of 19 to 401 nibbles */
+  PAT_ALTERNATE,			/* No repeated nibbles */
+  PAT_RANDOM,				/* Random bytes */
+  PAT_COUNT
+};
+
+
+/*
+ * Types...
+ */
+
+typedef struct page_buffer_s		/**** Encoder output ****/
+{
+  char		*data;			/* Output */
+  size_t	length,			/* Bytes of output */
+		size;			/* Allocated bytes */
+} page_buffer_t;
+
+
+/*
+ * Local globals...
+ */
+
+static int	Verbose = 0;		/* Show encoded lines? */
+static const char * const Patterns[PAT_COUNT] =
+{					/* Pattern names */
+  "zeros", "ones", "zero tail", "one tail", "odd zero tail",
+  "odd one tail", "last ink", "long run", "runs", "alternate", "random"
+};
+
+
+/*
+ * Local functions...
+ */
+
+static int	check_line(int pattern, int bpl);
+static int	check_page(int bpl, const char *optstr);
+static void	fill_line(unsigned char *line, int bpl, int pattern);
+static int	line_length(const char *data, int datalen, int bpl);
+static int	page_sink(void *data, const void *buffer, size_t length);
+
+
+/*
+ * 'main()' - Run the encoder tests.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line args */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		i, j;			/* Looping vars */
+  int		status = 0;		/* Exit status */
+  static const int widths[] =		/* Bytes per line to test */
+  {
+    1, 2, 7, 33, 203, TEST_MAX_BPL
+  };
+
+
+  for (i = 1; i < argc; i ++)
+    if (!strcmp(argv[i], "-v"))
+      Verbose = 1;
+
+  LabelEncInit();
+  srand(1);
+
+  fputs("LabelEncZPLLine: ", stdout);
+
+  for (i = 0; i < (int)(sizeof(widths) / sizeof(widths[0])); i ++)
+    for (j = 0; j < PAT_COUNT; j ++)
+      if (check_line(j, widths[i]))
+        status = 1;
+
+  if (!status)
+    puts("PASS");
+
+  for (i = 0; i < (int)(sizeof(widths) / sizeof(widths[0])); i ++)
+  {
+    printf("LabelEncWriteRow(%d bytes): ", widths[i]);
+
+    if (check_page(widths[i], "") || check_page(widths[i], "zeBandHeight=3"))
+      status = 1;
+    else
+      puts("PASS");
+  }
+
+  return (status);
+}
+
+
+/*
+ * 'check_line()' - Encode and decode one line.
+ */
+
+static int				/* O - 0 on success, -1 on failure */
+check_line(int pattern,			/* I - Line pattern */
+           int bpl)			/* I - Bytes per line */
+{
+  unsigned char	line[TEST_MAX_BPL],	/* Line to encode */
+		decoded[TEST_MAX_BPL],	/* Decoded line */
+		encoded[2 * TEST_MAX_BPL + 1];
+					/* Encoded line */
+  int		length;			/* Length of encoded line */
+  char		fill = 0;		/* Fill character that must end it */
+
+
+  fill_line(line, bpl, pattern);
+
+  length = LabelEncZPLLine(line, bpl, encoded);
+
+  if (Verbose)
+    printf("\n    %s, %d bytes: %.*s", Patterns[pattern], bpl,
+           length > 60 ? 60 : length, encoded);
+
+ /*
+  * Lines ending in at least a whole byte of 0's or F's must end with a
+  * fill character...
+  */
+
+  if (pattern == PAT_ZEROS ||
+      (bpl > 1 && (pattern == PAT_ZERO_TAIL || pattern == PAT_ODD_ZERO_TAIL)))
+    fill = ',';
+  else if (pattern == PAT_ONES ||
+           (bpl > 1 && (pattern == PAT_ONE_TAIL ||
+	                pattern == PAT_ODD_ONE_TAIL)))
+    fill = '!';
+
+  if (length < 1 || length > 2 * bpl)
+    printf("FAIL (%s, %d bytes: %d bytes encoded)\n", Patterns[pattern], bpl,
+           length);
+  else if (fill && encoded[length - 1] != fill)
+    printf("FAIL (%s, %d bytes: no '%c' at end)\n", Patterns[pattern], bpl,
+           fill);
+  else if (fill && (pattern == PAT_ODD_ZERO_TAIL ||
+                    pattern == PAT_ODD_ONE_TAIL) &&
+           (length < 2 || encoded[length - 2] != (fill == ',' ? '0' : 'F')))
+    printf("FAIL (%s, %d bytes: '%c' not on a byte boundary)\n",
+           Patterns[pattern], bpl, fill);
+  else if (LabelEncZPLDecode(encoded, length, NULL, decoded, bpl) != bpl ||
+           memcmp(decoded, line, bpl))
+    printf("FAIL (%s, %d bytes: does not decode to the line)\n",
+           Patterns[pattern], bpl);
+  else
+    return (0);
+
+  return (-1);
+}
+
+
+/*
+ * 'check_page()' - Encode and decode a page.
+ *
+ * The page repeats lines of the edge-case patterns so that ':' is used,
+ * and with banded fields some repeats fall on the first line of a field,
+ * where ':' must not be used.
+ */
+
+static int				/* O - 0 on success, -1 on failure */
+check_page(int        bpl,		/* I - Bytes per line */
+           const char *optstr)		/* I - Encoder options */
+{
+  int			y,		/* Current line */
+			length,		/* Length of encoded line */
+			colons = 0,	/* Lines encoded as ':' */
+			status = -1;	/* Return value */
+  int			num_options;	/* Number of options */
+  cups_option_t		*options = NULL;/* Options */
+  labelenc_t		*enc;		/* Encoder */
+  cups_page_header2_t	header;		/* Page header */
+  page_buffer_t		page;		/* Encoder output */
+  unsigned char		*lines,		/* Lines of the page */
+			*decoded;	/* Decoded line */
+  const unsigned char	*prev;		/* Previous decoded line */
+  char			*field,		/* Start of graphic field */
+			*ptr,		/* Pointer into output */
+			*end;		/* End of output */
+  static const int	rows[TEST_ROWS] =/* Pattern of each line, -1 = same */
+  {
+    PAT_ZEROS, -1, PAT_ZERO_TAIL, -1, PAT_ONES, PAT_ONE_TAIL, -1, -1,
+    PAT_ODD_ZERO_TAIL, PAT_RANDOM, -1, PAT_ODD_ONE_TAIL, PAT_LAST_INK,
+    PAT_ZEROS, PAT_RUNS, -1, -1, PAT_LONG_RUN, PAT_ALTERNATE, -1,
+    PAT_ZEROS, -1, -1, PAT_ONES
+  };
+
+
+  memset(&page, 0, sizeof(page));
+  memset(&header, 0, sizeof(header));
+
+  header.HWResolution[0]  = 203;
+  header.HWResolution[1]  = 203;
+  header.NumCopies        = 1;
+  header.cupsWidth        = 8 * bpl;
+  header.cupsHeight       = TEST_ROWS;
+  header.cupsBitsPerColor = 1;
+  header.cupsBitsPerPixel = 1;
+  header.cupsBytesPerLine = bpl;
+
+  if ((lines = malloc(TEST_ROWS * bpl)) == NULL ||
+      (decoded = malloc(bpl)) == NULL)
+  {
+    free(lines);
+    puts("FAIL (out of memory)");
+    return (-1);
+  }
+
+  for (y = 0; y < TEST_ROWS; y ++)
+    if (rows[y] < 0)
+      memcpy(lines + y * bpl, lines + (y - 1) * bpl, bpl);
+    else
+      fill_line(lines + y * bpl, bpl, rows[y]);
+
+ /*
+  * Encode the page...
+  */
+
+  num_options = cupsParseOptions(optstr, 0, &options);
+
+  if ((enc = LabelEncNew(page_sink, &page)) == NULL ||
+      LabelEncStartJob(enc, ZEBRA_ZPL, num_options, options) ||
+      LabelEncStartPage(enc, &header))
+  {
+    puts("FAIL (unable to start page)");
+    goto done;
+  }
+
+  for (y = 0; y < TEST_ROWS; y ++)
+    LabelEncWriteRow(enc, lines + y * bpl);
+
+  if (LabelEncEndPage(enc, 0) || page_sink(&page, "", 1))
+  {
+    puts("FAIL (unable to end page)");
+    goto done;
+  }
+
+ /*
+  * Decode every line of every graphic field...
+  */
+
+  page.length --;
+  end = page.data + page.length;
+
+  for (y = 0, ptr = page.data; y < TEST_ROWS; ptr = field)
+  {
+    if ((field = strstr(ptr, "~DGR:CUPS.GRF,")) == NULL &&
+        (field = strstr(ptr, "^GFA,")) == NULL)
+      break;
+
+    if ((field = strchr(field, '\n')) == NULL)
+      break;
+
+    for (field ++, prev = NULL;
+         field < end && *field != '^' && *field != '~' && y < TEST_ROWS;)
+    {
+      if (*field == '\n' || *field == '\r')
+      {
+        field ++;
+	continue;
+      }
+
+      length = line_length(field, end - field, bpl);
+
+      if (*field == ':')
+        colons ++;
+
+      if (LabelEncZPLDecode((unsigned char *)field, length, prev, decoded,
+                            bpl) != bpl ||
+	  memcmp(decoded, lines + y * bpl, bpl))
+      {
+        printf("FAIL (%s, line %d: \"%.*s\" does not decode to the line)\n",
+	       optstr[0] ? optstr : "~DG", y, length > 40 ? 40 : length,
+	       field);
+        goto done;
+      }
+
+      prev  = lines + y * bpl;
+      field += length;
+      y ++;
+    }
+  }
+
+  if (y < TEST_ROWS)
+    printf("FAIL (%s, %d of %d lines in output)\n", optstr[0] ? optstr : "~DG",
+           y, TEST_ROWS);
+  else if (!colons)
+    printf("FAIL (%s, no repeated lines)\n", optstr[0] ? optstr : "~DG");
+  else
+    status = 0;
+
+  done:
+
+  LabelEncDelete(enc);
+  cupsFreeOptions(num_options, options);
+  free(page.data);
+  free(lines);
+  free(decoded);
+
+  return (status);
+}
+
+
+/*
+ * 'fill_line()' - Fill a line with a test pattern.
+ */
+
+static void
+fill_line(unsigned char *line,		/* I - Line */
+          int           bpl,		/* I - Bytes per line */
+	  int           pattern)	/* I - Line pattern */
+{
+  int	i,				/* Looping var */
+	ink;				/* Bytes of ink */
+
+
+  ink = bpl / 2;
+
+  switch (pattern)
+  {
+    case PAT_ZEROS :
+        memset(line, 0x00, bpl);
+	break;
+
+    case PAT_ONES :
+        memset(line, 0xff, bpl);
+	break;
+
+    case PAT_ZERO_TAIL :
+    case PAT_ODD_ZERO_TAIL :
+        for (i = 0; i < bpl; i ++)
+	  line[i] = i < ink ? 0x11 * (i % 14 + 1) + 0x01 : 0x00;
+
+        line[ink > 0 ? ink - 1 : 0] = pattern == PAT_ZERO_TAIL ? 0x3c : 0x30;
+	break;
+
+    case PAT_ONE_TAIL :
+    case PAT_ODD_ONE_TAIL :
+        for (i = 0; i < bpl; i ++)
+	  line[i] = i < ink ? 0x11 * (i % 14) + 0x01 : 0xff;
+
+        line[ink > 0 ? ink - 1 : 0] = pattern == PAT_ONE_TAIL ? 0x3c : 0x3f;
+	break;
+
+    case PAT_LAST_INK :
+        memset(line, 0x00, bpl);
+	line[bpl - 1] = 0x01;
+	break;
+
+    case PAT_LONG_RUN :
+        memset(line, 0x55, bpl);
+	break;
+
+    case PAT_RUNS :
+        for (i = 0; i < bpl; i ++)
+	  switch (i % 400)
+	  {
+	    case 0 :
+	    case 10 :
+	    case 20 :
+	    case 221 :
+	        line[i] = 0x75;
+		break;
+
+	    default :
+	        line[i] = 0x55;
+		break;
+	  }
+	break;
+
+    case PAT_ALTERNATE :
+        for (i = 0; i < bpl; i ++)
+	  line[i] = (i & 1) ? 0xa5 : 0x5a;
+	break;
+
+    default :
+        for (i = 0; i < bpl; i ++)
+	  line[i] = rand();
+	break;
+  }
+}
+
+
+/*
+ * 'line_length()' - Find the end of an encoded line in ZPL output.
+ *
+ * A line ends with ':', ',' or '!', or after enough hex digits for the
+ * whole line.
+ */
+
+static int				/* O - Length of encoded line */
+line_length(const char *data,		/* I - ZPL output */
+            int        datalen,		/* I - Bytes of output */
+	    int        bpl)		/* I - Bytes per line */
+{
+  int	i,				/* Looping var */
+	nibbles,			/* Nibbles in line */
+	count;				/* Repeat count */
+
+
+  if (datalen > 0 && data[0] == ':')
+    return (1);
+
+  for (i = 0, nibbles = 0, count = 0; i < datalen; i ++)
+  {
+    if (data[i] >= 'G' && data[i] <= 'Y')
+      count += data[i] - 'F';
+    else if (data[i] >= 'g' && data[i] <= 'z')
+      count += 20 * (data[i] - 'f');
+    else if (data[i] == ',' || data[i] == '!')
+      return (i + 1);
+    else if ((data[i] >= '0' && data[i] <= '9') ||
+             (data[i] >= 'A' && data[i] <= 'F'))
+    {
+      nibbles += count ? count : 1;
+      count   = 0;
+
+      if (nibbles >= 2 * bpl)
+        return (i + 1);
+    }
+    else
+      break;
+  }
+
+  return (i);
+}
+
+
+/*
+ * 'page_sink()' - Gather encoder output in memory.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+page_sink(void       *data,		/* I - Output buffer */
+          const void *buffer,		/* I - Bytes to add */
+	  size_t     length)		/* I - Number of bytes */
+{
+  page_buffer_t	*page = (page_buffer_t *)data;
+					/* Output buffer */
+  char		*temp;			/* New buffer */
+
+
+  if (page->length + length > page->size)
+  {
+    if ((temp = realloc(page->data, page->size + length + 65536)) == NULL)
+      return (-1);
+
+    page->data = temp;
+    page->size += length + 65536;
+  }
+
+  memcpy(page->data + page->length, buffer, length);
+  page->length += length;
+
+  return (0);
+}
+
+
+/*
+ * End of "$Id$".
+ */
@@ -0,0 +1,349 @@
+/*
+ * "$Id$"
+ *
+ *   Label multiplexer test program.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ *
+ *   Usage:
+ *
+ *     testlabelmux [-v] [labelmux]
+ *
+ *   Build with "cc -o testlabelmux testlabelmux.c labelout.c labellog.c
+ *   -lpthread" and run from the directory holding labelmux.  Starts
+ *   labelmux for a network printer on the loopback interface that is not
+ *   listening yet, sends two jobs and a canceled job through the socket
+ *   sink in labelout.c, and then lets the printer accept.  The canceled
+ *   job must finish without the printer and none of its labels may reach
+ *   it; both other jobs must print all of their labels.
+ *
+ * Contents:
+ *
+ *   main()     - Run the multiplexer tests.
+ *   start_job() - Start a filter process that sends labels to the
+ *                 multiplexer.
+ *   wait_job() - Wait for a filter process to finish.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "labelout.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+
+/*
+ * Local globals...
+ */
+
+static int	Verbose = 0;		/* Show multiplexer messages? */
+
+
+/*
+ * Local functions...
+ */
+
+static pid_t	start_job(const char *name, int priority, int canceled);
+static int	wait_job(pid_t pid, int msec);
+
+
+/*
+ * 'main()' - Run the multiplexer tests.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line args */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int			i;		/* Looping var */
+  int			status;		/* Exit status */
+  const char		*labelmux;	/* Multiplexer program */
+  char			dir[] = "/tmp/testlabelmuxXXXXXX",
+					/* Socket directory */
+			sockname[1024],	/* Queue socket */
+			printer[256],	/* Printer address */
+			buffer[8192];	/* Data from multiplexer */
+  int			listener,	/* Printer socket */
+			fd;		/* Printer connection */
+  struct sockaddr_in	addr;		/* Printer address */
+  socklen_t		addrlen;	/* Length of address */
+  pid_t			mux,		/* Multiplexer process */
+			job1,		/* First job */
+			job2,		/* Second job */
+			job3;		/* Canceled job */
+  size_t		length;		/* Bytes received */
+  ssize_t		bytes;		/* Bytes read */
+  struct pollfd		pfd;		/* Printer poll entry */
+  struct stat		sockinfo;	/* Queue socket information */
+  static const char * const labels[] =	/* Labels that must print */
+  {
+    "job1-1", "job1-2", "job2-1", "job2-2"
+  };
+
+
+  labelmux = "./labelmux";
+
+  for (i = 1; i < argc; i ++)
+    if (!strcmp(argv[i], "-v"))
+      Verbose = 1;
+    else
+      labelmux = argv[i];
+
+  status = 0;
+
+  signal(SIGPIPE, SIG_IGN);
+
+ /*
+  * Bind the printer's port but don't listen yet, so the multiplexer holds
+  * every label until we say so...
+  */
+
+  if (!mkdtemp(dir))
+  {
+    perror("testlabelmux: Unable to create socket directory");
+    return (1);
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addrlen              = sizeof(addr);
+
+  if ((listener = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+      bind(listener, (struct sockaddr *)&addr, sizeof(addr)) ||
+      getsockname(listener, (struct sockaddr *)&addr, &addrlen))
+  {
+    perror("testlabelmux: Unable to bind printer socket");
+    rmdir(dir);
+    return (1);
+  }
+
+  snprintf(printer, sizeof(printer), "127.0.0.1:%d", ntohs(addr.sin_port));
+  snprintf(sockname, sizeof(sockname), "%s/testq", dir);
+
+  setenv("LABELMUX_DIR", dir, 1);
+  setenv("PRINTER", "testq", 1);
+
+  fflush(stdout);
+
+  if ((mux = fork()) == 0)
+  {
+    if (!Verbose)
+      freopen("/dev/null", "w", stderr);
+
+    execl(labelmux, "labelmux", printer, "testq", (char *)NULL);
+    _exit(127);
+  }
+
+  fputs("labelmux: ", stdout);
+
+  for (i = 0; i < 50 && stat(sockname, &sockinfo); i ++)
+    usleep(100000);
+
+  if (mux < 0 || i >= 50)
+  {
+    puts("FAIL (no queue socket)");
+    status = 1;
+    goto done;
+  }
+
+  puts("PASS");
+
+ /*
+  * Queue two jobs, then cancel a third with its labels still queued...
+  */
+
+  fputs("LabelOutMux: ", stdout);
+
+  job1 = start_job("job1", 1, 0);
+  job2 = start_job("job2", 1, 0);
+
+  usleep(200000);
+
+  job3 = start_job("job3", 1, 1);
+
+  if (job1 < 0 || job2 < 0 || job3 < 0)
+  {
+    puts("FAIL (unable to start jobs)");
+    status = 1;
+    goto done;
+  }
+
+  puts("PASS");
+
+  fputs("LabelOutEnd(canceled): ", stdout);
+
+  if (wait_job(job3, 5000))
+  {
+    puts("FAIL (canceled job not finished)");
+    status = 1;
+  }
+  else if (!wait_job(job1, 0) || !wait_job(job2, 0))
+  {
+    puts("FAIL (job finished before its labels were sent)");
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+ /*
+  * Let the printer accept and collect what the multiplexer sends...
+  */
+
+  fputs("printer: ", stdout);
+
+  if (listen(listener, 1) ||
+      (pfd.fd = accept(listener, NULL, NULL)) < 0)
+  {
+    printf("FAIL (%s)\n", strerror(errno));
+    status = 1;
+    goto done;
+  }
+
+  fd         = pfd.fd;
+  pfd.events = POLLIN;
+  length     = 0;
+
+  while (length < sizeof(buffer) - 1 && poll(&pfd, 1, 1000) > 0)
+  {
+    if ((bytes = read(fd, buffer + length, sizeof(buffer) - 1 - length)) <= 0)
+      break;
+
+    length += (size_t)bytes;
+  }
+
+  buffer[length] = '\0';
+
+  close(fd);
+
+  for (i = 0; i < (int)(sizeof(labels) / sizeof(labels[0])); i ++)
+    if (!strstr(buffer, labels[i]))
+      break;
+
+  if (i < (int)(sizeof(labels) / sizeof(labels[0])))
+  {
+    printf("FAIL (\"%s\" not printed)\n", labels[i]);
+    status = 1;
+  }
+  else if (strstr(buffer, "job3"))
+  {
+    puts("FAIL (canceled job printed)");
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+  fputs("LabelOutEnd: ", stdout);
+
+  if (wait_job(job1, 5000) || wait_job(job2, 5000))
+  {
+    puts("FAIL (job not finished)");
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+ /*
+  * Clean up...
+  */
+
+  done:
+
+  if (mux > 0)
+  {
+    kill(mux, SIGTERM);
+    waitpid(mux, NULL, 0);
+  }
+
+  close(listener);
+  unlink(sockname);
+  rmdir(dir);
+
+  return (status);
+}
+
+
+/*
+ * 'start_job()' - Start a filter process that sends labels to the
+ *                 multiplexer.
+ */
+
+static pid_t				/* O - Process ID or -1 on error */
+start_job(const char *name,		/* I - Job name */
+          int        priority,		/* I - Job priority */
+	  int        canceled)		/* I - Cancel the job at the end? */
+{
+  pid_t	pid;				/* Child process */
+  int	i;				/* Looping var */
+
+
+  fflush(stdout);
+
+  if ((pid = fork()) != 0)
+    return (pid);
+
+  if (!Verbose)
+    freopen("/dev/null", "w", stderr);
+
+  if (LabelOutMux(priority) || LabelOutStart(4096, 0, 0))
+    _exit(2);
+
+  printf("^XA^LH0,0^XZ\n");
+  LabelOutPreamble();
+
+  for (i = 1; i <= 2; i ++)
+  {
+    printf("^XA^FO10,10^FD%s-%d^FS^XZ\n", name, i);
+    LabelOutFlush();
+  }
+
+  LabelOutEnd(canceled);
+
+  exit(0);
+}
+
+
+/*
+ * 'wait_job()' - Wait for a filter process to finish.
+ */
+
+static int				/* O - 0 if finished OK, -1 otherwise */
+wait_job(pid_t pid,			/* I - Process ID */
+         int   msec)			/* I - Milliseconds to wait */
+{
+  int	status;				/* Exit status */
+
+
+  for (;;)
+  {
+    if (waitpid(pid, &status, WNOHANG) == pid)
+      return (WIFEXITED(status) && !WEXITSTATUS(status) ? 0 : -1);
+
+    if (msec <= 0)
+      return (-1);
+
+    usleep(10000);
+    msec -= 10;
+  }
+}
+
+
+/*
+ * End of "$Id$".
+ */
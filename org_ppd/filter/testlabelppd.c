@@ -0,0 +1,338 @@
+/*
+ * "$Id$"
+ *
+ *   PPD snapshot test and benchmark program.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ *
+ *   Usage:
+ *
+ *     testlabelppd [-n runs] [ppd-file [name=value ...]]
+ *
+ *   Build with "cc -o testlabelppd testlabelppd.c labelppd.c labellog.c
+ *   -lcups".  Marks every choice of every option, and every PageSize,
+ *   MediaType and InputSlot choice as "media", with ppdMarkDefaults() and
+ *   cupsMarkOptions() and with the PPD snapshot; both must mark the same
+ *   choice of each option.  Then times what a filter does at startup with
+ *   the given job options: ppdOpenFile(), ppdMarkDefaults() and
+ *   cupsMarkOptions(), against LabelPPDOpen() building a new snapshot
+ *   (cold) and mapping a saved one (warm).  The best time of "runs" opens
+ *   (default 20) is reported.  The PPD file defaults to
+ *   "../../Zebra_ZPL_EN_DE.ppd".
+ *
+ * Contents:
+ *
+ *   main()          - Compare and time the PPD readers.
+ *   check_marks()   - Compare the choices marked for a set of options.
+ *   clear_cache()   - Remove saved snapshots.
+ *   elapsed()       - Return the seconds since a start time.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "labelppd.h"
+#include <cups/ppd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+
+
+/*
+ * Local globals...
+ */
+
+static char		CacheDir[] = "/tmp/testlabelppdXXXXXX";
+					/* Snapshot directory */
+
+
+/*
+ * Local functions...
+ */
+
+static int	check_marks(ppd_file_t *ppd, labelppd_t *snap,
+		            int num_keywords, const char **keywords,
+			    const char *name, const char *value);
+static void	clear_cache(void);
+static double	elapsed(struct timespec *start);
+
+
+/*
+ * 'main()' - Compare and time the PPD readers.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line args */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int			i, j,		/* Looping vars */
+			run,		/* Current run */
+			runs = 20;	/* Number of runs */
+  int			status = 0;	/* Exit status */
+  const char		*filename = "../../Zebra_ZPL_EN_DE.ppd";
+					/* PPD file */
+  int			num_options = 0;/* Number of job options */
+  cups_option_t		*options = NULL;/* Job options */
+  ppd_file_t		*ppd;		/* PPD file */
+  ppd_option_t		*option;	/* Current option */
+  labelppd_t		*snap;		/* PPD snapshot */
+  int			num_keywords = 0;/* Number of options */
+  const char		**keywords = NULL;/* Option keywords */
+  int			sets = 0;	/* Option sets checked */
+  double		secs,		/* Time for this run */
+			best[3];	/* Best time for each reader */
+  struct timespec	start;		/* Start of run */
+  static const char * const names[] =	/* Reader names */
+  {
+    "libcups", "cold", "warm"
+  };
+  static const char * const media[] =	/* Options named by "media" */
+  {
+    "PageSize", "MediaType", "InputSlot"
+  };
+
+
+  for (i = 1; i < argc; i ++)
+  {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc)
+    {
+      if ((runs = atoi(argv[++ i])) < 1)
+        runs = 1;
+    }
+    else if (strchr(argv[i], '='))
+      num_options = cupsParseOptions(argv[i], num_options, &options);
+    else
+      filename = argv[i];
+  }
+
+  if (!mkdtemp(CacheDir))
+  {
+    perror("testlabelppd: Unable to create snapshot directory");
+    return (1);
+  }
+
+  setenv("CUPS_CACHEDIR", CacheDir, 1);
+
+  printf("%s:\n", filename);
+
+ /*
+  * Mark every choice both ways...
+  */
+
+  fputs("    marking : ", stdout);
+
+  if ((ppd = ppdOpenFile(filename)) == NULL ||
+      (snap = LabelPPDOpen(filename, 0, NULL)) == NULL)
+  {
+    puts("FAIL (unable to open PPD file)");
+    rmdir(CacheDir);
+    return (1);
+  }
+
+  for (option = ppdFirstOption(ppd); option; option = ppdNextOption(ppd))
+  {
+    if ((keywords = realloc(keywords, (num_keywords + 1) *
+                                      sizeof(const char *))) == NULL)
+      break;
+
+    keywords[num_keywords ++] = option->keyword;
+  }
+
+  if (check_marks(ppd, snap, num_keywords, keywords, NULL, NULL))
+    status = 1;
+
+  for (i = 0; i < num_keywords && !status; i ++)
+  {
+    option = ppdFindOption(ppd, keywords[i]);
+
+    for (j = 0; j < option->num_choices && !status; j ++, sets ++)
+    {
+      if (check_marks(ppd, snap, num_keywords, keywords, option->keyword,
+                      option->choices[j].choice))
+        status = 1;
+
+      if (!strcmp(option->keyword, media[0]) ||
+          !strcmp(option->keyword, media[1]) ||
+          !strcmp(option->keyword, media[2]))
+      {
+        sets ++;
+
+	if (check_marks(ppd, snap, num_keywords, keywords, "media",
+	                option->choices[j].choice))
+	  status = 1;
+      }
+    }
+  }
+
+  if (!status && LabelPPDKeyword(snap, num_keywords - 1) &&
+      !LabelPPDKeyword(snap, num_keywords))
+    printf("PASS, %d options, %d option sets\n", num_keywords, sets + 1);
+  else if (!status)
+  {
+    puts("FAIL (snapshot has a different number of options)");
+    status = 1;
+  }
+
+  LabelPPDClose(snap);
+  ppdClose(ppd);
+  free(keywords);
+
+ /*
+  * Time what a filter does at startup...
+  */
+
+  for (i = 0; i < 3; i ++)
+  {
+    best[i] = -1.0;
+
+    for (run = 0; run < runs; run ++)
+    {
+      if (i == 1)
+        clear_cache();
+
+      clock_gettime(CLOCK_MONOTONIC, &start);
+
+      if (i == 0)
+      {
+        if ((ppd = ppdOpenFile(filename)) == NULL)
+	  break;
+
+        ppdMarkDefaults(ppd);
+	cupsMarkOptions(ppd, num_options, options);
+	ppdClose(ppd);
+      }
+      else
+      {
+        if ((snap = LabelPPDOpen(filename, num_options, options)) == NULL)
+	  break;
+
+	LabelPPDClose(snap);
+      }
+
+      secs = elapsed(&start);
+
+      if (best[i] < 0.0 || secs < best[i])
+        best[i] = secs;
+    }
+
+    printf("    %-8s: ", names[i]);
+
+    if (best[i] < 0.0)
+    {
+      puts("FAIL (unable to open PPD file)");
+      status = 1;
+    }
+    else
+      printf("PASS, %.3f ms (%.2fx)\n", 1000.0 * best[i],
+             best[i] > 0.0 ? best[0] / best[i] : 0.0);
+  }
+
+  clear_cache();
+  rmdir(CacheDir);
+  cupsFreeOptions(num_options, options);
+
+  return (status);
+}
+
+
+/*
+ * 'check_marks()' - Compare the choices marked for a set of options.
+ */
+
+static int				/* O - 0 if the same, -1 otherwise */
+check_marks(ppd_file_t  *ppd,		/* I - PPD file */
+            labelppd_t  *snap,		/* I - PPD snapshot */
+	    int         num_keywords,	/* I - Number of options */
+	    const char  **keywords,	/* I - Option keywords */
+	    const char  *name,		/* I - Option name or NULL */
+	    const char  *value)		/* I - Option value */
+{
+  int		i;			/* Looping var */
+  int		num_options = 0;	/* Number of job options */
+  cups_option_t	*options = NULL;	/* Job options */
+  ppd_choice_t	*marked;		/* Choice marked by libcups */
+  const char	*choice;		/* Choice marked in snapshot */
+
+
+  if (name)
+    num_options = cupsAddOption(name, value, num_options, &options);
+
+  ppdMarkDefaults(ppd);
+  cupsMarkOptions(ppd, num_options, options);
+  LabelPPDMark(snap, num_options, options);
+
+  cupsFreeOptions(num_options, options);
+
+  for (i = 0; i < num_keywords; i ++)
+  {
+    marked = ppdFindMarkedChoice(ppd, keywords[i]);
+    choice = LabelPPDChoice(snap, keywords[i]);
+
+    if (marked ? !choice || strcmp(marked->choice, choice) : choice != NULL)
+    {
+      printf("FAIL (%s=%s marks %s=%s, snapshot %s)\n",
+             name ? name : "defaults", name ? value : "",
+	     keywords[i], marked ? marked->choice : "(none)",
+	     choice ? choice : "(none)");
+      return (-1);
+    }
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'clear_cache()' - Remove saved snapshots.
+ */
+
+static void
+clear_cache(void)
+{
+  DIR		*dir;			/* Snapshot directory */
+  struct dirent	*dent;			/* Directory entry */
+  char		path[1024];		/* Snapshot filename */
+
+
+  if ((dir = opendir(CacheDir)) == NULL)
+    return;
+
+  while ((dent = readdir(dir)) != NULL)
+    if (dent->d_name[0] != '.')
+    {
+      snprintf(path, sizeof(path), "%s/%s", CacheDir, dent->d_name);
+      unlink(path);
+    }
+
+  closedir(dir);
+}
+
+
+/*
+ * 'elapsed()' - Return the seconds since a start time.
+ */
+
+static double				/* O - Seconds */
+elapsed(struct timespec *start)		/* I - Start time */
+{
+  struct timespec	end;		/* End time */
+
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  return (end.tv_sec - start->tv_sec + 0.000000001 * (end.tv_nsec -
+                                                      start->tv_nsec));
+}
+
+
+/*
+ * End of "$Id$".
+ */
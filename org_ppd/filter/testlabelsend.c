@@ -0,0 +1,499 @@
+/*
+ * "$Id$"
+ *
+ *   Raw socket sender test program.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ *
+ *   Usage:
+ *
+ *     testlabelsend [-v] [labelsend]
+ *
+ *   Build with "cc -o testlabelsend testlabelsend.c" and run from the
+ *   directory holding labelsend.  Runs labelsend against a fake printer
+ *   on the loopback interface:
+ *
+ *     - An EPL job must be sent without ~HS status queries and without
+ *       waiting for a status reply.
+ *     - A ZPL job must be held while the printer reports it is out of
+ *       media or its head is open.
+ *     - When the printer goes offline after the first label, labelsend
+ *       must reconnect once it is back and send the remaining labels.
+ *
+ * Contents:
+ *
+ *   main()           - Run the sender tests.
+ *   printer_listen() - Listen for labelsend on the fake printer's port.
+ *   printer_serve()  - Accept a connection and act as a ZPL printer.
+ *   start_send()     - Start labelsend for a job file.
+ *   wait_send()      - Wait for labelsend to finish.
+ *   write_job()      - Write a job file.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+
+/*
+ * Constants...
+ */
+
+#define TS_READY	0		/* Printer ready */
+#define TS_PAPER_OUT	1		/* Printer out of media */
+#define TS_HEAD_OPEN	2		/* Printer head open */
+
+
+/*
+ * Local globals...
+ */
+
+static const char *LabelSend = "./labelsend";
+					/* Sender program */
+static int	Verbose = 0;		/* Show sender messages? */
+static int	Port = 0;		/* Fake printer port */
+
+
+/*
+ * Local functions...
+ */
+
+static int	printer_listen(void);
+static int	printer_serve(int listener, const int *states, int labels,
+		              char *buffer, size_t bufsize);
+static pid_t	start_send(const char *filename);
+static int	wait_send(pid_t pid, int msec);
+static int	write_job(const char *filename, const char *data);
+
+
+/*
+ * 'main()' - Run the sender tests.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line args */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		i;			/* Looping var */
+  int		status;			/* Exit status */
+  int		listener;		/* Fake printer socket */
+  int		queries;		/* ~HS queries answered */
+  pid_t		pid;			/* labelsend process */
+  char		dir[] = "/tmp/testlabelsendXXXXXX",
+					/* Job directory */
+		eplfile[1024],		/* EPL job file */
+		zplfile[1024],		/* ZPL job file */
+		first[8192],		/* Data before going offline */
+		second[8192];		/* Data after coming back */
+  struct timespec start,		/* Start of EPL job */
+		end;			/* End of EPL job */
+  long		msec;			/* Time to send EPL job */
+  static const int ready[] =		/* Printer always ready */
+  {
+    TS_READY
+  };
+  static const int held[] =		/* Printer needs attention at first */
+  {
+    TS_PAPER_OUT, TS_HEAD_OPEN, TS_READY
+  };
+  static const char * const labels[] =	/* Labels that must print */
+  {
+    "label-1", "label-2", "label-3"
+  };
+
+
+  for (i = 1; i < argc; i ++)
+    if (!strcmp(argv[i], "-v"))
+      Verbose = 1;
+    else
+      LabelSend = argv[i];
+
+  status = 0;
+
+  signal(SIGPIPE, SIG_IGN);
+
+  if (!mkdtemp(dir))
+  {
+    perror("testlabelsend: Unable to create job directory");
+    return (1);
+  }
+
+  snprintf(eplfile, sizeof(eplfile), "%s/epl", dir);
+  snprintf(zplfile, sizeof(zplfile), "%s/zpl", dir);
+
+  if (write_job(eplfile, "\nN\nq812\nA10,10,0,3,1,1,N,\"epl-label\"\nP1\n") ||
+      write_job(zplfile, "^XA^FO10,10^FDlabel-1^FS^XZ\n"
+                         "^XA^FO10,10^FDlabel-2^FS^XZ\n"
+			 "^XA^FO10,10^FDlabel-3^FS^XZ\n"))
+  {
+    perror("testlabelsend: Unable to write job files");
+    status = 1;
+    goto done;
+  }
+
+  if ((listener = printer_listen()) < 0)
+  {
+    perror("testlabelsend: Unable to listen for labelsend");
+    status = 1;
+    goto done;
+  }
+
+ /*
+  * An EPL job goes straight out, since EPL printers don't answer ~HS...
+  */
+
+  fputs("labelsend EPL: ", stdout);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if ((pid = start_send(eplfile)) < 0)
+  {
+    puts("FAIL (unable to start labelsend)");
+    status = 1;
+    goto done;
+  }
+
+  queries = printer_serve(listener, ready, 0, first, sizeof(first));
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  msec = (end.tv_sec - start.tv_sec) * 1000 +
+         (end.tv_nsec - start.tv_nsec) / 1000000;
+
+  if (wait_send(pid, 5000))
+  {
+    puts("FAIL (labelsend did not finish)");
+    status = 1;
+  }
+  else if (queries || strstr(first, "~HS"))
+  {
+    puts("FAIL (status queried)");
+    status = 1;
+  }
+  else if (!strstr(first, "epl-label"))
+  {
+    puts("FAIL (label not printed)");
+    status = 1;
+  }
+  else if (msec >= 2500)
+  {
+    printf("FAIL (took %ld ms)\n", msec);
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+ /*
+  * A ZPL job is held while the printer is out of media or has its head
+  * open, then the printer goes offline after the first label...
+  */
+
+  fputs("labelsend ZPL held: ", stdout);
+
+  if ((pid = start_send(zplfile)) < 0)
+  {
+    puts("FAIL (unable to start labelsend)");
+    status = 1;
+    goto done;
+  }
+
+  queries = printer_serve(listener, held, 1, first, sizeof(first));
+
+  close(listener);
+
+  if (queries < 3)
+  {
+    printf("FAIL (label sent after %d status queries)\n", queries);
+    status = 1;
+  }
+  else if (!strstr(first, "label-1"))
+  {
+    puts("FAIL (first label not printed)");
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+  fputs("labelsend ZPL offline: ", stdout);
+
+  sleep(2);
+
+  if ((listener = printer_listen()) < 0)
+  {
+    printf("FAIL (unable to listen again: %s)\n", strerror(errno));
+    status = 1;
+    kill(pid, SIGTERM);
+    wait_send(pid, 5000);
+    goto done;
+  }
+
+  printer_serve(listener, ready, 0, second, sizeof(second));
+
+  for (i = 1; i < (int)(sizeof(labels) / sizeof(labels[0])); i ++)
+    if (!strstr(second, labels[i]))
+      break;
+
+  if (wait_send(pid, 5000))
+  {
+    puts("FAIL (labelsend did not finish)");
+    status = 1;
+  }
+  else if (i < (int)(sizeof(labels) / sizeof(labels[0])))
+  {
+    printf("FAIL (\"%s\" not printed after reconnecting)\n", labels[i]);
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+  close(listener);
+
+ /*
+  * Clean up...
+  */
+
+  done:
+
+  unlink(eplfile);
+  unlink(zplfile);
+  rmdir(dir);
+
+  return (status);
+}
+
+
+/*
+ * 'printer_listen()' - Listen for labelsend on the fake printer's port.
+ *
+ * The first call picks a free port; later calls listen on the same one.
+ */
+
+static int				/* O - Socket or -1 on error */
+printer_listen(void)
+{
+  int			fd;		/* Socket */
+  int			val = 1;	/* Socket option value */
+  struct sockaddr_in	addr;		/* Printer address */
+  socklen_t		addrlen;	/* Length of address */
+
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port        = htons(Port);
+  addrlen              = sizeof(addr);
+
+  if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    return (-1);
+
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(fd, 1) ||
+      getsockname(fd, (struct sockaddr *)&addr, &addrlen))
+  {
+    close(fd);
+    return (-1);
+  }
+
+  Port = ntohs(addr.sin_port);
+
+  return (fd);
+}
+
+
+/*
+ * 'printer_serve()' - Accept a connection and act as a ZPL printer.
+ *
+ * Each ~HS query is answered with the next of "states", which ends with
+ * TS_READY.  The connection is closed once "labels" labels have come in,
+ * or if "labels" is 0 when labelsend closes it.
+ */
+
+static int				/* O - Number of ~HS queries */
+printer_serve(int       listener,	/* I - Listening socket */
+              const int *states,	/* I - Status for each query */
+	      int       labels,		/* I - Labels to take or 0 for all */
+	      char      *buffer,	/* O - Data received */
+	      size_t    bufsize)	/* I - Size of buffer */
+{
+  int		i;			/* Looping var */
+  int		fd;			/* Connection */
+  int		queries,		/* ~HS queries answered */
+		count,			/* Queries or labels in buffer */
+		state;			/* Status to report */
+  size_t	length;			/* Bytes received */
+  ssize_t	bytes;			/* Bytes read */
+  char		*ptr,			/* Pointer into buffer */
+		reply[256];		/* ~HS reply */
+  struct pollfd	pfd;			/* Poll entry */
+
+
+  buffer[0] = '\0';
+
+  pfd.fd     = listener;
+  pfd.events = POLLIN;
+
+  if (poll(&pfd, 1, 10000) <= 0 || (fd = accept(listener, NULL, NULL)) < 0)
+    return (0);
+
+  pfd.fd  = fd;
+  length  = 0;
+  queries = 0;
+
+  while (length < bufsize - 1 && poll(&pfd, 1, 10000) > 0)
+  {
+    if ((bytes = read(fd, buffer + length, bufsize - 1 - length)) <= 0)
+      break;
+
+    length += (size_t)bytes;
+    buffer[length] = '\0';
+
+   /*
+    * Answer new status queries...
+    */
+
+    for (count = 0, ptr = buffer; (ptr = strstr(ptr, "~HS")) != NULL;
+         ptr += 3)
+      count ++;
+
+    for (; queries < count; queries ++)
+    {
+      for (i = 0; i < queries && states[i] != TS_READY; i ++);
+
+      state = states[i];
+
+     /*
+      * String 1 holds the paper out flag, string 2 the head up flag...
+      */
+
+      snprintf(reply, sizeof(reply),
+               "\002030,%d,0,1245,000,0,0,0,000,0,0,0\003\r\n"
+	       "\002000,0,%d,0,0,2,4,0,00000000,1,000\003\r\n"
+	       "\0021234,0\003\r\n",
+	       state == TS_PAPER_OUT, state == TS_HEAD_OPEN);
+
+      if (write(fd, reply, strlen(reply)) < 0)
+        break;
+    }
+
+    if (labels)
+    {
+      for (count = 0, ptr = buffer; (ptr = strstr(ptr, "^XZ")) != NULL;
+           ptr += 3)
+        count ++;
+
+      if (count >= labels)
+        break;
+    }
+  }
+
+  close(fd);
+
+  return (queries);
+}
+
+
+/*
+ * 'start_send()' - Start labelsend for a job file.
+ */
+
+static pid_t				/* O - Process ID or -1 on error */
+start_send(const char *filename)	/* I - Job file */
+{
+  pid_t	pid;				/* Child process */
+  char	printer[256];			/* Printer address */
+
+
+  snprintf(printer, sizeof(printer), "127.0.0.1:%d", Port);
+
+  fflush(stdout);
+
+  if ((pid = fork()) == 0)
+  {
+    if (!Verbose)
+      freopen("/dev/null", "w", stderr);
+
+    execl(LabelSend, "labelsend", "-t", "30", printer, filename,
+          (char *)NULL);
+    _exit(127);
+  }
+
+  return (pid);
+}
+
+
+/*
+ * 'wait_send()' - Wait for labelsend to finish.
+ */
+
+static int				/* O - 0 if finished OK, -1 otherwise */
+wait_send(pid_t pid,			/* I - Process ID */
+          int   msec)			/* I - Milliseconds to wait */
+{
+  int	status;				/* Exit status */
+
+
+  for (;;)
+  {
+    if (waitpid(pid, &status, WNOHANG) == pid)
+      return (WIFEXITED(status) && !WEXITSTATUS(status) ? 0 : -1);
+
+    if (msec <= 0)
+    {
+      kill(pid, SIGTERM);
+      waitpid(pid, NULL, 0);
+      return (-1);
+    }
+
+    usleep(10000);
+    msec -= 10;
+  }
+}
+
+
+/*
+ * 'write_job()' - Write a job file.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+write_job(const char *filename,		/* I - Job file */
+          const char *data)		/* I - Job data */
+{
+  int	fd;				/* Job file */
+  int	ok;				/* Written? */
+
+
+  if ((fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+    return (-1);
+
+  ok = write(fd, data, strlen(data)) == (ssize_t)strlen(data);
+
+  close(fd);
+
+  return (ok ? 0 : -1);
+}
+
+
+/*
+ * End of "$Id$".
+ */
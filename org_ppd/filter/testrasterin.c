@@ -0,0 +1,320 @@
+/*
+ * "$Id$"
+ *
+ *   Raster input test and benchmark program.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ *
+ *   Usage:
+ *
+ *     testrasterin [-n runs] file.ras ...
+ *
+ *   Build with "cc -o testrasterin testrasterin.c rasterin.c labellog.c
+ *   -lcups".  Reads each raster file with cupsRasterReadPixels() and with
+ *   the in-tree reader, both mapped from the file and streamed through a
+ *   pipe as from the scheduler.  Every line must match what libcups
+ *   returns; the best time of "runs" reads (default 5) is reported for
+ *   each reader.
+ *
+ * Contents:
+ *
+ *   main()      - Compare and time the raster readers.
+ *   hash_line() - Add a line to a running hash.
+ *   read_cups() - Read a raster file with libcups.
+ *   read_in()   - Read a raster file with the in-tree reader.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include "rasterin.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/wait.h>
+
+
+/*
+ * Local functions...
+ */
+
+static uint64_t	hash_line(uint64_t hash, const unsigned char *line,
+		          unsigned length);
+static double	read_cups(const char *filename, uint64_t *hash, long *rows);
+static double	read_in(const char *filename, int streamed, uint64_t *hash,
+		        long *rows);
+
+
+/*
+ * 'main()' - Compare and time the raster readers.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line args */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		i,			/* Looping var */
+		run,			/* Current run */
+		runs = 5;		/* Number of runs */
+  int		status = 0;		/* Exit status */
+  int		reader;			/* Current reader */
+  double	secs,			/* Time for this run */
+		best[3];		/* Best time for each reader */
+  uint64_t	hash[3];		/* Hash of lines from each reader */
+  long		rows[3];		/* Lines from each reader */
+  static const char * const names[] =	/* Reader names */
+  {
+    "libcups", "mapped", "streamed"
+  };
+
+
+  signal(SIGPIPE, SIG_IGN);
+
+  for (i = 1; i < argc; i ++)
+  {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc)
+    {
+      if ((runs = atoi(argv[++ i])) < 1)
+        runs = 1;
+      continue;
+    }
+
+    for (reader = 0; reader < 3; reader ++)
+    {
+      best[reader] = -1.0;
+
+      for (run = 0; run < runs; run ++)
+      {
+        hash[reader] = 0;
+	rows[reader] = 0;
+
+        if (reader == 0)
+	  secs = read_cups(argv[i], hash + reader, rows + reader);
+	else
+	  secs = read_in(argv[i], reader == 2, hash + reader, rows + reader);
+
+        if (secs < 0.0)
+	  break;
+
+        if (best[reader] < 0.0 || secs < best[reader])
+	  best[reader] = secs;
+      }
+    }
+
+    printf("%s:\n", argv[i]);
+
+    for (reader = 0; reader < 3; reader ++)
+    {
+      printf("    %-8s: ", names[reader]);
+
+      if (best[reader] < 0.0)
+      {
+        puts("FAIL (unable to read file)");
+	status = 1;
+      }
+      else if (reader > 0 &&
+               (hash[reader] != hash[0] || rows[reader] != rows[0]))
+      {
+        printf("FAIL (%ld lines differ from libcups)\n", rows[reader]);
+	status = 1;
+      }
+      else
+        printf("PASS, %ld lines in %.3f ms (%.0f lines/sec, %.2fx)\n",
+	       rows[reader], 1000.0 * best[reader],
+	       best[reader] > 0.0 ? rows[reader] / best[reader] : 0.0,
+	       best[reader] > 0.0 ? best[0] / best[reader] : 0.0);
+    }
+  }
+
+  if (argc < 2)
+  {
+    fputs("Usage: testrasterin [-n runs] file.ras ...\n", stderr);
+    return (1);
+  }
+
+  return (status);
+}
+
+
+/*
+ * 'hash_line()' - Add a line to a running hash.
+ */
+
+static uint64_t				/* O - New hash */
+hash_line(uint64_t            hash,	/* I - Hash so far */
+          const unsigned char *line,	/* I - Line */
+	  unsigned            length)	/* I - Bytes in line */
+{
+  if (!hash)
+    hash = 0xcbf29ce484222325ULL;
+
+  while (length > 0)
+  {
+    hash ^= *line++;
+    hash *= 0x100000001b3ULL;
+    length --;
+  }
+
+  return (hash);
+}
+
+
+/*
+ * 'read_cups()' - Read a raster file with libcups.
+ */
+
+static double				/* O - Seconds or -1.0 on error */
+read_cups(const char *filename,		/* I - Raster file */
+          uint64_t   *hash,		/* O - Hash of lines */
+	  long       *rows)		/* O - Number of lines */
+{
+  int			fd;		/* Raster file */
+  unsigned		y;		/* Current line */
+  cups_raster_t		*ras;		/* Raster stream */
+  cups_page_header2_t	header;		/* Page header */
+  unsigned char		*line = NULL;	/* Line buffer */
+  struct timespec	start,		/* Start of read */
+			end;		/* End of read */
+
+
+  if ((fd = open(filename, O_RDONLY)) < 0)
+    return (-1.0);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if ((ras = cupsRasterOpen(fd, CUPS_RASTER_READ)) == NULL)
+  {
+    close(fd);
+    return (-1.0);
+  }
+
+  while (cupsRasterReadHeader2(ras, &header))
+  {
+    if ((line = realloc(line, header.cupsBytesPerLine + 1)) == NULL)
+      break;
+
+    for (y = 0; y < header.cupsHeight; y ++)
+    {
+      if (cupsRasterReadPixels(ras, line, header.cupsBytesPerLine) < 1)
+        break;
+
+      *hash = hash_line(*hash, line, header.cupsBytesPerLine);
+      (*rows) ++;
+    }
+  }
+
+  cupsRasterClose(ras);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  free(line);
+  close(fd);
+
+  return (end.tv_sec - start.tv_sec + 0.000000001 * (end.tv_nsec -
+                                                     start.tv_nsec));
+}
+
+
+/*
+ * 'read_in()' - Read a raster file with the in-tree reader.
+ *
+ * A streamed read gets the file through a pipe from a child process.
+ */
+
+static double				/* O - Seconds or -1.0 on error */
+read_in(const char *filename,		/* I - Raster file */
+        int        streamed,		/* I - Read through a pipe? */
+        uint64_t   *hash,		/* O - Hash of lines */
+	long       *rows)		/* O - Number of lines */
+{
+  int			fd;		/* Raster file or pipe */
+  int			fds[2];		/* Pipe */
+  unsigned		y;		/* Current line */
+  pid_t			pid = 0;	/* Writer process */
+  ssize_t		bytes;		/* Bytes read */
+  char			buffer[65536];	/* Copy buffer */
+  raster_in_t		*ras;		/* Raster stream */
+  cups_page_header2_t	header;		/* Page header */
+  const unsigned char	*line;		/* Line read */
+  struct timespec	start,		/* Start of read */
+			end;		/* End of read */
+
+
+  if ((fd = open(filename, O_RDONLY)) < 0)
+    return (-1.0);
+
+  if (streamed)
+  {
+    if (pipe(fds))
+    {
+      close(fd);
+      return (-1.0);
+    }
+
+    if ((pid = fork()) == 0)
+    {
+      close(fds[0]);
+
+      while ((bytes = read(fd, buffer, sizeof(buffer))) > 0)
+        if (write(fds[1], buffer, (size_t)bytes) != bytes)
+	  break;
+
+      _exit(0);
+    }
+
+    close(fd);
+    close(fds[1]);
+
+    fd = fds[0];
+
+    if (pid < 0)
+    {
+      close(fd);
+      return (-1.0);
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if ((ras = RasterInOpen(fd, 0)) != NULL)
+  {
+    while (RasterInReadHeader(ras, &header))
+      for (y = 0; y < header.cupsHeight; y ++)
+      {
+	if ((line = RasterInReadLine(ras)) == NULL)
+	  break;
+
+	*hash = hash_line(*hash, line, header.cupsBytesPerLine);
+	(*rows) ++;
+      }
+
+    RasterInClose(ras);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  close(fd);
+
+  if (pid > 0)
+    waitpid(pid, NULL, 0);
+
+  if (!ras)
+    return (-1.0);
+
+  return (end.tv_sec - start.tv_sec + 0.000000001 * (end.tv_nsec -
+                                                     start.tv_nsec));
+}
+
+
+/*
+ * End of "$Id$".
+ */
@@ -0,0 +1,484 @@
+/*
+ * "$Id$"
+ *
+ *   ZPL flow control test program.
+ *
+ *   These coded instructions, statements, and computer programs are the
+ *   property of Apple Inc. and are protected by Federal copyright
+ *   law.  Distribution and use rights are outlined in the file "LICENSE.txt"
+ *   which should have been included with this file.  If this file is
+ *   file is missing or damaged, see the license at "http://www.cups.org/".
+ *
+ *   Usage:
+ *
+ *     testzplstatus [-v] [rastertolabel [ppd-file]]
+ *
+ *   Build with "cc -o testzplstatus testzplstatus.c" and run from the
+ *   directory holding rastertolabel; the PPD file defaults to the ZPL
+ *   PPD at the top of the tree.  Prints a two label job with
+ *   zeFlowControl=1, acting as the printer on the filter's output and back
+ *   channel.  The ~HS replies report the printer out of media, then its
+ *   head open, then ready:
+ *
+ *     - No label may be sent until the printer is ready.
+ *     - The media-empty-error and cover-open-error reasons must be set
+ *       while the printer reports them and cleared after.
+ *     - A printer that stops answering must not hold the job; flow
+ *       control is turned off after the status timeout.
+ *
+ * Contents:
+ *
+ *   main()        - Run the flow control tests.
+ *   run_filter()  - Run rastertolabel with a fake printer on its output
+ *                   and back channel.
+ *   write_page()  - Write a page of raster data.
+ */
+
+/*
+ * Include necessary headers...
+ */
+
+#include <cups/raster.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+
+/*
+ * Constants...
+ */
+
+#define TZ_READY	0		/* Printer ready */
+#define TZ_PAPER_OUT	1		/* Printer out of media */
+#define TZ_HEAD_OPEN	2		/* Printer head open */
+#define TZ_SILENT	3		/* Printer does not answer */
+
+#define TZ_WIDTH	203		/* Label width in pixels */
+#define TZ_HEIGHT	100		/* Label height in pixels */
+
+
+/*
+ * Local globals...
+ */
+
+static const char *Filter = "./rastertolabel";
+					/* Filter program */
+static const char *PPDFile = "../../Zebra_ZPL_EN_DE.ppd";
+					/* PPD file */
+static int	Verbose = 0;		/* Show filter messages? */
+
+
+/*
+ * Local functions...
+ */
+
+static int	run_filter(const char *rasfile, const char *errfile,
+		           const int *states, char *buffer, size_t bufsize,
+			   int *held);
+static int	write_page(int fd);
+
+
+/*
+ * 'main()' - Run the flow control tests.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line args */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		i, j;			/* Looping vars */
+  int		status;			/* Exit status */
+  int		fd;			/* Raster file */
+  int		held;			/* Label data sent while held */
+  unsigned	sync = 0x52615333;	/* "RaS3" sync word */
+  FILE		*fp;			/* Filter messages */
+  char		dir[] = "/tmp/testzplstatusXXXXXX",
+					/* Job directory */
+		rasfile[1024],		/* Raster file */
+		errfile[1024],		/* Filter messages */
+		line[1024],		/* Line from filter messages */
+		output[65536];		/* Filter output */
+  const char	*ptr;			/* Pointer into output */
+  int		set[2],			/* Reasons set */
+		cleared[2];		/* Reasons cleared */
+  static const int held_states[] =	/* Out of media, head open, ready */
+  {
+    TZ_PAPER_OUT, TZ_PAPER_OUT, TZ_HEAD_OPEN, TZ_READY
+  };
+  static const int silent_states[] =	/* Printer never answers */
+  {
+    TZ_SILENT
+  };
+  static const char * const reasons[] =	/* Reasons to check */
+  {
+    "media-empty-error", "cover-open-error"
+  };
+
+
+  for (i = 1, j = 0; i < argc; i ++)
+    if (!strcmp(argv[i], "-v"))
+      Verbose = 1;
+    else if (j ++ == 0)
+      Filter = argv[i];
+    else
+      PPDFile = argv[i];
+
+  status = 0;
+
+  signal(SIGPIPE, SIG_IGN);
+
+ /*
+  * Write a two label job...
+  */
+
+  if (!mkdtemp(dir))
+  {
+    perror("testzplstatus: Unable to create job directory");
+    return (1);
+  }
+
+  snprintf(rasfile, sizeof(rasfile), "%s/job.ras", dir);
+  snprintf(errfile, sizeof(errfile), "%s/job.err", dir);
+
+  if ((fd = open(rasfile, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0 ||
+      write(fd, &sync, sizeof(sync)) != sizeof(sync) ||
+      write_page(fd) || write_page(fd))
+  {
+    perror("testzplstatus: Unable to write raster file");
+    status = 1;
+    goto done;
+  }
+
+  close(fd);
+
+ /*
+  * Out of media, then head open, then ready...
+  */
+
+  fputs("ZPLWaitPrinter: ", stdout);
+
+  if (run_filter(rasfile, errfile, held_states, output, sizeof(output),
+                 &held))
+  {
+    puts("FAIL (filter failed)");
+    status = 1;
+  }
+  else if (held)
+  {
+    puts("FAIL (label sent while printer needs attention)");
+    status = 1;
+  }
+  else if ((ptr = strstr(output, "^XA")) == NULL ||
+           (ptr = strstr(ptr + 3, "^XA")) == NULL)
+  {
+    puts("FAIL (labels not printed)");
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+  fputs("printer-state-reasons: ", stdout);
+
+  memset(set, 0, sizeof(set));
+  memset(cleared, 0, sizeof(cleared));
+
+  if ((fp = fopen(errfile, "r")) != NULL)
+  {
+    while (fgets(line, sizeof(line), fp))
+    {
+      if (Verbose)
+        fputs(line, stderr);
+
+      for (i = 0; i < 2; i ++)
+      {
+        if (strncmp(line, "STATE: ", 7) ||
+	    strncmp(line + 8, reasons[i], strlen(reasons[i])))
+	  continue;
+
+        if (line[7] == '+' && !cleared[i])
+	  set[i] = 1;
+	else if (line[7] == '-' && set[i])
+	  cleared[i] = 1;
+      }
+    }
+
+    fclose(fp);
+  }
+
+  for (i = 0; i < 2; i ++)
+    if (!set[i] || !cleared[i])
+      break;
+
+  if (i < 2)
+  {
+    printf("FAIL (%s not %s)\n", reasons[i], set[i] ? "cleared" : "set");
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+ /*
+  * A printer that never answers only delays the first label...
+  */
+
+  fputs("ZPLReadStatus(timeout): ", stdout);
+
+  if (run_filter(rasfile, errfile, silent_states, output, sizeof(output),
+                 &held))
+  {
+    puts("FAIL (filter failed)");
+    status = 1;
+  }
+  else if ((ptr = strstr(output, "^XA")) == NULL ||
+           (ptr = strstr(ptr + 3, "^XA")) == NULL)
+  {
+    puts("FAIL (labels not printed)");
+    status = 1;
+  }
+  else if ((ptr = strstr(output, "~HS")) != NULL && strstr(ptr + 3, "~HS"))
+  {
+    puts("FAIL (status polled after timeout)");
+    status = 1;
+  }
+  else
+    puts("PASS");
+
+ /*
+  * Clean up...
+  */
+
+  done:
+
+  unlink(rasfile);
+  unlink(errfile);
+  rmdir(dir);
+
+  return (status);
+}
+
+
+/*
+ * 'run_filter()' - Run rastertolabel with a fake printer on its output and
+ *                  back channel.
+ *
+ * Each ~HS query is answered with the next of "states", which ends with
+ * TZ_READY or TZ_SILENT.  "held" is set if anything but a status query
+ * came from the filter between the first query and the first ready reply.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+run_filter(const char *rasfile,		/* I - Raster file */
+           const char *errfile,		/* I - File for filter messages */
+	   const int  *states,		/* I - Status for each query */
+	   char       *buffer,		/* O - Filter output */
+	   size_t     bufsize,		/* I - Size of buffer */
+	   int        *held)		/* O - Label data sent while held */
+{
+  int		i;			/* Looping var */
+  int		outpipe[2],		/* Filter output */
+		backpipe[2];		/* Back channel */
+  int		fd,			/* Message file */
+		outfd,			/* Output for filter */
+		backfd;			/* Back channel for filter */
+  int		queries,		/* ~HS queries answered */
+		count,			/* Queries in buffer */
+		state,			/* Status to report */
+		ready;			/* Ready reply sent? */
+  int		exitstatus;		/* Filter exit status */
+  pid_t		pid;			/* Filter process */
+  size_t	length;			/* Bytes of output */
+  ssize_t	bytes;			/* Bytes read */
+  char		*ptr,			/* Pointer into buffer */
+		*first,			/* First status query */
+		reply[256];		/* ~HS reply */
+  struct pollfd	pfd;			/* Poll entry */
+
+
+  *held     = 0;
+  buffer[0] = '\0';
+
+  if (pipe(outpipe))
+    return (-1);
+
+  if (pipe(backpipe))
+  {
+    close(outpipe[0]);
+    close(outpipe[1]);
+    return (-1);
+  }
+
+  fflush(stdout);
+
+  if ((pid = fork()) == 0)
+  {
+   /*
+    * Standard output is the printer and file descriptor 3 the back
+    * channel, as under the CUPS scheduler; the pipes are moved out of the
+    * way first since one of them may already be file descriptor 3...
+    */
+
+    outfd  = fcntl(outpipe[1], F_DUPFD, 10);
+    backfd = fcntl(backpipe[0], F_DUPFD, 10);
+
+    close(outpipe[0]);
+    close(outpipe[1]);
+    close(backpipe[0]);
+    close(backpipe[1]);
+
+    dup2(outfd, 1);
+    dup2(backfd, 3);
+    close(outfd);
+    close(backfd);
+
+    if ((fd = open(errfile, O_WRONLY | O_CREAT | O_TRUNC, 0600)) >= 0)
+    {
+      dup2(fd, 2);
+      close(fd);
+    }
+
+    setenv("PPD", PPDFile, 1);
+    unsetenv("PRINTER");
+
+    execl(Filter, "rastertolabel", "1", "test", "testzplstatus", "1",
+          "zeFlowControl=1", rasfile, (char *)NULL);
+    _exit(127);
+  }
+
+  close(outpipe[1]);
+  close(backpipe[0]);
+
+  if (pid < 0)
+  {
+    close(outpipe[0]);
+    close(backpipe[1]);
+    return (-1);
+  }
+
+ /*
+  * Act as the printer until the filter closes its output...
+  */
+
+  pfd.fd     = outpipe[0];
+  pfd.events = POLLIN;
+  length     = 0;
+  queries    = 0;
+  ready      = 0;
+
+  while (length < bufsize - 1 && poll(&pfd, 1, 30000) > 0)
+  {
+    if ((bytes = read(outpipe[0], buffer + length,
+                      bufsize - 1 - length)) <= 0)
+      break;
+
+    length += (size_t)bytes;
+    buffer[length] = '\0';
+
+   /*
+    * Anything other than a status query before the printer is ready is
+    * a label sent to a printer that cannot take it...
+    */
+
+    if (!ready && (first = strstr(buffer, "~HS")) != NULL)
+    {
+      for (ptr = first; *ptr; ptr += 4)
+        if (strncmp(ptr, "~HS\n", 4))
+	{
+	  if (strlen(ptr) >= 4)
+	    *held = 1;
+	  break;
+	}
+    }
+
+    for (count = 0, ptr = buffer; (ptr = strstr(ptr, "~HS")) != NULL;
+         ptr += 3)
+      count ++;
+
+    for (; queries < count; queries ++)
+    {
+      for (i = 0; i < queries && states[i] != TZ_READY &&
+                  states[i] != TZ_SILENT; i ++);
+
+      if ((state = states[i]) == TZ_SILENT)
+        continue;
+
+      if (state == TZ_READY)
+        ready = 1;
+
+     /*
+      * String 1 holds the paper out flag, string 2 the head up flag...
+      */
+
+      snprintf(reply, sizeof(reply),
+               "\002030,%d,0,1245,000,0,0,0,000,0,0,0\003\r\n"
+	       "\002000,0,%d,0,0,2,4,0,00000000,1,000\003\r\n"
+	       "\0021234,0\003\r\n",
+	       state == TZ_PAPER_OUT, state == TZ_HEAD_OPEN);
+
+      if (write(backpipe[1], reply, strlen(reply)) < 0)
+        break;
+    }
+  }
+
+  close(outpipe[0]);
+  close(backpipe[1]);
+
+  if (waitpid(pid, &exitstatus, 0) != pid || !WIFEXITED(exitstatus) ||
+      WEXITSTATUS(exitstatus))
+    return (-1);
+
+  return (0);
+}
+
+
+/*
+ * 'write_page()' - Write a page of raster data.
+ */
+
+static int				/* O - 0 on success, -1 on error */
+write_page(int fd)			/* I - Raster file */
+{
+  int			y;		/* Current line */
+  cups_page_header2_t	header;		/* Page header */
+  unsigned char		line[(TZ_WIDTH + 7) / 8];
+					/* Line of graphics */
+
+
+  memset(&header, 0, sizeof(header));
+
+  header.HWResolution[0]  = 203;
+  header.HWResolution[1]  = 203;
+  header.NumCopies        = 1;
+  header.PageSize[0]      = TZ_WIDTH * 72 / 203;
+  header.PageSize[1]      = TZ_HEIGHT * 72 / 203;
+  header.cupsWidth        = TZ_WIDTH;
+  header.cupsHeight       = TZ_HEIGHT;
+  header.cupsBitsPerColor = 1;
+  header.cupsBitsPerPixel = 1;
+  header.cupsBytesPerLine = sizeof(line);
+  header.cupsColorOrder   = CUPS_ORDER_CHUNKED;
+  header.cupsColorSpace   = CUPS_CSPACE_K;
+
+  if (write(fd, &header, sizeof(header)) != sizeof(header))
+    return (-1);
+
+  for (y = 0; y < TZ_HEIGHT; y ++)
+  {
+    memset(line, (y / 10) & 1 ? 0xff : 0x00, sizeof(line));
+
+    if (write(fd, line, sizeof(line)) != sizeof(line))
+      return (-1);
+  }
+
+  return (0);
+}
+
+
+/*
+ * End of "$Id$".
+ */